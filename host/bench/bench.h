@@ -0,0 +1,43 @@
+/*  Helpers of the host benchmarks. Each result is printed as one JSON
+*   object per line, so the results can be compared between builds:
+*   {"benchmark":"<name>","ns_per_call":<ns>,"calls":<n>,...}
+*   The absolute numbers depend on the host, the ratio between the
+*   benchmarks and between two builds on the same host shows regressions.
+*/
+#ifndef __BENCH__
+#define __BENCH__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <time.h>
+
+static uint64_t bench_now_ns(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t)time.tv_sec * 1000000000 + time.tv_nsec;
+}
+
+/**@brief print a result, extra_format adds members to the object
+ * 
+ * @details extra_format starts with a comma, e.g. ",\"bytes\":%d", or is
+ * NULL without further members
+ */
+static void bench_report(const char *name, uint64_t duration_ns,
+    uint64_t calls, const char *extra_format, ...)
+{
+    printf("{\"benchmark\":\"%s\",\"ns_per_call\":%.2f,\"calls\":%llu",
+        name, calls ? (double)duration_ns / calls : 0.0,
+        (unsigned long long)calls);
+    if (extra_format)
+    {
+        va_list args;
+        va_start(args, extra_format);
+        vprintf(extra_format, args);
+        va_end(args);
+    }
+    printf("}\n");
+}
+
+#endif /* __BENCH__ */
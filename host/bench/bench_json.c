@@ -0,0 +1,313 @@
+/*  Measures the JSON scanner of the command path on the host: the lookup
+*   of a single value at different payload sizes, the lookups of a complete
+*   position command and the scan of scenes. The results are printed as
+*   JSON lines, see bench.h.
+*   The position commands of the JSON and the binary topic are compared
+*   through the command handler, both hand the same command over to the
+*   position queue, so the difference is the decoding.
+*   When cJSON is found the same payloads also get parsed with cJSON like
+*   the firmware did before the scanner. malloc is hooked, so every result
+*   contains the allocations and the allocated bytes per call.
+*/
+#include <string.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "json_parser.h"
+#include "host_app.h"
+#include "command_handler.h"
+#if HAVE_CJSON
+#include "cJSON.h"
+#endif
+
+#define PAYLOAD_SIZE_MAX    4096
+#define VALUE_CALLS         200000
+#define SCENE_BYTES         2000000 /* scanned bytes per scene benchmark */
+#define DECODE_CALLS        200000
+
+/*  keeps the compiler from dropping the measured calls */
+static volatile int64_t sink;
+static char payload[PAYLOAD_SIZE_MAX + 64];
+static uint64_t allocations;
+static uint64_t allocated_bytes;
+
+/*  the allocator of glibc, the functions below count the calls to it */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+void *malloc(size_t size)
+{
+    ++allocations;
+    allocated_bytes += size;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    ++allocations;
+    allocated_bytes += count * size;
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    ++allocations;
+    allocated_bytes += size;
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+    __libc_free(ptr);
+}
+
+/*  counters of the allocator at the start of a benchmark */
+typedef struct {
+    uint64_t start_ns;
+    uint64_t allocations;
+    uint64_t allocated_bytes;
+} measurement_t;
+
+static measurement_t measure_start(void)
+{
+    return (measurement_t){ bench_now_ns(), allocations, allocated_bytes };
+}
+
+/**@brief print a result with the allocations per call
+ */
+static void measure_report(const measurement_t *start, const char *name,
+    uint64_t calls, int bytes)
+{
+    const uint64_t duration = bench_now_ns() - start->start_ns;
+    bench_report(name, duration, calls,
+        ",\"bytes\":%d,\"allocations_per_call\":%.2f,"
+        "\"allocated_bytes_per_call\":%.2f,\"messages_per_s\":%.0f",
+        bytes, (double)(allocations - start->allocations) / calls,
+        (double)(allocated_bytes - start->allocated_bytes) / calls,
+        duration ? calls * 1e9 / duration : 0.0);
+}
+
+/**@brief build a command of the given size, a padding string in front of
+ * the value has to be skipped by the scanner
+ */
+static int build_padded_command(int size)
+{
+    const char tail[] = "\",\"value\":50,\"speed\":800,\"seq\":12}";
+    int len = snprintf(payload, sizeof(payload), "{\"padding\":\"");
+    const int padding = size - len - (int)strlen(tail);
+    for (int i = 0; i < padding; ++i) payload[len++] = 'x';
+    len += snprintf(payload + len, sizeof(payload) - len, "%s", tail);
+    return len;
+}
+
+/**@brief build a scene with the given amount of entries
+ */
+static int build_scene(int entries)
+{
+    int len = snprintf(payload, sizeof(payload), "{\"seq\":12,\"scene\":[");
+    for (int i = 0; i < entries; ++i)
+    {
+        len += snprintf(payload + len, sizeof(payload) - len,
+            "%s{\"id\":%d,\"value\":%d,\"speed\":800}", i ? "," : "",
+            i % 16, i % 101);
+    }
+    len += snprintf(payload + len, sizeof(payload) - len, "]}");
+    return len;
+}
+
+/**@brief lookup of the position, like json_find_uint8 does it
+ */
+static void bench_value(int size)
+{
+    const int len = build_padded_command(size);
+    int64_t value = 0;
+    const measurement_t start = measure_start();
+    for (int i = 0; i < VALUE_CALLS; ++i)
+    {
+        json_get_int(payload, len, "value", &value);
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "json_value_%d", size);
+    measure_report(&start, name, VALUE_CALLS, len);
+    sink = value;
+}
+
+/**@brief all lookups of a position command: value, speed, seq and start
+ */
+static void bench_command(int size)
+{
+    const int len = build_padded_command(size);
+    int64_t value = 0;
+    const measurement_t start = measure_start();
+    for (int i = 0; i < VALUE_CALLS / 4; ++i)
+    {
+        json_get_int(payload, len, "value", &value);
+        json_get_int(payload, len, "speed", &value);
+        json_get_int(payload, len, "seq", &value);
+        json_get_int(payload, len, "start", &value);
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "json_command_%d", size);
+    measure_report(&start, name, VALUE_CALLS / 4, len);
+    sink = value;
+}
+
+#if HAVE_CJSON
+/**@brief the same lookups with a cJSON tree, like the firmware before the
+ * scanner, the tree gets deleted after each message
+ */
+static void bench_cjson_command(int size)
+{
+    build_padded_command(size);
+    const int len = strlen(payload);
+    int64_t value = 0;
+    const char *keys[] = { "value", "speed", "seq", "start" };
+    const measurement_t start = measure_start();
+    for (int i = 0; i < VALUE_CALLS / 4; ++i)
+    {
+        cJSON *json = cJSON_Parse(payload);
+        for (size_t key = 0; key < sizeof(keys) / sizeof(keys[0]); ++key)
+        {
+            const cJSON *item = cJSON_GetObjectItemCaseSensitive(json,
+                keys[key]);
+            if (cJSON_IsNumber(item)) value = item->valueint;
+        }
+        cJSON_Delete(json);
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "cjson_command_%d", size);
+    measure_report(&start, name, VALUE_CALLS / 4, len);
+    sink = value;
+}
+#endif
+
+/**@brief scan of a scene like the command handler does it
+ */
+static void bench_scene(int entries)
+{
+    const int len = build_scene(entries);
+    const int calls = SCENE_BYTES / len + 1;
+    int64_t value = 0;
+    const measurement_t start = measure_start();
+    for (int i = 0; i < calls; ++i)
+    {
+        json_scanner_t scene;
+        json_scanner_t entry;
+        json_find(payload, len, "scene", &scene);
+        while (json_array_next(&scene, &entry) == ESP_OK)
+        {
+            const int entry_len = entry.end - entry.pos;
+            json_get_int(entry.pos, entry_len, "id", &value);
+            json_get_int(entry.pos, entry_len, "value", &value);
+            json_get_int(entry.pos, entry_len, "speed", &value);
+        }
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "json_scene_%d", entries);
+    measure_report(&start, name, calls, len);
+    sink = value;
+}
+
+#if HAVE_CJSON
+/**@brief the same scene as a cJSON tree
+ */
+static void bench_cjson_scene(int entries)
+{
+    const int len = build_scene(entries);
+    const int calls = SCENE_BYTES / len + 1;
+    int64_t value = 0;
+    const measurement_t start = measure_start();
+    for (int i = 0; i < calls; ++i)
+    {
+        cJSON *json = cJSON_Parse(payload);
+        const cJSON *scene = cJSON_GetObjectItemCaseSensitive(json, "scene");
+        const cJSON *entry;
+        cJSON_ArrayForEach(entry, scene)
+        {
+            const cJSON *id = cJSON_GetObjectItemCaseSensitive(entry, "id");
+            const cJSON *position = cJSON_GetObjectItemCaseSensitive(entry,
+                "value");
+            const cJSON *speed = cJSON_GetObjectItemCaseSensitive(entry,
+                "speed");
+            if (cJSON_IsNumber(id) && cJSON_IsNumber(position)
+                && cJSON_IsNumber(speed))
+            {
+                value += id->valueint + position->valueint + speed->valueint;
+            }
+        }
+        cJSON_Delete(json);
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "cjson_scene_%d", entries);
+    measure_report(&start, name, calls, len);
+    sink = value;
+}
+#endif
+
+/**@brief a position command of the JSON topic through the command handler
+ */
+static void bench_decode_json(void)
+{
+    const char topic[] = "blindcontrol/0";
+    const char command[] = "{\"value\":50,\"speed\":800}";
+    const measurement_t start = measure_start();
+    for (int i = 0; i < DECODE_CALLS; ++i)
+    {
+        command_handler_process(topic, sizeof(topic) - 1, command,
+            sizeof(command) - 1, 0);
+    }
+    measure_report(&start, "decode_json_command", DECODE_CALLS,
+        sizeof(command) - 1);
+}
+
+/**@brief the same command as frame of the binary topic
+ */
+static void bench_decode_binary(void)
+{
+    const char topic[] = "blindcontrol/bin";
+    /*  actuator 0, 50%, speed 800, no sequence number */
+    const char frame[] = { 0, 50, 800 & 0xFF, 800 >> 8, 0, 0, 0, 0 };
+    const measurement_t start = measure_start();
+    for (int i = 0; i < DECODE_CALLS; ++i)
+    {
+        command_handler_process(topic, sizeof(topic) - 1, frame,
+            sizeof(frame), 0);
+    }
+    measure_report(&start, "decode_binary_command", DECODE_CALLS,
+        sizeof(frame));
+}
+
+int main(void)
+{
+    /*  the queues for the command handler, the tasks are not needed */
+    if (host_app_init() != ESP_OK)
+    {
+        fprintf(stderr, "initialization of the firmware failed\n");
+        return 1;
+    }
+
+    for (int size = 64; size <= PAYLOAD_SIZE_MAX; size *= 4)
+    {
+        bench_value(size);
+    }
+    for (int size = 64; size <= PAYLOAD_SIZE_MAX; size *= 4)
+    {
+        bench_command(size);
+    }
+    bench_scene(4);
+    bench_scene(32);
+    bench_scene(100);
+    bench_decode_json();
+    bench_decode_binary();
+#if HAVE_CJSON
+    for (int size = 64; size <= PAYLOAD_SIZE_MAX; size *= 4)
+    {
+        bench_cjson_command(size);
+    }
+    bench_cjson_scene(4);
+    bench_cjson_scene(32);
+    bench_cjson_scene(100);
+#endif
+    return 0;
+}
@@ -0,0 +1,89 @@
+/*  Measures the simulated latency from a received command to the first
+*   step. The latency is taken from the virtual time of the simulation, so
+*   it shows the delays the firmware schedules (start delay, hold times,
+*   task wake ups), not the cpu time of the host. ns_per_call is the host
+*   cpu time of the command handler for a command. The results are printed
+*   as JSON lines, see bench.h.
+*/
+#include "bench.h"
+#include "host_platform.h"
+#include "host_app.h"
+#include "actuator.h"
+#include "latency_stats.h"
+
+#define SECONDS(s)      ((uint64_t)(s) * 1000000)
+#define MOVES           50
+
+/**@brief move back and forth by 1% and measure the first step of each move
+ * 
+ * @details without scene only actuator 0 gets a command, with scene all
+ * actuators get moved by a single scene
+ */
+static void bench_first_step(const char *name, bool scene)
+{
+    uint32_t max_us = 0;
+    uint64_t sum_us = 0;
+    uint32_t moves = 0;
+    uint64_t duration = 0;
+    char command[512];
+
+    for (int i = 0; i < MOVES; ++i)
+    {
+        const int value = 40 + i % 2;
+        latency_histogram_t before;
+        latency_histogram_t after;
+        latency_stats_get(LATENCY_FIRST_STEP, &before);
+
+        uint64_t start = bench_now_ns();
+        if (scene)
+        {
+            int len = snprintf(command, sizeof(command), "{\"scene\":[");
+            for (uint8_t id = 0; id < ACTUATOR_COUNT; ++id)
+            {
+                len += snprintf(command + len, sizeof(command) - len,
+                    "%s{\"id\":%d,\"value\":%d}", id ? "," : "", id, value);
+            }
+            len += snprintf(command + len, sizeof(command) - len, "]}");
+            host_app_inject("blindcontrol/scene", command, len);
+        } else {
+            const int len = snprintf(command, sizeof(command),
+                "{\"value\":%d}", value);
+            host_app_inject("blindcontrol/0", command, len);
+        }
+        duration += bench_now_ns() - start;
+
+        if (!host_app_run_until_idle(SECONDS(10)))
+        {
+            fprintf(stderr, "%s: move %d did not finish\n", name, i);
+            continue;
+        }
+        latency_stats_get(LATENCY_FIRST_STEP, &after);
+
+        /*  the maximum of this run, the histogram keeps the one since boot */
+        const uint32_t count = after.count - before.count;
+        if (!count) continue;
+        const uint32_t latency = (after.sum_us - before.sum_us) / count;
+        if (latency > max_us) max_us = latency;
+        sum_us += latency;
+        ++moves;
+    }
+
+    bench_report(name, duration, MOVES, ",\"moves\":%u,\"mean_us\":%u,"
+        "\"max_us\":%u", (unsigned)moves,
+        moves ? (unsigned)(sum_us / moves) : 0, (unsigned)max_us);
+}
+
+int main(void)
+{
+    host_nvs_erase();
+    if (host_app_init() != ESP_OK || host_app_start() != ESP_OK
+        || !host_app_run_until_idle(SECONDS(60)))
+    {
+        fprintf(stderr, "start of the firmware failed\n");
+        return 1;
+    }
+
+    bench_first_step("first_step_command", false);
+    bench_first_step("first_step_scene", true);
+    return 0;
+}
@@ -0,0 +1,66 @@
+/*  Measures the cost of the motion planner per step on the host, the
+*   results are printed as JSON lines, see bench.h.
+*/
+#include "bench.h"
+#include "sdkconfig.h"
+#include "motion_planner.h"
+
+#define MOVE_STEPS      2000
+#define MOVES           5000
+
+/*  keeps the compiler from dropping the measured calls */
+static volatile uint32_t sink;
+
+/**@brief the ramp table gets built once at boot
+ */
+static void bench_init(void)
+{
+    const int runs = 100;
+    const uint64_t start = bench_now_ns();
+    for (int i = 0; i < runs; ++i) motion_planner_init();
+    bench_report("planner_init", bench_now_ns() - start, runs, NULL);
+}
+
+/**@brief the call of the timer interrupt for each full step
+ */
+static void bench_step(int32_t steps, const char *name)
+{
+    const uint16_t max_index = motion_planner_speed_index(0);
+    uint32_t sum = 0;
+    const uint64_t start = bench_now_ns();
+    for (int move = 0; move < MOVES; ++move)
+    {
+        motion_planner_t planner;
+        motion_planner_start(&planner, max_index);
+        for (int32_t step = steps - 1; step >= 0; --step)
+        {
+            sum += motion_planner_step(&planner, step);
+        }
+    }
+    bench_report(name, bench_now_ns() - start, (uint64_t)MOVES * steps, NULL);
+    sink = sum;
+}
+
+/**@brief the lookup of a speed limit, once per command
+ */
+static void bench_speed_index(void)
+{
+    const uint32_t calls = 1000000;
+    uint32_t sum = 0;
+    const uint64_t start = bench_now_ns();
+    for (uint32_t i = 0; i < calls; ++i)
+    {
+        sum += motion_planner_speed_index(1 + i % CONFIG_STEPPER_MAX_SPEED);
+    }
+    bench_report("planner_speed_index", bench_now_ns() - start, calls, NULL);
+    sink = sum;
+}
+
+int main(void)
+{
+    bench_init();
+    bench_step(MOVE_STEPS, "planner_step");
+    bench_step(MOVE_STEPS / 20, "planner_step_short_move");
+    bench_speed_index();
+    return 0;
+}
@@ -0,0 +1,104 @@
+/*  Measures the position queue under command storms on the host. The
+*   commands are sent from outside of the tasks, so the motor control task
+*   only reads the queue when the simulation runs. A burst without running
+*   the simulation is a producer above the priority of the motor control
+*   task, the queue has to collapse the burst into the newest command.
+*   Running the simulation after each command is the other extreme, every
+*   command reaches the motor control task. The results are printed as JSON
+*   lines, see bench.h.
+*/
+#include "bench.h"
+#include "host_platform.h"
+#include "host_app.h"
+#include "actuator.h"
+#include "position_queue.h"
+#include "latency_stats.h"
+
+#define SECONDS(s)      ((uint64_t)(s) * 1000000)
+#define STORM_COMMANDS  20000
+
+/**@brief commands received by the motor control task so far
+ */
+static uint32_t consumed_commands(void)
+{
+    latency_histogram_t histogram;
+    latency_stats_get(LATENCY_DEQUEUE, &histogram);
+    return histogram.count;
+}
+
+/**@brief send a storm of commands to actuator 0
+ * 
+ * @details the commands contain the current position, so the motor does not
+ * move. drain_every runs the simulation after that many commands, 0 only
+ * after the storm.
+ */
+static void bench_storm(const char *name, int drain_every)
+{
+    const actuator_t *actuator = actuator_get(0);
+    position_command_t command = { .position = actuator->command.position };
+    const uint32_t before = consumed_commands();
+
+    const uint64_t start = bench_now_ns();
+    for (int i = 0; i < STORM_COMMANDS; ++i)
+    {
+        command.received_time = latency_stats_timestamp();
+        position_queue_send(0, &command);
+        if (drain_every && (i + 1) % drain_every == 0) host_run_for(0);
+    }
+    const uint64_t duration = bench_now_ns() - start;
+    host_app_run_until_idle(SECONDS(1));
+
+    bench_report(name, duration, STORM_COMMANDS,
+        ",\"sent\":%d,\"consumed\":%u", STORM_COMMANDS,
+        (unsigned)(consumed_commands() - before));
+}
+
+/**@brief a storm of batches that address all actuators
+ */
+static void bench_batch_storm(const char *name, int drain_every)
+{
+    position_command_t commands[ACTUATOR_COUNT];
+    const uint32_t id_mask = (1UL << ACTUATOR_COUNT) - 1;
+    const uint32_t before = consumed_commands();
+
+    for (uint8_t id = 0; id < ACTUATOR_COUNT; ++id)
+    {
+        commands[id] = (position_command_t){
+            .position = actuator_get(id)->command.position };
+    }
+    const uint64_t start = bench_now_ns();
+    for (int i = 0; i < STORM_COMMANDS; ++i)
+    {
+        const uint32_t received_time = latency_stats_timestamp();
+        for (uint8_t id = 0; id < ACTUATOR_COUNT; ++id)
+        {
+            commands[id].received_time = received_time;
+        }
+        position_queue_send_batch(commands, id_mask);
+        if (drain_every && (i + 1) % drain_every == 0) host_run_for(0);
+    }
+    const uint64_t duration = bench_now_ns() - start;
+    host_app_run_until_idle(SECONDS(1));
+
+    bench_report(name, duration, STORM_COMMANDS,
+        ",\"sent\":%d,\"consumed\":%u", STORM_COMMANDS * ACTUATOR_COUNT,
+        (unsigned)(consumed_commands() - before));
+}
+
+int main(void)
+{
+    host_nvs_erase();
+    if (host_app_init() != ESP_OK || host_app_start() != ESP_OK
+        || !host_app_run_until_idle(SECONDS(60)))
+    {
+        fprintf(stderr, "start of the firmware failed\n");
+        return 1;
+    }
+
+    bench_storm("queue_storm_burst", 0);
+    bench_storm("queue_storm_drain_100", 100);
+    bench_storm("queue_storm_drain_1", 1);
+    bench_batch_storm("queue_batch_storm_burst", 0);
+    bench_batch_storm("queue_batch_storm_drain_1", 1);
+    return 0;
+}
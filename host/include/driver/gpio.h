@@ -0,0 +1,41 @@
+/*  Host shim of the ESP-IDF GPIO driver, the levels are kept in the
+*   simulated GPIO registers of soc/gpio_struct.h
+*/
+#pragma once
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef int gpio_num_t;
+typedef enum {
+    GPIO_PIN_INTR_DISABLE = 0,
+    GPIO_PIN_INTR_POSEDGE,
+    GPIO_PIN_INTR_NEGEDGE,
+    GPIO_PIN_INTR_ANYEDGE,
+    GPIO_PIN_INTR_LOLEVEL,
+    GPIO_PIN_INTR_HILEVEL,
+} gpio_int_type_t;
+#define GPIO_INTR_DISABLE       GPIO_PIN_INTR_DISABLE
+#define GPIO_INTR_POSEDGE       GPIO_PIN_INTR_POSEDGE
+#define GPIO_INTR_NEGEDGE       GPIO_PIN_INTR_NEGEDGE
+#define GPIO_INTR_ANYEDGE       GPIO_PIN_INTR_ANYEDGE
+#define GPIO_INTR_LOW_LEVEL     GPIO_PIN_INTR_LOLEVEL
+#define GPIO_INTR_HIGH_LEVEL    GPIO_PIN_INTR_HILEVEL
+
+typedef enum { GPIO_MODE_DISABLE, GPIO_MODE_INPUT, GPIO_MODE_OUTPUT } gpio_mode_t;
+typedef struct {
+    uint64_t pin_bit_mask;
+    gpio_mode_t mode;
+    uint32_t pull_up_en;
+    uint32_t pull_down_en;
+    gpio_int_type_t intr_type;
+} gpio_config_t;
+typedef void (*gpio_isr_t)(void *arg);
+
+esp_err_t gpio_config(const gpio_config_t *config);
+esp_err_t gpio_set_level(gpio_num_t gpio, uint32_t level);
+int gpio_get_level(gpio_num_t gpio);
+esp_err_t gpio_set_intr_type(gpio_num_t gpio, gpio_int_type_t type);
+esp_err_t gpio_install_isr_service(int flags);
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio, gpio_isr_t handler, void *arg);
+esp_err_t gpio_wakeup_enable(gpio_num_t gpio, gpio_int_type_t type);
+esp_err_t gpio_wakeup_disable(gpio_num_t gpio);
@@ -0,0 +1,7 @@
+/*  Host shim of the ESP-IDF memory placement attributes
+*/
+#pragma once
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define RTC_DATA_ATTR
@@ -0,0 +1,26 @@
+/*  Host shim of the legacy ESP-IDF event loop, the events of the simulated
+*   WiFi driver get passed to the registered handler
+*/
+#pragma once
+#include <stdint.h>
+#include "esp_err.h"
+#include "tcpip_adapter.h"
+
+typedef enum {
+    SYSTEM_EVENT_STA_START,
+    SYSTEM_EVENT_STA_CONNECTED,
+    SYSTEM_EVENT_STA_DISCONNECTED,
+    SYSTEM_EVENT_STA_GOT_IP,
+} system_event_id_t;
+
+typedef struct {
+    system_event_id_t event_id;
+    union {
+        struct { tcpip_adapter_ip_info_t ip_info; } got_ip;
+        struct { uint8_t reason; } disconnected;
+    } event_info;
+} system_event_t;
+
+typedef esp_err_t (*system_event_cb_t)(void *ctx, system_event_t *event);
+
+esp_err_t esp_event_loop_init(system_event_cb_t cb, void *ctx);
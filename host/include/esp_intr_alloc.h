@@ -0,0 +1,5 @@
+/*  Host shim of the interrupt allocation flags
+*/
+#pragma once
+
+#define ESP_INTR_FLAG_IRAM          (1 << 10)
@@ -0,0 +1,6 @@
+/*  Host shim of the ESP-IDF system functions
+*/
+#pragma once
+#include <stdint.h>
+
+uint32_t esp_random(void);
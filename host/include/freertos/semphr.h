@@ -0,0 +1,12 @@
+/*  Host shim of the FreeRTOS mutexes, a task only gives up the CPU when it
+*   blocks, so a mutex never has to wait
+*/
+#pragma once
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+typedef struct host_queue *SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
@@ -0,0 +1,20 @@
+/*  Host shim of the FreeRTOS tasks and task notifications
+*/
+#pragma once
+#include "freertos/FreeRTOS.h"
+
+typedef struct host_task *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *arg);
+typedef enum { eNoAction, eSetBits, eIncrement, eSetValueWithOverwrite } eNotifyAction;
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name,
+    uint32_t stack_size, void *arg, UBaseType_t priority, TaskHandle_t *handle);
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action);
+BaseType_t xTaskNotifyFromISR(TaskHandle_t task, uint32_t value,
+    eNotifyAction action, BaseType_t *higher_priority_task_woken);
+BaseType_t xTaskNotifyWait(uint32_t clear_on_entry, uint32_t clear_on_exit,
+    uint32_t *value, TickType_t ticks_to_wait);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount(void);
+TickType_t xTaskGetTickCountFromISR(void);
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
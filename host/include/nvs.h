@@ -0,0 +1,24 @@
+/*  Host shim of the NVS API, the storage is kept in RAM, see
+*   host/platform/nvs_host.c
+*/
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef uint32_t nvs_handle;
+typedef enum { NVS_READONLY, NVS_READWRITE } nvs_open_mode;
+
+esp_err_t nvs_open(const char *name, nvs_open_mode open_mode, nvs_handle *handle);
+void nvs_close(nvs_handle handle);
+esp_err_t nvs_commit(nvs_handle handle);
+esp_err_t nvs_get_u8(nvs_handle handle, const char *key, uint8_t *value);
+esp_err_t nvs_set_u8(nvs_handle handle, const char *key, uint8_t value);
+esp_err_t nvs_get_u16(nvs_handle handle, const char *key, uint16_t *value);
+esp_err_t nvs_set_u16(nvs_handle handle, const char *key, uint16_t value);
+esp_err_t nvs_get_i32(nvs_handle handle, const char *key, int32_t *value);
+esp_err_t nvs_set_i32(nvs_handle handle, const char *key, int32_t value);
+esp_err_t nvs_get_blob(nvs_handle handle, const char *key, void *value,
+    size_t *length);
+esp_err_t nvs_set_blob(nvs_handle handle, const char *key, const void *value,
+    size_t length);
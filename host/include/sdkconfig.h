@@ -0,0 +1,35 @@
+/*  Configuration of the host build.
+*   Mirrors the defaults of main/Kconfig.projbuild, the simulator drives two
+*   actuators and accepts binary commands, so those paths are covered too.
+*/
+#pragma once
+
+#define CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ 240
+#define CONFIG_WIFI_SSID "myssid"
+#define CONFIG_WIFI_PASSWORD "mypassword"
+#define CONFIG_WIFI_RECONNECT_MIN_MS 500
+#define CONFIG_WIFI_RECONNECT_MAX_MS 60000
+#define CONFIG_MQTT_BINARY_COMMANDS 1
+#define CONFIG_MQTT_RESYNC_MS 300
+#define CONFIG_TIME_SYNC_MAX_DELAY_S 60
+#define CONFIG_ACTUATOR_COUNT 2
+#define CONFIG_STEPPER_MAX_SPEED 1000
+#define CONFIG_STEPPER_ACCELERATION 2000
+#define CONFIG_STEPPER_MICROSTEPS 16
+#define CONFIG_STEPPER_COARSE_MICROSTEPS 1
+#define CONFIG_STEPPER_FINE_STEPS 10
+#define CONFIG_STEPPER_FINE_SPEED 200
+#define CONFIG_STEPPER_IDLE_DISABLE 1
+#define CONFIG_STEPPER_HOLD_MS 500
+#define CONFIG_ENCODER_COUNTS_PER_REV 1600
+#define CONFIG_STEPPER_STEPS_PER_REV 200
+#define CONFIG_ENCODER_STALL_STEPS 4
+#define CONFIG_ENCODER_STALL_RETRIES 2
+#define CONFIG_ENCODER_BACK_OFF_STEPS 50
+#define CONFIG_END_STOP_DEBOUNCE_MS 20
+#define CONFIG_CALIBRATION_ON_FIRST_BOOT 1
+#define CONFIG_CALIBRATION_MAX_STEPS 10000
+#define CONFIG_CALIBRATION_BACK_OFF_STEPS 100
+#define CONFIG_CALIBRATION_SLOW_SPEED 200
+#define CONFIG_POSITION_SAVE_DELAY_MS 5000
+#define CONFIG_TELEMETRY_RATE_HZ 2
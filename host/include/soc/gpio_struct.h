@@ -0,0 +1,26 @@
+/*  Host shim of the GPIO registers used by the interrupt handlers
+*/
+#pragma once
+#include <stdint.h>
+
+typedef volatile struct {
+    uint32_t out;
+    uint32_t out_w1ts;
+    uint32_t out_w1tc;
+    uint32_t in;
+    union {
+        struct {
+            uint32_t data:8;
+        };
+        uint32_t val;
+    } in1;
+    union {
+        struct {
+            uint32_t int_type:3;
+            uint32_t wakeup_enable:1;
+        };
+        uint32_t val;
+    } pin[40];
+} gpio_dev_t;
+
+extern gpio_dev_t GPIO;
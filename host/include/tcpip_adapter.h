@@ -0,0 +1,27 @@
+/*  Host shim of the ESP-IDF TCP/IP adapter, only the ip configuration of
+*   the station is kept
+*/
+#pragma once
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef struct { uint32_t addr; } ip4_addr_t;
+typedef struct {
+    ip4_addr_t ip;
+    ip4_addr_t netmask;
+    ip4_addr_t gw;
+} tcpip_adapter_ip_info_t;
+typedef struct { ip4_addr_t ip; } tcpip_adapter_dns_info_t;
+typedef enum { TCPIP_ADAPTER_IF_STA, TCPIP_ADAPTER_IF_AP } tcpip_adapter_if_t;
+typedef enum { TCPIP_ADAPTER_DNS_MAIN, TCPIP_ADAPTER_DNS_BACKUP } tcpip_adapter_dns_type_t;
+
+void tcpip_adapter_init(void);
+esp_err_t tcpip_adapter_dhcpc_start(tcpip_adapter_if_t tcpip_if);
+esp_err_t tcpip_adapter_dhcpc_stop(tcpip_adapter_if_t tcpip_if);
+esp_err_t tcpip_adapter_set_ip_info(tcpip_adapter_if_t tcpip_if,
+    const tcpip_adapter_ip_info_t *ip_info);
+esp_err_t tcpip_adapter_get_dns_info(tcpip_adapter_if_t tcpip_if,
+    tcpip_adapter_dns_type_t type, tcpip_adapter_dns_info_t *dns);
+esp_err_t tcpip_adapter_set_dns_info(tcpip_adapter_if_t tcpip_if,
+    tcpip_adapter_dns_type_t type, const tcpip_adapter_dns_info_t *dns);
+char *ip4addr_ntoa(const ip4_addr_t *addr);
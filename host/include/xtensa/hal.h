@@ -0,0 +1,6 @@
+/*  Host shim of the Xtensa cycle counter, derived from the virtual time
+*/
+#pragma once
+#include <stdint.h>
+
+uint32_t xthal_get_ccount(void);
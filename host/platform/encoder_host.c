@@ -0,0 +1,30 @@
+/*  Simulated backend of the quadrature encoders, the counts are set by the
+*   virtual motor
+*/
+#include "encoder.h"
+#include "host_platform.h"
+
+static int32_t counts[ENCODER_MAX_UNITS];
+static bool connected[ENCODER_MAX_UNITS];
+
+void host_encoder_set_count(uint8_t unit, int32_t count)
+{
+    if (unit < ENCODER_MAX_UNITS) counts[unit] = count;
+}
+
+bool host_encoder_connected(uint8_t unit)
+{
+    return unit < ENCODER_MAX_UNITS && connected[unit];
+}
+
+esp_err_t encoder_init(uint8_t unit, uint8_t a_gpio, uint8_t b_gpio)
+{
+    if (unit >= ENCODER_MAX_UNITS) return ESP_ERR_INVALID_ARG;
+    connected[unit] = true;
+    return ESP_OK;
+}
+
+int32_t encoder_get_count(uint8_t unit)
+{
+    return counts[unit];
+}
@@ -0,0 +1,49 @@
+/*  Linux implementation of the ESP-IDF logging.
+*   The messages are prefixed with the virtual time in ms instead of the
+*   time since boot. Only warnings and errors are shown unless the
+*   environment variable HOST_LOG is set to info or debug.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include "host_platform.h"
+#include "esp_system.h"
+
+static esp_log_level_t log_level = ESP_LOG_NONE;
+
+static esp_log_level_t default_level(void)
+{
+    const char *level = getenv("HOST_LOG");
+    if (level && !strcmp(level, "debug")) return ESP_LOG_DEBUG;
+    if (level && !strcmp(level, "info")) return ESP_LOG_INFO;
+    return ESP_LOG_WARN;
+}
+
+void host_log_set_level(esp_log_level_t level)
+{
+    log_level = level;
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag,
+    const char *format, ...)
+{
+    if (log_level == ESP_LOG_NONE) log_level = default_level();
+    if (level > log_level) return;
+
+    static const char letters[] = "NEWIDV";
+    fprintf(stderr, "%c (%llu) %s: ", letters[level],
+        (unsigned long long)(host_time() / 1000), tag);
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    fputc('\n', stderr);
+}
+
+/**@brief not random, so the simulations can be repeated
+ */
+uint32_t esp_random(void)
+{
+    return (uint32_t)rand();
+}
@@ -0,0 +1,83 @@
+/*  Stand-ins for the firmware modules that need the network stack or the
+*   power management of the ESP32 and are not part of the host build.
+*   MQTT is replaced at the command handler: the simulation passes the
+*   messages to command_handler_process and receives the publishes through
+*   host_mqtt_set_listener.
+*/
+#include <stdio.h>
+#include "host_platform.h"
+#include "mqtts_task.h"
+#include "power_manager.h"
+#include "time_sync.h"
+#include "ota_update_task.h"
+
+static host_mqtt_listener_t mqtt_listener = NULL;
+static bool time_synchronized = false;
+static int64_t time_offset = 0;
+static uint32_t ota_checks = 0;
+
+void host_mqtt_set_listener(host_mqtt_listener_t listener)
+{
+    mqtt_listener = listener;
+}
+
+/**@brief the server time is the local time plus the offset
+ */
+void host_time_sync_set_offset(int64_t offset_us)
+{
+    time_synchronized = true;
+    time_offset = offset_us;
+}
+
+uint32_t host_ota_check_count(void)
+{
+    return ota_checks;
+}
+
+esp_err_t mqtts_task_publish(const char *topic, const char *data, int len,
+    int qos, bool retain)
+{
+    if (mqtt_listener) mqtt_listener(topic, data, len);
+    return ESP_OK;
+}
+
+void power_manager_set_active(bool active)
+{
+}
+
+void power_manager_add_wake_latency(uint32_t latency_us)
+{
+}
+
+void power_manager_reset_stats(void)
+{
+}
+
+int power_manager_format_stats(char *buffer, int size)
+{
+    const int length = snprintf(buffer, size, "{}");
+    return length < size ? length : -1;
+}
+
+esp_err_t time_sync_to_local(int64_t server_ms, int64_t *local_us)
+{
+    if (!time_synchronized) return ESP_ERR_INVALID_STATE;
+    *local_us = server_ms * 1000 - time_offset;
+    return ESP_OK;
+}
+
+void time_sync_reset_stats(void)
+{
+}
+
+int time_sync_format_stats(char *buffer, int size)
+{
+    const int length = snprintf(buffer, size, "{}");
+    return length < size ? length : -1;
+}
+
+esp_err_t ota_update_task_check(void)
+{
+    ++ota_checks;
+    return ESP_OK;
+}
@@ -0,0 +1,527 @@
+/*  Linux implementation of the FreeRTOS API used by the firmware.
+*   Every task is a thread, but only the thread holding the baton runs: the
+*   simulation loop hands it to one ready task after another and waits until
+*   that task blocks again. Code between two blocking calls therefore runs
+*   without interruption, like on a single core without preemption, and the
+*   critical sections need no locking.
+*   The time is virtual. It stands still while a task runs and jumps to the
+*   next timeout, software timer or hardware alarm once all tasks are
+*   blocked, so a simulation runs deterministic and faster than real time.
+*   The stacks of the tasks are filled with a pattern, the part that got
+*   overwritten is the stack a task used so far.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "host_platform.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/timers.h"
+#include "freertos/event_groups.h"
+#include "esp_timer.h"
+#include "xtensa/hal.h"
+
+#define TICK_US         ((uint64_t)portTICK_PERIOD_MS * 1000)
+#define NO_TIMEOUT      UINT64_MAX
+#define STACK_SIZE      (256 * 1024)    /* the C library needs more than a task */
+#define STACK_PATTERN   0xA5
+
+struct host_task {
+    const char *name;
+    TaskFunction_t function;
+    void *arg;
+    pthread_cond_t resume;
+    bool running;           /* holds the baton */
+    bool ready;             /* runs as soon as it gets the baton */
+    bool waiting;           /* blocked in xTaskNotifyWait */
+    uint64_t timeout;       /* virtual time a blocked task gets ready */
+    uint32_t notify_value;
+    bool notify_pending;
+    uint32_t stack_size;    /* requested size in bytes */
+    uint8_t *stack;         /* lowest address of the thread stack */
+    uint8_t *stack_top;     /* frame of the task function */
+    struct host_task *next;
+};
+
+struct host_timer {
+    const char *name;
+    TickType_t period;
+    bool auto_reload;
+    void *id;
+    TimerCallbackFunction_t callback;
+    bool active;
+    uint64_t expiry;
+    struct host_timer *next;
+};
+
+struct host_event_group {
+    EventBits_t bits;
+};
+
+struct host_queue {
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t count;
+    UBaseType_t head;
+    uint8_t items[];
+};
+
+static pthread_mutex_t baton = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t loop_resume = PTHREAD_COND_INITIALIZER;
+static struct host_task *tasks = NULL;
+static struct host_task *current = NULL;
+static struct host_timer *timers = NULL;
+static uint64_t now_us = 0;
+static uint64_t alarm_time = NO_TIMEOUT;
+static host_alarm_handler_t alarm_handler = NULL;
+
+/**@brief the main thread runs the simulation loop and owns the baton
+ * whenever no task runs
+ */
+__attribute__((constructor)) static void take_baton(void)
+{
+    pthread_mutex_lock(&baton);
+}
+
+/**@brief give the baton back to the simulation loop and wait until the
+ * task gets it again
+ */
+static void block_current(uint64_t timeout)
+{
+    struct host_task *task = current;
+    if (!task)
+    {
+        fprintf(stderr, "blocking FreeRTOS call outside of a task\n");
+        abort();
+    }
+    task->ready = false;
+    task->timeout = timeout;
+    task->running = false;
+    pthread_cond_signal(&loop_resume);
+    while (!task->running) pthread_cond_wait(&task->resume, &baton);
+}
+
+/**@brief let a task run until it blocks
+ */
+static void run_task(struct host_task *task)
+{
+    current = task;
+    task->running = true;
+    pthread_cond_signal(&task->resume);
+    while (task->running) pthread_cond_wait(&loop_resume, &baton);
+    current = NULL;
+}
+
+static void make_ready(struct host_task *task)
+{
+    task->ready = true;
+    task->timeout = NO_TIMEOUT;
+}
+
+static void *task_thread(void *arg)
+{
+    struct host_task *task = arg;
+    pthread_mutex_lock(&baton);
+    while (!task->running) pthread_cond_wait(&task->resume, &baton);
+
+    /*  the thread start and the TLS above are not part of the task stack */
+    task->stack_top = __builtin_frame_address(0);
+    task->function(task->arg);
+
+    /*  a returning task is treated like a deleted one */
+    task->ready = false;
+    task->timeout = NO_TIMEOUT;
+    task->running = false;
+    pthread_cond_signal(&loop_resume);
+    pthread_mutex_unlock(&baton);
+    return NULL;
+}
+
+/**@brief run all ready tasks until every task is blocked
+ */
+static void run_ready_tasks(void)
+{
+    bool ran;
+    do {
+        ran = false;
+        for (struct host_task *task = tasks; task; task = task->next)
+        {
+            if (task->ready)
+            {
+                run_task(task);
+                ran = true;
+            }
+        }
+    } while (ran);
+}
+
+/**@brief handle everything that is due at the current time
+ * 
+ * @details returns false when nothing was due
+ */
+static bool fire_due_events(void)
+{
+    if (alarm_time <= now_us)
+    {
+        const uint64_t time = alarm_time;
+        const host_alarm_handler_t handler = alarm_handler;
+        alarm_time = NO_TIMEOUT;
+        handler(time);
+        return true;
+    }
+    for (struct host_timer *timer = timers; timer; timer = timer->next)
+    {
+        if (timer->active && timer->expiry <= now_us)
+        {
+            if (timer->auto_reload)
+            {
+                timer->expiry += timer->period * TICK_US;
+            } else {
+                timer->active = false;
+            }
+            timer->callback(timer);
+            return true;
+        }
+    }
+    bool woken = false;
+    for (struct host_task *task = tasks; task; task = task->next)
+    {
+        if (!task->ready && task->timeout <= now_us)
+        {
+            make_ready(task);
+            woken = true;
+        }
+    }
+    return woken;
+}
+
+/**@brief get the virtual time in us
+ */
+uint64_t host_time(void)
+{
+    return now_us;
+}
+
+/**@brief run the simulation until the given virtual time
+ */
+void host_run_until(uint64_t time_us)
+{
+    for (;;)
+    {
+        run_ready_tasks();
+
+        uint64_t next = time_us;
+        if (alarm_time < next) next = alarm_time;
+        for (struct host_timer *timer = timers; timer; timer = timer->next)
+        {
+            if (timer->active && timer->expiry < next) next = timer->expiry;
+        }
+        for (struct host_task *task = tasks; task; task = task->next)
+        {
+            if (!task->ready && task->timeout < next) next = task->timeout;
+        }
+        if (next > now_us) now_us = next;
+
+        if (!fire_due_events() && now_us >= time_us) return;
+    }
+}
+
+void host_run_for(uint64_t duration_us)
+{
+    host_run_until(now_us + duration_us);
+}
+
+/**@brief set the single hardware alarm
+ */
+void host_alarm_set(uint64_t time_us, host_alarm_handler_t handler)
+{
+    alarm_time = time_us;
+    alarm_handler = handler;
+}
+
+void host_alarm_cancel(void)
+{
+    alarm_time = NO_TIMEOUT;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return (int64_t)now_us;
+}
+
+uint32_t xthal_get_ccount(void)
+{
+    return (uint32_t)(now_us * CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ);
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name,
+    uint32_t stack_size, void *arg, UBaseType_t priority, TaskHandle_t *handle)
+{
+    struct host_task *task = calloc(1, sizeof(*task));
+    if (!task) return pdFAIL;
+    task->name = name;
+    task->function = function;
+    task->arg = arg;
+    task->stack_size = stack_size;
+    task->stack = malloc(STACK_SIZE);
+    if (!task->stack) abort();
+    memset(task->stack, STACK_PATTERN, STACK_SIZE);
+    pthread_cond_init(&task->resume, NULL);
+    make_ready(task);
+
+    /*  tasks run in the order they were created */
+    struct host_task **tail = &tasks;
+    while (*tail) tail = &(*tail)->next;
+    *tail = task;
+
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstack(&attr, task->stack, STACK_SIZE);
+    if (pthread_create(&thread, &attr, task_thread, task) != 0) abort();
+    pthread_attr_destroy(&attr);
+    pthread_detach(thread);
+    if (handle) *handle = task;
+    return pdPASS;
+}
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action)
+{
+    if (!task) return pdFAIL;
+    switch (action)
+    {
+        case eSetBits:
+            task->notify_value |= value;
+            break;
+        case eIncrement:
+            ++task->notify_value;
+            break;
+        case eSetValueWithOverwrite:
+            task->notify_value = value;
+            break;
+        default:
+            break;
+    }
+    task->notify_pending = true;
+    if (task->waiting && !task->ready) make_ready(task);
+    return pdPASS;
+}
+
+BaseType_t xTaskNotifyFromISR(TaskHandle_t task, uint32_t value,
+    eNotifyAction action, BaseType_t *higher_priority_task_woken)
+{
+    if (higher_priority_task_woken) *higher_priority_task_woken = pdFALSE;
+    return xTaskNotify(task, value, action);
+}
+
+BaseType_t xTaskNotifyWait(uint32_t clear_on_entry, uint32_t clear_on_exit,
+    uint32_t *value, TickType_t ticks_to_wait)
+{
+    struct host_task *task = current;
+    if (!task)
+    {
+        fprintf(stderr, "xTaskNotifyWait outside of a task\n");
+        abort();
+    }
+
+    if (!task->notify_pending)
+    {
+        task->notify_value &= ~clear_on_entry;
+        if (ticks_to_wait)
+        {
+            task->waiting = true;
+            block_current(ticks_to_wait == portMAX_DELAY
+                ? NO_TIMEOUT : now_us + ticks_to_wait * TICK_US);
+            task->waiting = false;
+        }
+    }
+    if (value) *value = task->notify_value;
+    if (!task->notify_pending) return pdFALSE;
+
+    task->notify_pending = false;
+    task->notify_value &= ~clear_on_exit;
+    return pdTRUE;
+}
+
+/**@brief wait in a task, outside of a task the simulation runs meanwhile
+ */
+void vTaskDelay(TickType_t ticks)
+{
+    if (!current)
+    {
+        host_run_for(ticks * TICK_US);
+        return;
+    }
+    block_current(now_us + ticks * TICK_US);
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(now_us / TICK_US);
+}
+
+TickType_t xTaskGetTickCountFromISR(void)
+{
+    return xTaskGetTickCount();
+}
+
+/**@brief get the least free stack of a task in bytes, NULL is the current
+ * task
+ * 
+ * @details the stack used on the host is taken from the requested size,
+ * it is 0 when the task would have overflown its stack on the target
+ */
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task)
+{
+    if (!task) task = current;
+    if (!task || !task->stack_top) return 0;
+
+    const uint8_t *lowest = task->stack;
+    while (lowest < task->stack_top && *lowest == STACK_PATTERN) ++lowest;
+    const uint32_t used = task->stack_top - lowest;
+    return used < task->stack_size ? task->stack_size - used : 0;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    struct host_queue *queue = calloc(1, sizeof(*queue) + length * item_size);
+    if (!queue) return NULL;
+    queue->length = length;
+    queue->item_size = item_size;
+    return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks)
+{
+    if (queue->count == queue->length) return errQUEUE_FULL;
+    const UBaseType_t tail = (queue->head + queue->count) % queue->length;
+    memcpy(&queue->items[tail * queue->item_size], item, queue->item_size);
+    ++queue->count;
+    return pdPASS;
+}
+
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void *item)
+{
+    memcpy(queue->items, item, queue->item_size);
+    queue->head = 0;
+    queue->count = 1;
+    return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks)
+{
+    if (!queue->count) return pdFALSE;
+    memcpy(item, &queue->items[queue->head * queue->item_size],
+        queue->item_size);
+    queue->head = (queue->head + 1) % queue->length;
+    --queue->count;
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    return queue->count;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return xQueueCreate(1, 0);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks)
+{
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+    return pdTRUE;
+}
+
+TimerHandle_t xTimerCreate(const char *name, TickType_t period,
+    UBaseType_t auto_reload, void *id, TimerCallbackFunction_t callback)
+{
+    struct host_timer *timer = calloc(1, sizeof(*timer));
+    if (!timer) return NULL;
+    timer->name = name;
+    timer->period = period;
+    timer->auto_reload = auto_reload;
+    timer->id = id;
+    timer->callback = callback;
+    timer->next = timers;
+    timers = timer;
+    return timer;
+}
+
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t ticks)
+{
+    timer->active = true;
+    timer->expiry = now_us + timer->period * TICK_US;
+    return pdPASS;
+}
+
+BaseType_t xTimerReset(TimerHandle_t timer, TickType_t ticks)
+{
+    return xTimerStart(timer, ticks);
+}
+
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t ticks)
+{
+    timer->active = false;
+    return pdPASS;
+}
+
+BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t period,
+    TickType_t ticks)
+{
+    timer->period = period;
+    return xTimerStart(timer, ticks);
+}
+
+void *pvTimerGetTimerID(TimerHandle_t timer)
+{
+    return timer->id;
+}
+
+EventGroupHandle_t xEventGroupCreate(void)
+{
+    return calloc(1, sizeof(struct host_event_group));
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    group->bits |= bits;
+    return group->bits;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    const EventBits_t old_bits = group->bits;
+    group->bits &= ~bits;
+    return old_bits;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group)
+{
+    return group->bits;
+}
+
+/**@brief wait for the bits by checking them every tick
+ */
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits,
+    BaseType_t clear_on_exit, BaseType_t wait_for_all, TickType_t ticks_to_wait)
+{
+    for (;;)
+    {
+        const EventBits_t current = group->bits;
+        const bool satisfied = wait_for_all
+            ? (current & bits) == bits : (current & bits) != 0;
+        if (satisfied && clear_on_exit) group->bits &= ~bits;
+        if (satisfied || ticks_to_wait == 0) return current;
+        if (ticks_to_wait != portMAX_DELAY) --ticks_to_wait;
+        vTaskDelay(1);
+    }
+}
@@ -0,0 +1,146 @@
+/*  Linux implementation of the GPIO driver.
+*   The levels live in the simulated GPIO registers, so the interrupt
+*   handlers that access them directly see the same state. Inputs are set by
+*   the simulation with host_gpio_set_input, which calls the registered
+*   interrupt handler when the configured edge or level occurs.
+*/
+#include "host_platform.h"
+#include "driver/gpio.h"
+#include "soc/gpio_struct.h"
+
+#define GPIO_COUNT      40
+
+gpio_dev_t GPIO;
+
+typedef struct {
+    gpio_isr_t handler;
+    void *arg;
+} isr_entry_t;
+
+static isr_entry_t isr_entries[GPIO_COUNT];
+
+static void write_input(int gpio, int level)
+{
+    if (gpio < 32)
+    {
+        GPIO.in = level ? GPIO.in | (1UL << gpio) : GPIO.in & ~(1UL << gpio);
+    } else {
+        const uint32_t mask = 1UL << (gpio - 32);
+        GPIO.in1.data = level ? GPIO.in1.data | mask : GPIO.in1.data & ~mask;
+    }
+}
+
+static int read_input(int gpio)
+{
+    if (gpio < 32) return (GPIO.in >> gpio) & 1;
+    return (GPIO.in1.data >> (gpio - 32)) & 1;
+}
+
+/**@brief change the level of a input and trigger its interrupt
+ */
+void host_gpio_set_input(int gpio, int level)
+{
+    if (gpio < 0 || gpio >= GPIO_COUNT) return;
+    const int old_level = read_input(gpio);
+    level = level ? 1 : 0;
+    write_input(gpio, level);
+
+    bool trigger;
+    switch (GPIO.pin[gpio].int_type)
+    {
+        case GPIO_PIN_INTR_POSEDGE:
+            trigger = !old_level && level;
+            break;
+        case GPIO_PIN_INTR_NEGEDGE:
+            trigger = old_level && !level;
+            break;
+        case GPIO_PIN_INTR_ANYEDGE:
+            trigger = old_level != level;
+            break;
+        case GPIO_PIN_INTR_LOLEVEL:
+            trigger = !level;
+            break;
+        case GPIO_PIN_INTR_HILEVEL:
+            trigger = level;
+            break;
+        default:
+            trigger = false;
+            break;
+    }
+    if (trigger && isr_entries[gpio].handler)
+    {
+        isr_entries[gpio].handler(isr_entries[gpio].arg);
+    }
+}
+
+/**@brief get the level a output got set to
+ */
+int host_gpio_get_output(int gpio)
+{
+    if (gpio < 0 || gpio >= 32) return 0;
+    return (GPIO.out >> gpio) & 1;
+}
+
+esp_err_t gpio_config(const gpio_config_t *config)
+{
+    for (int gpio = 0; gpio < GPIO_COUNT; ++gpio)
+    {
+        if (!(config->pin_bit_mask & (1ULL << gpio))) continue;
+        if (config->mode == GPIO_MODE_OUTPUT && gpio >= 34)
+        {
+            return ESP_ERR_INVALID_ARG;
+        }
+        GPIO.pin[gpio].int_type = config->intr_type;
+        /*  a open input reads the pull-up */
+        if (config->mode == GPIO_MODE_INPUT) write_input(gpio, config->pull_up_en);
+    }
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio, uint32_t level)
+{
+    if (gpio < 0 || gpio >= 32) return ESP_ERR_INVALID_ARG;
+    GPIO.out = level ? GPIO.out | (1UL << gpio) : GPIO.out & ~(1UL << gpio);
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio)
+{
+    if (gpio < 0 || gpio >= GPIO_COUNT) return 0;
+    return read_input(gpio);
+}
+
+esp_err_t gpio_set_intr_type(gpio_num_t gpio, gpio_int_type_t type)
+{
+    if (gpio < 0 || gpio >= GPIO_COUNT) return ESP_ERR_INVALID_ARG;
+    GPIO.pin[gpio].int_type = type;
+    return ESP_OK;
+}
+
+esp_err_t gpio_install_isr_service(int flags)
+{
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio, gpio_isr_t handler, void *arg)
+{
+    if (gpio < 0 || gpio >= GPIO_COUNT) return ESP_ERR_INVALID_ARG;
+    isr_entries[gpio].handler = handler;
+    isr_entries[gpio].arg = arg;
+    return ESP_OK;
+}
+
+esp_err_t gpio_wakeup_enable(gpio_num_t gpio, gpio_int_type_t type)
+{
+    if (gpio < 0 || gpio >= GPIO_COUNT) return ESP_ERR_INVALID_ARG;
+    GPIO.pin[gpio].int_type = type;
+    GPIO.pin[gpio].wakeup_enable = 1;
+    return ESP_OK;
+}
+
+esp_err_t gpio_wakeup_disable(gpio_num_t gpio)
+{
+    if (gpio < 0 || gpio >= GPIO_COUNT) return ESP_ERR_INVALID_ARG;
+    GPIO.pin[gpio].wakeup_enable = 0;
+    return ESP_OK;
+}
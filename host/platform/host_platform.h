@@ -0,0 +1,61 @@
+/*  Control of the simulated platform, used by the simulator and the tests.
+*   The firmware itself only sees the ESP-IDF and FreeRTOS API of the shims
+*   in host/include.
+*/
+#ifndef __HOST_PLATFORM__
+#define __HOST_PLATFORM__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_log.h"
+
+/*  inform c++ compilers that the function should be compiled in C Style */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*  called at the time of the hardware alarm, e.g. the pulse timer */
+typedef void (*host_alarm_handler_t)(uint64_t time_us);
+/*  called for each pulse of pulse_output_pulse */
+typedef void (*host_pulse_listener_t)(uint32_t gpio_mask, uint64_t time_us);
+/*  called for each message of mqtts_task_publish */
+typedef void (*host_mqtt_listener_t)(const char *topic, const char *data,
+    int len);
+
+/*  virtual time and scheduling */
+uint64_t host_time(void);
+void host_run_until(uint64_t time_us);
+void host_run_for(uint64_t duration_us);
+void host_alarm_set(uint64_t time_us, host_alarm_handler_t handler);
+void host_alarm_cancel(void);
+
+/*  peripherals */
+void host_gpio_set_input(int gpio, int level);
+int host_gpio_get_output(int gpio);
+void host_pulse_set_listener(host_pulse_listener_t listener);
+void host_encoder_set_count(uint8_t unit, int32_t count);
+bool host_encoder_connected(uint8_t unit);
+void host_nvs_erase(void);
+uint32_t host_nvs_write_count(void);
+
+/*  WiFi, at most one access point of the SSID is in range */
+void host_wifi_set_access_point(const uint8_t bssid[6], uint8_t channel);
+void host_wifi_remove_access_point(void);
+void host_wifi_disconnect(void);
+bool host_wifi_get_station_bssid(uint8_t bssid[6], uint8_t *channel);
+uint32_t host_wifi_scan_count(void);
+
+/*  firmware modules that are not part of the host build */
+void host_mqtt_set_listener(host_mqtt_listener_t listener);
+void host_time_sync_set_offset(int64_t offset_us);
+uint32_t host_ota_check_count(void);
+
+/*  logging, ESP_LOG_WARN unless HOST_LOG=info|debug is set */
+void host_log_set_level(esp_log_level_t level);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __HOST_PLATFORM__ */
@@ -0,0 +1,167 @@
+/*  RAM backed implementation of the NVS API.
+*   Every namespace is a handle, the values are stored as blobs. Each set
+*   counts as a flash write, the tests use the count to check that the
+*   position state does not wear out the flash.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include "host_platform.h"
+#include "nvs.h"
+
+#define NVS_NAME_LENGTH     16
+#define NVS_MAX_ENTRIES     64
+#define NVS_MAX_VALUE       512
+
+typedef struct {
+    char space[NVS_NAME_LENGTH];
+    char key[NVS_NAME_LENGTH];
+    size_t length;
+    uint8_t value[NVS_MAX_VALUE];
+} nvs_entry_t;
+
+static char spaces[NVS_MAX_ENTRIES][NVS_NAME_LENGTH];
+static nvs_entry_t entries[NVS_MAX_ENTRIES];
+static uint32_t write_count = 0;
+
+static nvs_entry_t *find_entry(nvs_handle handle, const char *key,
+    bool create)
+{
+    if (handle == 0 || handle > NVS_MAX_ENTRIES) return NULL;
+    const char *space = spaces[handle - 1];
+    nvs_entry_t *empty = NULL;
+    for (int i = 0; i < NVS_MAX_ENTRIES; ++i)
+    {
+        if (!entries[i].key[0])
+        {
+            if (!empty) empty = &entries[i];
+            continue;
+        }
+        if (!strcmp(entries[i].space, space) && !strcmp(entries[i].key, key))
+        {
+            return &entries[i];
+        }
+    }
+    if (!create || !empty) return NULL;
+    strncpy(empty->space, space, NVS_NAME_LENGTH - 1);
+    strncpy(empty->key, key, NVS_NAME_LENGTH - 1);
+    return empty;
+}
+
+static esp_err_t get_value(nvs_handle handle, const char *key, void *value,
+    size_t length)
+{
+    const nvs_entry_t *entry = find_entry(handle, key, false);
+    if (!entry) return ESP_ERR_NVS_NOT_FOUND;
+    /*  a value of a other type is not found, like on the target */
+    if (entry->length != length) return ESP_ERR_NVS_NOT_FOUND;
+    memcpy(value, entry->value, length);
+    return ESP_OK;
+}
+
+static esp_err_t set_value(nvs_handle handle, const char *key,
+    const void *value, size_t length)
+{
+    if (length > NVS_MAX_VALUE) return ESP_ERR_INVALID_SIZE;
+    nvs_entry_t *entry = find_entry(handle, key, true);
+    if (!entry) return ESP_ERR_NO_MEM;
+    memcpy(entry->value, value, length);
+    entry->length = length;
+    ++write_count;
+    return ESP_OK;
+}
+
+/**@brief forget everything, like a erased flash
+ */
+void host_nvs_erase(void)
+{
+    memset(entries, 0, sizeof(entries));
+    write_count = 0;
+}
+
+uint32_t host_nvs_write_count(void)
+{
+    return write_count;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode open_mode,
+    nvs_handle *handle)
+{
+    for (int i = 0; i < NVS_MAX_ENTRIES; ++i)
+    {
+        if (!spaces[i][0]) strncpy(spaces[i], name, NVS_NAME_LENGTH - 1);
+        if (!strcmp(spaces[i], name))
+        {
+            *handle = i + 1;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+void nvs_close(nvs_handle handle)
+{
+}
+
+esp_err_t nvs_commit(nvs_handle handle)
+{
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_u8(nvs_handle handle, const char *key, uint8_t *value)
+{
+    return get_value(handle, key, value, sizeof(*value));
+}
+
+esp_err_t nvs_set_u8(nvs_handle handle, const char *key, uint8_t value)
+{
+    return set_value(handle, key, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_u16(nvs_handle handle, const char *key, uint16_t *value)
+{
+    return get_value(handle, key, value, sizeof(*value));
+}
+
+esp_err_t nvs_set_u16(nvs_handle handle, const char *key, uint16_t value)
+{
+    return set_value(handle, key, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_i32(nvs_handle handle, const char *key, int32_t *value)
+{
+    return get_value(handle, key, value, sizeof(*value));
+}
+
+esp_err_t nvs_set_i32(nvs_handle handle, const char *key, int32_t value)
+{
+    return set_value(handle, key, &value, sizeof(value));
+}
+
+/**@brief like on the target a too small buffer is an error, the length of
+ * the stored blob is returned in any case
+ */
+esp_err_t nvs_get_blob(nvs_handle handle, const char *key, void *value,
+    size_t *length)
+{
+    const nvs_entry_t *entry = find_entry(handle, key, false);
+    if (!entry) return ESP_ERR_NVS_NOT_FOUND;
+    if (!value)
+    {
+        *length = entry->length;
+        return ESP_OK;
+    }
+    if (*length < entry->length)
+    {
+        *length = entry->length;
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    memcpy(value, entry->value, entry->length);
+    *length = entry->length;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_blob(nvs_handle handle, const char *key, const void *value,
+    size_t length)
+{
+    return set_value(handle, key, value, length);
+}
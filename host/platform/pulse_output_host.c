@@ -0,0 +1,70 @@
+/*  Virtual timer backend for the step pulse generation.
+*   Same interface as pulse_output.c: the alarm is scheduled on the virtual
+*   time of the simulation and each pulse is reported to a listener, e.g. the
+*   virtual motor, together with its time.
+*/
+#include "pulse_output.h"
+#include "host_platform.h"
+#include "soc/gpio_struct.h"
+
+#define PULSE_MIN_LEAD_US       5   /* alarms closer than this get delayed */
+
+static pulse_output_handler_t pulse_handler = NULL;
+static host_pulse_listener_t pulse_listener = NULL;
+
+static void arm(uint64_t alarm_time);
+
+static void pulse_alarm(uint64_t alarm_time)
+{
+    const uint64_t next_alarm = pulse_handler(alarm_time);
+    if (next_alarm != PULSE_OUTPUT_STOP) arm(next_alarm);
+}
+
+/**@brief set the next alarm, like the hardware it is not set into the past
+ */
+static void arm(uint64_t alarm_time)
+{
+    const uint64_t earliest = host_time() + PULSE_MIN_LEAD_US;
+    host_alarm_set(alarm_time < earliest ? earliest : alarm_time, pulse_alarm);
+}
+
+void host_pulse_set_listener(host_pulse_listener_t listener)
+{
+    pulse_listener = listener;
+}
+
+uint64_t pulse_output_get_time(void)
+{
+    return host_time();
+}
+
+void pulse_output_start(uint64_t alarm_time)
+{
+    arm(alarm_time);
+}
+
+void pulse_output_stop(void)
+{
+    host_alarm_cancel();
+}
+
+void pulse_output_set_level(uint32_t gpio_mask, bool level)
+{
+    if (level)
+    {
+        GPIO.out |= gpio_mask;
+    } else {
+        GPIO.out &= ~gpio_mask;
+    }
+}
+
+void pulse_output_pulse(uint32_t gpio_mask)
+{
+    if (pulse_listener) pulse_listener(gpio_mask, host_time());
+}
+
+esp_err_t pulse_output_init(pulse_output_handler_t handler)
+{
+    pulse_handler = handler;
+    return ESP_OK;
+}
@@ -0,0 +1,229 @@
+/*  Simulated WiFi driver and TCP/IP adapter.
+*   A connect attempt succeeds when the access point is in range and matches
+*   the BSSID and channel of the station config, without a BSSID the
+*   station scans all channels. The result is reported to the event handler
+*   after the time the attempt takes, like the event task of ESP-IDF does.
+*/
+#include <stdio.h>
+#include <string.h>
+#include "host_platform.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/timers.h"
+#include "esp_wifi.h"
+#include "esp_event_loop.h"
+
+#define CONNECT_MS          100     /* attempt with BSSID and channel */
+#define SCAN_MS             2000    /* attempt with a scan of all channels */
+#define REASON_ASSOC_LEAVE  8
+#define REASON_BEACON_TIMEOUT 200
+#define REASON_NO_AP_FOUND  201
+#define STATION_IP          0x3201A8C0  /* 192.168.1.50 */
+#define GATEWAY_IP          0x0101A8C0  /* 192.168.1.1 */
+
+static system_event_cb_t event_handler = NULL;
+static void *event_context = NULL;
+static TimerHandle_t event_timer = NULL;
+static system_event_id_t pending_event;
+
+static wifi_sta_config_t station;
+static bool ap_in_range = false;
+static uint8_t ap_bssid[6];
+static uint8_t ap_channel;
+static bool connected = false;
+static uint32_t scans = 0;
+
+static void send_event(system_event_t *event)
+{
+    if (event_handler) event_handler(event_context, event);
+}
+
+static void send_disconnected(uint8_t reason)
+{
+    system_event_t event = { .event_id = SYSTEM_EVENT_STA_DISCONNECTED };
+    event.event_info.disconnected.reason = reason;
+    send_event(&event);
+}
+
+/**@brief finish the start or the connect attempt
+ */
+static void event_timer_callback(TimerHandle_t timer)
+{
+    if (pending_event == SYSTEM_EVENT_STA_START)
+    {
+        system_event_t event = { .event_id = SYSTEM_EVENT_STA_START };
+        send_event(&event);
+        return;
+    }
+
+    if (!station.bssid_set) ++scans;
+    connected = ap_in_range && (!station.bssid_set
+        || (!memcmp(station.bssid, ap_bssid, sizeof(ap_bssid))
+            && station.channel == ap_channel));
+    if (!connected)
+    {
+        send_disconnected(REASON_NO_AP_FOUND);
+        return;
+    }
+    system_event_t event = { .event_id = SYSTEM_EVENT_STA_GOT_IP };
+    event.event_info.got_ip.ip_info.ip.addr = STATION_IP;
+    event.event_info.got_ip.ip_info.netmask.addr = 0x00FFFFFF;
+    event.event_info.got_ip.ip_info.gw.addr = GATEWAY_IP;
+    send_event(&event);
+}
+
+/**@brief report the event after delay_ms, a new event replaces a pending one
+ */
+static void schedule_event(system_event_id_t event_id, uint32_t delay_ms)
+{
+    pending_event = event_id;
+    xTimerChangePeriod(event_timer, delay_ms / portTICK_PERIOD_MS + 1, 0);
+}
+
+/**@brief put the access point in range, a different access point replaces
+ * the one the station is connected to
+ */
+void host_wifi_set_access_point(const uint8_t bssid[6], uint8_t channel)
+{
+    const bool same = ap_in_range && !memcmp(bssid, ap_bssid, sizeof(ap_bssid))
+        && channel == ap_channel;
+    if (!same) host_wifi_remove_access_point();
+    memcpy(ap_bssid, bssid, sizeof(ap_bssid));
+    ap_channel = channel;
+    ap_in_range = true;
+}
+
+void host_wifi_remove_access_point(void)
+{
+    ap_in_range = false;
+    if (!connected) return;
+    connected = false;
+    send_disconnected(REASON_BEACON_TIMEOUT);
+}
+
+/**@brief the access point drops the connection
+ */
+void host_wifi_disconnect(void)
+{
+    if (!connected) return;
+    connected = false;
+    send_disconnected(REASON_ASSOC_LEAVE);
+}
+
+/**@brief get the access point the station config is fixed to
+ * 
+ * @details returns false when the station scans all channels
+ */
+bool host_wifi_get_station_bssid(uint8_t bssid[6], uint8_t *channel)
+{
+    if (!station.bssid_set) return false;
+    memcpy(bssid, station.bssid, sizeof(station.bssid));
+    *channel = station.channel;
+    return true;
+}
+
+uint32_t host_wifi_scan_count(void)
+{
+    return scans;
+}
+
+esp_err_t esp_event_loop_init(system_event_cb_t cb, void *ctx)
+{
+    event_handler = cb;
+    event_context = ctx;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_init(const wifi_init_config_t *config)
+{
+    event_timer = xTimerCreate("wifi_event", 1, pdFALSE, NULL,
+        event_timer_callback);
+    return event_timer ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+esp_err_t esp_wifi_set_storage(wifi_storage_t storage)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode)
+{
+    return ESP_OK;
+}
+
+/**@brief the new config is used from the next connect attempt on
+ */
+esp_err_t esp_wifi_set_config(esp_interface_t interface, wifi_config_t *config)
+{
+    station = config->sta;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_start(void)
+{
+    schedule_event(SYSTEM_EVENT_STA_START, 0);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_connect(void)
+{
+    if (connected) return ESP_ERR_INVALID_STATE;
+    schedule_event(SYSTEM_EVENT_STA_GOT_IP,
+        station.bssid_set ? CONNECT_MS : SCAN_MS);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_ps(wifi_ps_type_t type)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t *ap_info)
+{
+    if (!connected) return ESP_ERR_INVALID_STATE;
+    memcpy(ap_info->bssid, ap_bssid, sizeof(ap_bssid));
+    ap_info->primary = ap_channel;
+    return ESP_OK;
+}
+
+void tcpip_adapter_init(void)
+{
+}
+
+esp_err_t tcpip_adapter_dhcpc_start(tcpip_adapter_if_t tcpip_if)
+{
+    return ESP_OK;
+}
+
+esp_err_t tcpip_adapter_dhcpc_stop(tcpip_adapter_if_t tcpip_if)
+{
+    return ESP_OK;
+}
+
+esp_err_t tcpip_adapter_set_ip_info(tcpip_adapter_if_t tcpip_if,
+    const tcpip_adapter_ip_info_t *ip_info)
+{
+    return ESP_OK;
+}
+
+esp_err_t tcpip_adapter_get_dns_info(tcpip_adapter_if_t tcpip_if,
+    tcpip_adapter_dns_type_t type, tcpip_adapter_dns_info_t *dns)
+{
+    dns->ip.addr = GATEWAY_IP;
+    return ESP_OK;
+}
+
+esp_err_t tcpip_adapter_set_dns_info(tcpip_adapter_if_t tcpip_if,
+    tcpip_adapter_dns_type_t type, const tcpip_adapter_dns_info_t *dns)
+{
+    return ESP_OK;
+}
+
+char *ip4addr_ntoa(const ip4_addr_t *addr)
+{
+    static char text[16];
+    const uint32_t ip = addr->addr;
+    snprintf(text, sizeof(text), "%u.%u.%u.%u", (unsigned)(ip & 0xFF),
+        (unsigned)((ip >> 8) & 0xFF), (unsigned)((ip >> 16) & 0xFF),
+        (unsigned)(ip >> 24));
+    return text;
+}
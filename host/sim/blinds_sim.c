@@ -0,0 +1,149 @@
+/*  Simulator of the actuator module.
+*   Reads a script with one event per line and prints the messages the
+*   module publishes. Usage: blinds_sim [-t trace.csv] [script], the script
+*   is read from stdin without a file. Events:
+*       <ms> <topic> <payload>          message of the broker
+*       <ms> @position <id> <steps>     the rotor got moved by hand, 1/32 steps
+*       <ms> @limits <id> <low> <high>  the rotor stalls outside, 1/32 steps
+*   The times are absolute since the boot and have to increase. Lines
+*   starting with # are comments. After the last event the simulation runs
+*   until the motors stand still and prints the state of each motor.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "host_platform.h"
+#include "host_app.h"
+#include "virtual_motor.h"
+#include "actuator.h"
+#include "position_state.h"
+
+#define LINE_LENGTH     512
+#define IDLE_TIMEOUT_US (60ULL * 1000000)
+
+static void print_publish(const char *topic, const char *data, int len)
+{
+    printf("%llu %s %.*s\n", (unsigned long long)(host_time() / 1000), topic,
+        len, data);
+}
+
+/**@brief handle a event that changes the simulated motors
+ */
+static esp_err_t process_motor_event(const char *event, const char *args)
+{
+    unsigned id;
+    long low, high;
+    if (!strcmp(event, "@position") && sscanf(args, "%u %ld", &id, &low) == 2
+        && virtual_motor_get(id))
+    {
+        virtual_motor_set_position(id, (int32_t)low);
+        return ESP_OK;
+    }
+    if (!strcmp(event, "@limits")
+        && sscanf(args, "%u %ld %ld", &id, &low, &high) == 3
+        && virtual_motor_get(id))
+    {
+        virtual_motor_set_limits(id, (int32_t)low, (int32_t)high);
+        return ESP_OK;
+    }
+    return ESP_ERR_INVALID_ARG;
+}
+
+/**@brief run the script, returns the amount of invalid lines
+ */
+static int run_script(FILE *script)
+{
+    char line[LINE_LENGTH];
+    int errors = 0;
+    int line_number = 0;
+
+    while (fgets(line, sizeof(line), script))
+    {
+        ++line_number;
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '#' || line[strspn(line, " \t")] == '\0') continue;
+
+        unsigned long long time_ms;
+        char topic[64];
+        int offset = 0;
+        if (sscanf(line, "%llu %63s %n", &time_ms, topic, &offset) < 2)
+        {
+            fprintf(stderr, "line %d: invalid event\n", line_number);
+            ++errors;
+            continue;
+        }
+        if (time_ms * 1000 > host_time()) host_run_until(time_ms * 1000);
+
+        const char *payload = line + offset;
+        const esp_err_t error_code = topic[0] == '@'
+            ? process_motor_event(topic, payload)
+            : host_app_inject(topic, payload, strlen(payload));
+        if (error_code != ESP_OK)
+        {
+            fprintf(stderr, "line %d: error %d\n", line_number, error_code);
+            ++errors;
+        }
+    }
+    return errors;
+}
+
+static void print_summary(void)
+{
+    printf("# id rotor position pulses lost_pulses travel\n");
+    for (uint8_t id = 0; id < ACTUATOR_COUNT; ++id)
+    {
+        const virtual_motor_t *motor = virtual_motor_get(id);
+        printf("# %u %d %d %u %u %d\n", id, motor->position,
+            step_generator_get_position(&actuator_get(id)->channel),
+            motor->pulses, motor->lost_pulses, position_state_get_travel(id));
+    }
+    printf("# nvs writes %u\n", host_nvs_write_count());
+}
+
+int main(int argc, char **argv)
+{
+    FILE *trace = NULL;
+    int option;
+    while ((option = getopt(argc, argv, "t:")) != -1)
+    {
+        if (option != 't')
+        {
+            fprintf(stderr, "usage: %s [-t trace.csv] [script]\n", argv[0]);
+            return 2;
+        }
+        trace = fopen(optarg, "w");
+        if (!trace)
+        {
+            perror(optarg);
+            return 2;
+        }
+        fprintf(trace, "time_us,id,position\n");
+    }
+    FILE *script = stdin;
+    if (optind < argc)
+    {
+        script = fopen(argv[optind], "r");
+        if (!script)
+        {
+            perror(argv[optind]);
+            return 2;
+        }
+    }
+
+    host_mqtt_set_listener(print_publish);
+    virtual_motor_set_trace(trace);
+    if (host_app_init() != ESP_OK || host_app_start() != ESP_OK) return 1;
+
+    int errors = run_script(script);
+    if (!host_app_run_until_idle(IDLE_TIMEOUT_US))
+    {
+        fprintf(stderr, "motors still moving after %llu s\n",
+            IDLE_TIMEOUT_US / 1000000);
+        ++errors;
+    }
+    print_summary();
+
+    if (trace) fclose(trace);
+    return errors != 0;
+}
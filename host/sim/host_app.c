@@ -0,0 +1,87 @@
+/*  Start of the firmware on the host, see host_app.h.
+*   host_app_init loads the state like app_main does before the tasks get
+*   started, so the simulation can change the contexts of the actuators in
+*   between, e.g. to connect encoders.
+*/
+#include <string.h>
+#include "host_app.h"
+#include "host_platform.h"
+#include "virtual_motor.h"
+#include "actuator.h"
+#include "position_state.h"
+#include "position_queue.h"
+#include "motor_control_task.h"
+#include "interrupt_task.h"
+#include "telemetry_task.h"
+#include "command_handler.h"
+#include "latency_stats.h"
+
+#if CONFIG_CALIBRATION_ON_FIRST_BOOT == 1
+    #define CALIBRATION_ON_FIRST_BOOT true
+#else
+    #define CALIBRATION_ON_FIRST_BOOT false
+#endif
+
+#define IDLE_POLL_US        10000   /* check for a finished move every 10ms */
+
+/**@brief set up the contexts and load the state from the nvs
+ */
+esp_err_t host_app_init(void)
+{
+    esp_err_t error_code = actuator_init();
+    if (error_code != ESP_OK) return error_code;
+
+    error_code = position_state_init();
+    if (error_code != ESP_OK) return error_code;
+
+    return position_queue_init();
+}
+
+/**@brief start the tasks in the order of app_main and connect the motors
+ */
+esp_err_t host_app_start(void)
+{
+    esp_err_t error_code = motor_control_task_init();
+    if (error_code != ESP_OK) return error_code;
+
+    error_code = interrupt_task_init();
+    if (error_code != ESP_OK) return error_code;
+
+    error_code = virtual_motor_init();
+    if (error_code != ESP_OK) return error_code;
+
+    if (CALIBRATION_ON_FIRST_BOOT)
+    {
+        error_code = motor_control_calibrate_uncalibrated();
+        if (error_code != ESP_OK) return error_code;
+    }
+
+    error_code = telemetry_task_init();
+    if (error_code != ESP_OK) return error_code;
+
+    /*  let the tasks reach their first wait */
+    host_run_for(0);
+    return ESP_OK;
+}
+
+/**@brief pass a message of the broker to the command handler
+ */
+esp_err_t host_app_inject(const char *topic, const char *data, int len)
+{
+    return command_handler_process(topic, strlen(topic), data, len,
+        latency_stats_timestamp());
+}
+
+/**@brief run the simulation until all motors stand still
+ * 
+ * @details returns false when they still move after timeout_us
+ */
+bool host_app_run_until_idle(uint64_t timeout_us)
+{
+    const uint64_t end = host_time() + timeout_us;
+    do {
+        host_run_for(IDLE_POLL_US);
+        if (motor_control_is_idle()) return true;
+    } while (host_time() < end);
+    return false;
+}
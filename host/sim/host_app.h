@@ -0,0 +1,26 @@
+/*  Start of the firmware on the host, the counterpart of app_main without
+*   the network. The messages of the broker are injected directly into the
+*   command handler.
+*/
+#ifndef __HOST_APP__
+#define __HOST_APP__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+/*  inform c++ compilers that the function should be compiled in C Style */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t host_app_init(void);
+esp_err_t host_app_start(void);
+esp_err_t host_app_inject(const char *topic, const char *data, int len);
+bool host_app_run_until_idle(uint64_t timeout_us);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __HOST_APP__ */
@@ -0,0 +1,155 @@
+/*  Simulated stepper motors, see virtual_motor.h.
+*   The motors start at the position the firmware loaded, with the End Stops
+*   at 0 and the default travel.
+*/
+#include "virtual_motor.h"
+#include "host_platform.h"
+#include "actuator.h"
+#include "encoder.h"
+#include "motor_control_task.h"
+#include "esp_log.h"
+
+#if CONFIG_ENCODER_REVERSE == 1
+    #define ENCODER_REVERSE true
+#else
+    #define ENCODER_REVERSE false
+#endif
+
+#define DRIVER_ENABLE_LEVEL     1   /* see motor_control_task.c */
+#define UNITS_PER_REV           ((int64_t)CONFIG_STEPPER_STEPS_PER_REV \
+                                * STEP_GENERATOR_UNITS_PER_STEP)
+
+static const char *TAG = "VIRTUAL_MOTOR";
+
+static virtual_motor_t motors[ACTUATOR_COUNT];
+static FILE *trace_file = NULL;
+
+static int output_level(uint8_t gpio)
+{
+    return gpio == STEP_GENERATOR_PIN_UNUSED ? 0 : host_gpio_get_output(gpio);
+}
+
+/**@brief get the 1/32 steps of a pulse from the mode pins
+ * 
+ * @details the DRV8825 uses 1/32 steps for the codes 5-7
+ */
+static int32_t pulse_units(const actuator_pins_t *pins)
+{
+    uint32_t code = 0;
+    for (uint8_t i = 0; i < STEP_GENERATOR_MODE_PINS; ++i)
+    {
+        code |= output_level(pins->mode[i]) << i;
+    }
+    if (code > 5) code = 5;
+    return STEP_GENERATOR_UNITS_PER_STEP >> code;
+}
+
+/**@brief update the End Stops and the encoder after the rotor moved
+ */
+static void update_sensors(uint8_t id)
+{
+    const virtual_motor_t *motor = &motors[id];
+    const actuator_pins_t *pins = actuator_get(id)->pins;
+
+    /*  the End Stops pull the pins to ground */
+    host_gpio_set_input(pins->low_end_stop,
+        motor->position > motor->low_end_stop);
+    host_gpio_set_input(pins->high_end_stop,
+        motor->position < motor->high_end_stop);
+
+    if (pins->encoder_a != ENCODER_PIN_UNUSED)
+    {
+        int32_t count = (int32_t)((int64_t)motor->position
+            * CONFIG_ENCODER_COUNTS_PER_REV / UNITS_PER_REV);
+        host_encoder_set_count(id, ENCODER_REVERSE ? -count : count);
+    }
+}
+
+/**@brief move the rotors of the motors whose step pin got pulsed
+ */
+static void handle_pulse(uint32_t gpio_mask, uint64_t time_us)
+{
+    for (uint8_t id = 0; id < ACTUATOR_COUNT; ++id)
+    {
+        const actuator_pins_t *pins = actuator_get(id)->pins;
+        if (!(gpio_mask & (1UL << pins->step))) continue;
+
+        virtual_motor_t *motor = &motors[id];
+        ++motor->pulses;
+        if (host_gpio_get_output(pins->enable) != DRIVER_ENABLE_LEVEL)
+        {
+            ++motor->lost_pulses;
+            continue;
+        }
+
+        const int32_t units = pulse_units(pins);
+        const int32_t position = host_gpio_get_output(pins->dir)
+            ? motor->position + units : motor->position - units;
+        if (position < motor->limit_low || position > motor->limit_high)
+        {
+            ++motor->lost_pulses;
+            continue;
+        }
+        motor->position = position;
+        update_sensors(id);
+
+        if (trace_file)
+        {
+            fprintf(trace_file, "%llu,%u,%d\n", (unsigned long long)time_us,
+                id, motor->position);
+        }
+    }
+}
+
+virtual_motor_t *virtual_motor_get(uint8_t id)
+{
+    if (id >= ACTUATOR_COUNT) return NULL;
+    return &motors[id];
+}
+
+/**@brief move the rotor without steps, e.g. by hand
+ */
+void virtual_motor_set_position(uint8_t id, int32_t position)
+{
+    if (id >= ACTUATOR_COUNT) return;
+    motors[id].position = position;
+    update_sensors(id);
+}
+
+void virtual_motor_set_limits(uint8_t id, int32_t limit_low, int32_t limit_high)
+{
+    if (id >= ACTUATOR_COUNT) return;
+    motors[id].limit_low = limit_low;
+    motors[id].limit_high = limit_high;
+}
+
+/**@brief write every step as time_us,id,position to the file, NULL stops
+ */
+void virtual_motor_set_trace(FILE *file)
+{
+    trace_file = file;
+}
+
+/**@brief Function for initializing the motors
+ * 
+ * @details needs the configured GPIOs, so it is called after the motor
+ * control and the interrupt task got started
+ */
+esp_err_t virtual_motor_init(void)
+{
+    for (uint8_t id = 0; id < ACTUATOR_COUNT; ++id)
+    {
+        virtual_motor_t *motor = &motors[id];
+        *motor = (virtual_motor_t){
+            .position = step_generator_get_position(&actuator_get(id)->channel),
+            .low_end_stop = 0,
+            .high_end_stop = STEPPER_UNITS,
+            .limit_low = VIRTUAL_MOTOR_NO_LIMIT_LOW,
+            .limit_high = VIRTUAL_MOTOR_NO_LIMIT_HIGH,
+        };
+        update_sensors(id);
+    }
+    host_pulse_set_listener(handle_pulse);
+    ESP_LOGI(TAG, "%d motors simulated", ACTUATOR_COUNT);
+    return ESP_OK;
+}
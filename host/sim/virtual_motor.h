@@ -0,0 +1,44 @@
+/*  Simulated stepper motors driven by the step pulses of the firmware.
+*   Each motor follows the pins of its actuator: it only turns while the
+*   driver is enabled, the direction pin selects the direction and the mode
+*   pins the microsteps per pulse. The End Stops and the encoder follow the
+*   position of the rotor.
+*/
+#ifndef __VIRTUAL_MOTOR__
+#define __VIRTUAL_MOTOR__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "esp_err.h"
+
+/*  inform c++ compilers that the function should be compiled in C Style */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define VIRTUAL_MOTOR_NO_LIMIT_LOW  INT32_MIN
+#define VIRTUAL_MOTOR_NO_LIMIT_HIGH INT32_MAX
+
+/*  state of a single motor, positions in 1/32 steps */
+typedef struct {
+    int32_t position;       /* position of the rotor */
+    int32_t low_end_stop;   /* low End Stop closed at or below */
+    int32_t high_end_stop;  /* high End Stop closed at or above */
+    int32_t limit_low;      /* the rotor stalls at the limits, e.g. on a */
+    int32_t limit_high;     /* blocked blind */
+    uint32_t pulses;        /* pulses received */
+    uint32_t lost_pulses;   /* pulses without motion, disabled or stalled */
+} virtual_motor_t;
+
+esp_err_t virtual_motor_init(void);
+virtual_motor_t *virtual_motor_get(uint8_t id);
+void virtual_motor_set_position(uint8_t id, int32_t position);
+void virtual_motor_set_limits(uint8_t id, int32_t limit_low, int32_t limit_high);
+void virtual_motor_set_trace(FILE *file);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __VIRTUAL_MOTOR__ */
@@ -0,0 +1,28 @@
+/*  Checks of the host tests, a failed check is reported and the test
+*   continues, main returns the amount of failures
+*/
+#ifndef __HOST_TEST__
+#define __HOST_TEST__
+
+#include <stdio.h>
+
+static int host_test_failures = 0;
+
+#define CHECK(condition) do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, \
+                #condition); \
+            ++host_test_failures; \
+        } \
+    } while (0)
+
+#define CHECK_NEAR(value, expected, tolerance) do { \
+        const long long v_ = (value), e_ = (expected); \
+        if (v_ < e_ - (tolerance) || v_ > e_ + (tolerance)) { \
+            fprintf(stderr, "%s:%d: check failed: %s = %lld, expected %lld\n", \
+                __FILE__, __LINE__, #value, v_, e_); \
+            ++host_test_failures; \
+        } \
+    } while (0)
+
+#endif /* __HOST_TEST__ */
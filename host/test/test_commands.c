@@ -0,0 +1,111 @@
+/*  Runs commands through the command handler into the motor control task
+*   and checks what the task received.
+*/
+#include <string.h>
+#include "host_test.h"
+#include "host_platform.h"
+#include "host_app.h"
+#include "virtual_motor.h"
+#include "actuator.h"
+
+#define SECONDS(s)      ((uint64_t)(s) * 1000000)
+
+static char published[256];
+
+/**@brief keep the last diagnostics message
+ */
+static void record_publish(const char *topic, const char *data, int len)
+{
+    if (strncmp(topic, "blinddiag/", 10) != 0) return;
+    snprintf(published, sizeof(published), "%.*s", len, data);
+}
+
+static esp_err_t send_binary(uint8_t id,
+    uint8_t position, uint16_t speed, uint32_t sequence)
+{
+    const uint8_t frame[] = { id, position, speed & 0xFF, speed >> 8,
+        sequence & 0xFF, (sequence >> 8) & 0xFF, (sequence >> 16) & 0xFF,
+        sequence >> 24 };
+    return host_app_inject("blindcontrol/bin", (const char *)frame,
+        sizeof(frame));
+}
+
+/**@brief a binary frame has no start time, the move starts right away
+ * 
+ * @details the host build fills locals that are not initialized with a
+ * pattern, so a start time taken from the stack would show up here
+ */
+static void test_binary_start_time(void)
+{
+    const actuator_t *actuator = actuator_get(1);
+    CHECK(send_binary(1, 40, 0, 1) == ESP_OK);
+    host_run_for(SECONDS(1) / 10);
+
+    CHECK(actuator->command.position == 40);
+    CHECK(actuator->command.sequence == 1);
+    CHECK(actuator->command.start_time == 0);
+    CHECK(host_app_run_until_idle(SECONDS(5)));
+    CHECK_NEAR(virtual_motor_get(1)->position,
+        actuator_percent_to_steps(actuator, 40), 0);
+}
+
+static void test_binary_invalid(void)
+{
+    CHECK(send_binary(0, 101, 0, 2) == ESP_ERR_INVALID_ARG);
+    CHECK(host_app_inject("blindcontrol/bin", "\x00\x10", 2)
+        == ESP_ERR_INVALID_SIZE);
+}
+
+/**@brief the flash write counters of the position state are published
+ */
+static void test_diag_position(void)
+{
+    const char get[] = "{\"position\":\"get\"}";
+    const char reset[] = "{\"position\":\"reset\"}";
+
+    host_mqtt_set_listener(record_publish);
+    CHECK(host_app_inject("blindcontrol/diag", get, strlen(get)) == ESP_OK);
+    CHECK(strstr(published, "\"updates\":") != NULL);
+    CHECK(strstr(published, "\"updates\":0,") == NULL);
+
+    CHECK(host_app_inject("blindcontrol/diag", reset, strlen(reset)) == ESP_OK);
+    CHECK(host_app_inject("blindcontrol/diag", get, strlen(get)) == ESP_OK);
+    CHECK(strcmp(published, "{\"updates\":0,\"writes\":0,"
+        "\"writes_avoided\":0,\"write_errors\":0}") == 0);
+    host_mqtt_set_listener(NULL);
+}
+
+/**@brief the steps of the previous moves show up in the step statistics
+ */
+static void test_diag_steps(void)
+{
+    const char get[] = "{\"steps\":\"get\"}";
+    const char reset[] = "{\"steps\":\"reset\"}";
+
+    host_mqtt_set_listener(record_publish);
+    CHECK(host_app_inject("blindcontrol/diag", get, strlen(get)) == ESP_OK);
+    CHECK(strstr(published, "{\"steps\":") == published);
+    CHECK(strstr(published, "{\"steps\":0,") == NULL);
+
+    CHECK(host_app_inject("blindcontrol/diag", reset, strlen(reset)) == ESP_OK);
+    CHECK(host_app_inject("blindcontrol/diag", get, strlen(get)) == ESP_OK);
+    CHECK(strcmp(published,
+        "{\"steps\":0,\"reversals\":0,\"max_late_us\":0}") == 0);
+    host_mqtt_set_listener(NULL);
+}
+
+int main(void)
+{
+    host_nvs_erase();
+    CHECK(host_app_init() == ESP_OK);
+    CHECK(host_app_start() == ESP_OK);
+    CHECK(host_app_run_until_idle(SECONDS(60)));
+
+    test_binary_start_time();
+    test_binary_invalid();
+    test_diag_position();
+    test_diag_steps();
+
+    printf("%s: %d failures\n", __FILE__, host_test_failures);
+    return host_test_failures != 0;
+}
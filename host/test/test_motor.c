@@ -0,0 +1,156 @@
+/*  Runs the motor control against the simulated motors: the calibration
+*   after the first boot, a move, the correction of lost steps at a End Stop
+*   and the coalescing of the position writes, which wait for all motors to
+*   stand still.
+*/
+#include <string.h>
+#include "host_test.h"
+#include "host_platform.h"
+#include "host_app.h"
+#include "virtual_motor.h"
+#include "actuator.h"
+#include "position_state.h"
+#include "motor_control_task.h"
+
+#define SECONDS(s)      ((uint64_t)(s) * 1000000)
+
+static char last_state[96];
+
+static void store_state(const char *topic, const char *data, int len)
+{
+    if (strcmp(topic, "blindstate/0")) return;
+    if (len >= (int)sizeof(last_state)) len = sizeof(last_state) - 1;
+    memcpy(last_state, data, len);
+    last_state[len] = '\0';
+}
+
+static void move_speed(uint8_t id, int percent, int speed)
+{
+    char topic[24];
+    char data[40];
+    snprintf(topic, sizeof(topic), "blindcontrol/%u", id);
+    const int len = speed
+        ? snprintf(data, sizeof(data), "{\"value\":%d,\"speed\":%d}",
+            percent, speed)
+        : snprintf(data, sizeof(data), "{\"value\":%d}", percent);
+    CHECK(host_app_inject(topic, data, len) == ESP_OK);
+}
+
+static void move(uint8_t id, int percent)
+{
+    move_speed(id, percent, 0);
+}
+
+static int32_t position(uint8_t id)
+{
+    return step_generator_get_position(&actuator_get(id)->channel);
+}
+
+/**@brief the first boot measures the travel between the End Stops
+ */
+static void test_calibration(void)
+{
+    CHECK(host_app_run_until_idle(SECONDS(60)));
+    for (uint8_t id = 0; id < ACTUATOR_COUNT; ++id)
+    {
+        CHECK_NEAR(position_state_get_travel(id), STEPPER_UNITS,
+            STEP_GENERATOR_UNITS_PER_STEP);
+        CHECK_NEAR(position(id), virtual_motor_get(id)->position, 0);
+    }
+}
+
+static void test_move(void)
+{
+    actuator_t *actuator = actuator_get(0);
+    move(0, 50);
+    CHECK(host_app_run_until_idle(SECONDS(10)));
+    CHECK_NEAR(virtual_motor_get(0)->position,
+        actuator_percent_to_steps(actuator, 50), 0);
+    CHECK_NEAR(position(0), virtual_motor_get(0)->position, 0);
+    /*  the other motor did not move */
+    CHECK_NEAR(position(1), virtual_motor_get(1)->position, 0);
+
+    host_run_for(SECONDS(1));
+    CHECK(strstr(last_state, "\"position\":50") != NULL);
+    CHECK(strstr(last_state, "\"state\":\"idle\"") != NULL);
+}
+
+/**@brief the rotor lost 10% of the travel, the low End Stop corrects the
+ * position before the move ends
+ */
+static void test_end_stop_correction(void)
+{
+    const actuator_t *actuator = actuator_get(0);
+    const int32_t lost = actuator_percent_to_steps(actuator, 10);
+    virtual_motor_set_position(0, virtual_motor_get(0)->position - lost);
+
+    move(0, 0);
+    CHECK(host_app_run_until_idle(SECONDS(10)));
+    CHECK_NEAR(position(0), 0, 0);
+    CHECK_NEAR(virtual_motor_get(0)->position, 0, 0);
+    CHECK(virtual_motor_get(0)->lost_pulses == 0);
+}
+
+/**@brief a burst of commands gets saved with a single write
+ */
+static void test_position_writes(void)
+{
+    host_run_for(SECONDS(10));
+    const uint32_t writes = host_nvs_write_count();
+    static const int targets[] = { 20, 40, 60, 80, 30 };
+    for (size_t i = 0; i < sizeof(targets) / sizeof(targets[0]); ++i)
+    {
+        move(0, targets[i]);
+        host_run_for(SECONDS(1) / 5);
+    }
+    CHECK(host_app_run_until_idle(SECONDS(10)));
+    CHECK_NEAR(virtual_motor_get(0)->position,
+        actuator_percent_to_steps(actuator_get(0), 30), 0);
+    CHECK(host_nvs_write_count() == writes);
+
+    host_run_for(SECONDS(CONFIG_POSITION_SAVE_DELAY_MS / 1000 + 1));
+    CHECK(host_nvs_write_count() == writes + 1);
+    CHECK_NEAR(position_state_get(0), position(0), 0);
+}
+
+/**@brief a finished move and a new travel are not written while another
+ * motor is still running
+ */
+static void test_writes_held(void)
+{
+    const uint32_t writes = host_nvs_write_count();
+    move_speed(0, 100, 100);
+    move(1, 5);
+    host_run_for(SECONDS(1));
+    CHECK(!actuator_get(1)->moving);
+    CHECK(position_state_set_travel(1, position_state_get_travel(1)) == ESP_OK);
+
+    host_run_for(SECONDS(CONFIG_POSITION_SAVE_DELAY_MS / 1000 + 1));
+    CHECK(actuator_get(0)->moving);
+    CHECK(host_nvs_write_count() == writes);
+
+    CHECK(host_app_run_until_idle(SECONDS(60)));
+    CHECK(host_nvs_write_count() == writes);
+    host_run_for(SECONDS(CONFIG_POSITION_SAVE_DELAY_MS / 1000 + 1));
+    /*  both positions and the travel */
+    CHECK(host_nvs_write_count() == writes + 3);
+    CHECK_NEAR(position_state_get(0), position(0), 0);
+    CHECK_NEAR(position_state_get(1), position(1), 0);
+}
+
+int main(void)
+{
+    host_nvs_erase();
+    host_mqtt_set_listener(store_state);
+    CHECK(host_app_init() == ESP_OK);
+    CHECK(host_app_start() == ESP_OK);
+
+    test_calibration();
+    test_move();
+    test_end_stop_correction();
+    test_position_writes();
+    test_writes_held();
+
+    printf("%s: %d failures\n", __FILE__, host_test_failures);
+    return host_test_failures != 0;
+}
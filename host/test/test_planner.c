@@ -0,0 +1,148 @@
+/*  Checks the profiles of the motion planner: the trapezoid of a long move,
+*   the triangle of a short one, the acceleration of the ramp and the
+*   deceleration to a lowered cruise speed.
+*/
+#include <math.h>
+#include "host_test.h"
+#include "sdkconfig.h"
+#include "motion_planner.h"
+
+#define MAX_STEPS           20000
+#define CRUISE_INTERVAL     (1000000 / CONFIG_STEPPER_MAX_SPEED)
+
+/*  interval before each step of a move */
+static uint32_t intervals[MAX_STEPS];
+/*  ramp index after the last step of a move */
+static uint16_t end_index;
+
+/**@brief plan a move like the step generator does, one call per full step
+ * 
+ * @details returns the duration of the move in us
+ */
+static uint64_t plan_move(int32_t steps, uint16_t max_index)
+{
+    motion_planner_t planner;
+    motion_planner_start(&planner, max_index);
+    uint64_t duration = 0;
+    uint32_t interval = motion_planner_interval(&planner);
+    for (int32_t step = 0; step < steps; ++step)
+    {
+        intervals[step] = interval;
+        duration += interval;
+        interval = motion_planner_step(&planner, steps - step - 1);
+    }
+    end_index = planner.ramp_index;
+    return duration;
+}
+
+/**@brief accelerate, cruise at the max speed and decelerate symmetrically
+ */
+static void test_trapezoid(void)
+{
+    const int32_t steps = 2000;
+    const uint64_t duration = plan_move(steps, motion_planner_speed_index(0));
+
+    int32_t accel_steps = 0;
+    while (intervals[accel_steps] > CRUISE_INTERVAL) ++accel_steps;
+    int32_t decel_steps = 0;
+    while (intervals[steps - 1 - decel_steps] > CRUISE_INTERVAL) ++decel_steps;
+    CHECK(accel_steps > 0);
+    CHECK_NEAR(decel_steps, accel_steps, 1);
+
+    for (int32_t step = 1; step < steps; ++step)
+    {
+        if (step < accel_steps) CHECK(intervals[step] <= intervals[step - 1]);
+        else if (step < steps - decel_steps)
+        {
+            CHECK(intervals[step] == CRUISE_INTERVAL);
+        }
+        else CHECK(intervals[step] >= intervals[step - 1]);
+    }
+    /*  the move ends at standstill */
+    CHECK(end_index == 0);
+
+    /*  v^2 = 2 * a * s, the ramp takes v / a on each side */
+    const double v = CONFIG_STEPPER_MAX_SPEED;
+    const double a = CONFIG_STEPPER_ACCELERATION;
+    const double expected = ((steps - v * v / a) / v + 2 * v / a) * 1000000;
+    CHECK_NEAR(duration, (long long)expected, (long long)(expected / 50));
+}
+
+/**@brief the speed follows v = sqrt(2 * a * s) while accelerating
+ */
+static void test_acceleration(void)
+{
+    plan_move(2000, motion_planner_speed_index(0));
+    for (int32_t step = 10; intervals[step] > CRUISE_INTERVAL; ++step)
+    {
+        const double speed = 1000000.0 / intervals[step];
+        const double expected = sqrt(2.0 * CONFIG_STEPPER_ACCELERATION * step);
+        CHECK_NEAR((long long)speed, (long long)expected,
+            (long long)(expected / 20));
+    }
+}
+
+/**@brief a short move starts decelerating before the cruise speed
+ */
+static void test_triangle(void)
+{
+    const int32_t steps = 100;
+    plan_move(steps, motion_planner_speed_index(0));
+
+    int32_t fastest = 0;
+    for (int32_t step = 1; step < steps; ++step)
+    {
+        if (intervals[step] < intervals[fastest]) fastest = step;
+    }
+    CHECK(intervals[fastest] > CRUISE_INTERVAL);
+    CHECK_NEAR(fastest, steps / 2, 1);
+    CHECK(end_index == 0);
+}
+
+/**@brief a speed limit selects the last ramp step at or below it
+ */
+static void test_speed_limit(void)
+{
+    const uint32_t speed = CONFIG_STEPPER_MAX_SPEED / 2;
+    const uint16_t index = motion_planner_speed_index(speed);
+    plan_move(4000, index);
+    CHECK(intervals[2000] >= 1000000 / speed);
+    CHECK(intervals[2000] < 1000000 / speed * 21 / 20);
+
+    CHECK(motion_planner_speed_index(CONFIG_STEPPER_MAX_SPEED * 2)
+        == motion_planner_speed_index(0));
+}
+
+/**@brief lowering the cruise speed during a move decelerates to it
+ */
+static void test_lowered_speed(void)
+{
+    motion_planner_t planner;
+    motion_planner_start(&planner, motion_planner_speed_index(0));
+    for (int i = 0; i < 1000; ++i) motion_planner_step(&planner, 10000);
+    CHECK(motion_planner_interval(&planner) == CRUISE_INTERVAL);
+
+    planner.max_index = motion_planner_speed_index(CONFIG_STEPPER_MAX_SPEED / 4);
+    uint32_t last = motion_planner_interval(&planner);
+    for (int i = 0; i < 1000; ++i)
+    {
+        const uint32_t interval = motion_planner_step(&planner, 10000);
+        CHECK(interval >= last);
+        last = interval;
+    }
+    CHECK(planner.ramp_index == planner.max_index);
+}
+
+int main(void)
+{
+    CHECK(motion_planner_init() == ESP_OK);
+
+    test_trapezoid();
+    test_acceleration();
+    test_triangle();
+    test_speed_limit();
+    test_lowered_speed();
+
+    printf("%s: %d failures\n", __FILE__, host_test_failures);
+    return host_test_failures != 0;
+}
@@ -0,0 +1,180 @@
+/*  Loads the scene command with hundreds of entries per message: every
+*   actuator has to get the last of its entries and all of them have to
+*   start together, incomplete or too deeply nested scenes have to be
+*   dropped without moving any actuator.
+*/
+#include <string.h>
+#include "host_test.h"
+#include "host_platform.h"
+#include "host_app.h"
+#include "virtual_motor.h"
+#include "actuator.h"
+#include "latency_stats.h"
+
+#define SECONDS(s)      ((uint64_t)(s) * 1000000)
+#define SCENE_ENTRIES   600
+/*  ids above the actuators get skipped by the command handler */
+#define SCENE_IDS       (ACTUATOR_COUNT + 2)
+
+static char scene[SCENE_ENTRIES * 48 + 64];
+
+/**@brief get the time of the first step of each motor from a trace
+ */
+static void read_first_steps(FILE *trace, uint64_t first_step[ACTUATOR_COUNT])
+{
+    unsigned long long time_us;
+    unsigned id;
+    int position;
+
+    memset(first_step, 0, ACTUATOR_COUNT * sizeof(first_step[0]));
+    rewind(trace);
+    while (fscanf(trace, "%llu,%u,%d\n", &time_us, &id, &position) == 3)
+    {
+        if (id < ACTUATOR_COUNT && !first_step[id]) first_step[id] = time_us;
+    }
+}
+
+/**@brief value of the entry, the last entry of each actuator wins
+ */
+static int entry_value(int entry)
+{
+    return (entry * 7) % 101;
+}
+
+/**@brief build a scene with entries for all ids in turn
+ */
+static int build_scene(int entries)
+{
+    int len = snprintf(scene, sizeof(scene), "{\"scene\":[");
+    for (int i = 0; i < entries; ++i)
+    {
+        len += snprintf(scene + len, sizeof(scene) - len,
+            "%s{\"id\":%d,\"value\":%d,\"speed\":800}", i ? "," : "",
+            i % SCENE_IDS, entry_value(i));
+    }
+    len += snprintf(scene + len, sizeof(scene) - len, "]}");
+    return len;
+}
+
+/**@brief the expected position of a actuator after build_scene
+ */
+static int32_t expected_position(uint8_t id, int entries)
+{
+    int last = -1;
+    for (int i = 0; i < entries; ++i)
+    {
+        if (i % SCENE_IDS == id) last = i;
+    }
+    return actuator_percent_to_steps(actuator_get(id), entry_value(last));
+}
+
+static uint32_t parsed_commands(void)
+{
+    latency_histogram_t histogram;
+    latency_stats_get(LATENCY_PARSE, &histogram);
+    return histogram.count;
+}
+
+/**@brief every actuator gets the last of its entries, all start together
+ */
+static void test_large_scene(void)
+{
+    const int len = build_scene(SCENE_ENTRIES);
+    CHECK(len > 16 * 1024);
+
+    FILE *trace = tmpfile();
+    CHECK(trace != NULL);
+    if (!trace) return;
+    virtual_motor_set_trace(trace);
+    CHECK(host_app_inject("blindcontrol/scene", scene, len) == ESP_OK);
+    CHECK(host_app_run_until_idle(SECONDS(30)));
+    virtual_motor_set_trace(NULL);
+
+    uint64_t first_step[ACTUATOR_COUNT];
+    read_first_steps(trace, first_step);
+    fclose(trace);
+    for (uint8_t id = 0; id < ACTUATOR_COUNT; ++id)
+    {
+        CHECK_NEAR(virtual_motor_get(id)->position,
+            expected_position(id, SCENE_ENTRIES), 0);
+        CHECK(first_step[id] != 0);
+        CHECK_NEAR(first_step[id], first_step[0], 0);
+    }
+}
+
+/**@brief a scene cut off like the first part of a message above the MQTT
+ * buffer gets dropped completely
+ */
+static void test_truncated_scene(void)
+{
+    int32_t positions[ACTUATOR_COUNT];
+    for (uint8_t id = 0; id < ACTUATOR_COUNT; ++id)
+    {
+        positions[id] = virtual_motor_get(id)->position;
+    }
+    const uint32_t parsed = parsed_commands();
+
+    /*  other values than the scene before, so a partial apply would move */
+    int len = snprintf(scene, sizeof(scene), "{\"scene\":[");
+    for (int i = 0; len < (int)sizeof(scene) - 64; ++i)
+    {
+        len += snprintf(scene + len, sizeof(scene) - len,
+            "%s{\"id\":%d,\"value\":%d}", i ? "," : "", i % ACTUATOR_COUNT,
+            10 + i % 2);
+    }
+    CHECK(host_app_inject("blindcontrol/scene", scene, 8192) != ESP_OK);
+    CHECK(host_app_inject("blindcontrol/scene", scene, len) != ESP_OK);
+    CHECK(host_app_run_until_idle(SECONDS(5)));
+
+    CHECK(parsed_commands() == parsed);
+    for (uint8_t id = 0; id < ACTUATOR_COUNT; ++id)
+    {
+        CHECK_NEAR(virtual_motor_get(id)->position, positions[id], 0);
+    }
+}
+
+/**@brief entries nested deeper than the scanner supports drop the scene
+ */
+static void test_nested_scene(void)
+{
+    const int32_t position = virtual_motor_get(0)->position;
+    int len = snprintf(scene, sizeof(scene),
+        "{\"scene\":[{\"id\":0,\"value\":20},{\"id\":1,\"value\":20,\"x\":");
+    for (int i = 0; i < 64; ++i) scene[len++] = '[';
+    for (int i = 0; i < 64; ++i) scene[len++] = ']';
+    len += snprintf(scene + len, sizeof(scene) - len, "}]}");
+
+    CHECK(host_app_inject("blindcontrol/scene", scene, len) != ESP_OK);
+    CHECK(host_app_run_until_idle(SECONDS(5)));
+    CHECK_NEAR(virtual_motor_get(0)->position, position, 0);
+}
+
+/**@brief the command handler keeps working after the rejected scenes
+ */
+static void test_scene_after_rejects(void)
+{
+    const int len = build_scene(SCENE_ENTRIES / 2);
+    CHECK(host_app_inject("blindcontrol/scene", scene, len) == ESP_OK);
+    CHECK(host_app_run_until_idle(SECONDS(30)));
+    for (uint8_t id = 0; id < ACTUATOR_COUNT; ++id)
+    {
+        CHECK_NEAR(virtual_motor_get(id)->position,
+            expected_position(id, SCENE_ENTRIES / 2), 0);
+    }
+}
+
+int main(void)
+{
+    host_nvs_erase();
+    CHECK(host_app_init() == ESP_OK);
+    CHECK(host_app_start() == ESP_OK);
+    CHECK(host_app_run_until_idle(SECONDS(60)));
+
+    test_large_scene();
+    test_truncated_scene();
+    test_nested_scene();
+    test_scene_after_rejects();
+
+    printf("%s: %d failures\n", __FILE__, host_test_failures);
+    return host_test_failures != 0;
+}
@@ -0,0 +1,66 @@
+/*  Measures the stack of the motor control task on the deepest paths: the
+*   calibration after the first boot, moves with stalls and End Stop
+*   corrections, a scene and a requested calibration, all with the debug
+*   messages enabled. The frames of the host differ from the ones of the
+*   target, the used stack plus the margin has to fit into
+*   MOTOR_CONTROL_STACK_SIZE.
+*/
+#include <stdio.h>
+#include <string.h>
+#include "host_test.h"
+#include "host_platform.h"
+#include "host_app.h"
+#include "virtual_motor.h"
+#include "actuator.h"
+#include "motor_control_task.h"
+
+#define SECONDS(s)      ((uint64_t)(s) * 1000000)
+#define STACK_MARGIN    512
+
+static actuator_pins_t encoder_pins;
+
+static void inject(const char *topic, const char *data)
+{
+    CHECK(host_app_inject(topic, data, strlen(data)) == ESP_OK);
+    CHECK(host_app_run_until_idle(SECONDS(60)));
+}
+
+int main(void)
+{
+    /*  the messages get formatted, but not shown */
+    host_log_set_level(ESP_LOG_DEBUG);
+    CHECK(freopen("/dev/null", "w", stderr) != NULL);
+
+    host_nvs_erase();
+    CHECK(host_app_init() == ESP_OK);
+    encoder_pins = *actuator_get(0)->pins;
+    encoder_pins.encoder_a = 36;
+    encoder_pins.encoder_b = 39;
+    actuator_get(0)->pins = &encoder_pins;
+    CHECK(host_app_start() == ESP_OK);
+    CHECK(host_app_run_until_idle(SECONDS(60)));
+
+    inject("blindcontrol/0", "{\"value\":50}");
+    /*  blocked blind, the retries and the back off */
+    virtual_motor_set_limits(0, VIRTUAL_MOTOR_NO_LIMIT_LOW,
+        actuator_percent_to_steps(actuator_get(0), 70));
+    inject("blindcontrol/0", "{\"value\":90}");
+    virtual_motor_set_limits(0, VIRTUAL_MOTOR_NO_LIMIT_LOW,
+        VIRTUAL_MOTOR_NO_LIMIT_HIGH);
+    /*  lost steps corrected by the End Stop */
+    virtual_motor_set_position(1, virtual_motor_get(1)->position
+        - actuator_percent_to_steps(actuator_get(1), 10));
+    inject("blindcontrol/1", "{\"value\":0}");
+    inject("blindcontrol/scene",
+        "{\"scene\":[{\"id\":0,\"value\":20},{\"id\":1,\"value\":80}]}");
+    inject("blindcontrol/calibrate", "{}");
+    inject("blindcontrol/diag", "{\"latency\":\"get\"}");
+
+    const UBaseType_t free = uxTaskGetStackHighWaterMark(motor_control_handle);
+    printf("motor control task: %u of %u bytes used\n",
+        (unsigned)(MOTOR_CONTROL_STACK_SIZE - free), MOTOR_CONTROL_STACK_SIZE);
+    CHECK(free >= STACK_MARGIN);
+
+    printf("%s: %d failures\n", __FILE__, host_test_failures);
+    return host_test_failures != 0;
+}
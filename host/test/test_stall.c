@@ -0,0 +1,110 @@
+/*  Runs the stall detection against a simulated motor with encoder: a
+*   blocked blind, the recovery once it is free again and a blind that got
+*   moved by hand while the driver was released.
+*/
+#include "host_test.h"
+#include "host_platform.h"
+#include "host_app.h"
+#include "virtual_motor.h"
+#include "actuator.h"
+#include "stall_detection.h"
+#include "motor_control_task.h"
+
+#define SECONDS(s)      ((uint64_t)(s) * 1000000)
+#define BACK_OFF_UNITS  (CONFIG_ENCODER_BACK_OFF_STEPS * STEP_GENERATOR_UNITS_PER_STEP)
+
+/*  the free input only GPIOs of the current boards */
+static actuator_pins_t encoder_pins;
+
+static void move(int percent)
+{
+    char data[32];
+    const int len = snprintf(data, sizeof(data), "{\"value\":%d}", percent);
+    CHECK(host_app_inject("blindcontrol/0", data, len) == ESP_OK);
+}
+
+static int32_t position(void)
+{
+    return step_generator_get_position(&actuator_get(0)->channel);
+}
+
+/**@brief the blind gets blocked at 30%, the motor retries and backs off
+ */
+static void test_blocked(void)
+{
+    const actuator_t *actuator = actuator_get(0);
+    const int32_t obstacle = actuator_percent_to_steps(actuator, 30);
+    virtual_motor_set_limits(0, VIRTUAL_MOTOR_NO_LIMIT_LOW, obstacle);
+
+    move(80);
+    CHECK(host_app_run_until_idle(SECONDS(20)));
+
+    stall_detection_stats_t stats;
+    stall_detection_get_stats(0, &stats);
+    CHECK(stats.stalls >= CONFIG_ENCODER_STALL_RETRIES + 1);
+    CHECK(stats.back_offs == 1);
+    CHECK(virtual_motor_get(0)->lost_pulses > 0);
+    CHECK_NEAR(virtual_motor_get(0)->position, obstacle - BACK_OFF_UNITS,
+        STEP_GENERATOR_UNITS_PER_STEP);
+    CHECK_NEAR(position(), virtual_motor_get(0)->position,
+        STEP_GENERATOR_UNITS_PER_STEP);
+}
+
+/**@brief the next command after the obstacle got removed reaches its target
+ */
+static void test_recovered(void)
+{
+    virtual_motor_set_limits(0, VIRTUAL_MOTOR_NO_LIMIT_LOW,
+        VIRTUAL_MOTOR_NO_LIMIT_HIGH);
+    move(80);
+    CHECK(host_app_run_until_idle(SECONDS(20)));
+    CHECK_NEAR(virtual_motor_get(0)->position,
+        actuator_percent_to_steps(actuator_get(0), 80), 0);
+    CHECK_NEAR(position(), virtual_motor_get(0)->position, 0);
+}
+
+/**@brief the position is taken over from the encoder before a move starts
+ */
+static void test_moved_by_hand(void)
+{
+    stall_detection_reset_stats();
+    /*  the driver gets released after the holding time */
+    host_run_for(SECONDS(2));
+    virtual_motor_set_position(0, virtual_motor_get(0)->position
+        - 5 * STEP_GENERATOR_UNITS_PER_STEP);
+
+    move(50);
+    CHECK(host_app_run_until_idle(SECONDS(20)));
+
+    stall_detection_stats_t stats;
+    stall_detection_get_stats(0, &stats);
+    CHECK(stats.corrections == 1);
+    CHECK(stats.stalls == 0);
+    CHECK_NEAR(virtual_motor_get(0)->position,
+        actuator_percent_to_steps(actuator_get(0), 50), 0);
+}
+
+int main(void)
+{
+    host_nvs_erase();
+    CHECK(host_app_init() == ESP_OK);
+
+    /*  connect a encoder to actuator 0 before the motor task starts */
+    encoder_pins = *actuator_get(0)->pins;
+    encoder_pins.encoder_a = 36;
+    encoder_pins.encoder_b = 39;
+    actuator_get(0)->pins = &encoder_pins;
+
+    CHECK(host_app_start() == ESP_OK);
+    CHECK(host_encoder_connected(0));
+    CHECK(!host_encoder_connected(1));
+    CHECK(host_app_run_until_idle(SECONDS(60)));
+    stall_detection_reset_stats();
+
+    test_blocked();
+    test_recovered();
+    test_moved_by_hand();
+
+    printf("%s: %d failures\n", __FILE__, host_test_failures);
+    return host_test_failures != 0;
+}
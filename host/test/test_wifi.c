@@ -0,0 +1,90 @@
+/*  Runs the WiFi connection against a simulated access point: the cache of
+*   the access point, the scan after it moved and the use of the new one.
+*/
+#include <string.h>
+#include "host_test.h"
+#include "host_platform.h"
+#include "wifi_task.h"
+
+#define SECONDS(s)      ((uint64_t)(s) * 1000000)
+
+static const uint8_t first_bssid[6] = { 0x24, 0x0a, 0xc4, 0x00, 0x00, 0x01 };
+static const uint8_t second_bssid[6] = { 0x24, 0x0a, 0xc4, 0x00, 0x00, 0x02 };
+
+/**@brief check that the next attempt goes to the access point without scan
+ */
+static void check_station(const uint8_t expected_bssid[6],
+    uint8_t expected_channel)
+{
+    uint8_t bssid[6];
+    uint8_t channel = 0;
+    CHECK(host_wifi_get_station_bssid(bssid, &channel));
+    CHECK(!memcmp(bssid, expected_bssid, sizeof(bssid)));
+    CHECK(channel == expected_channel);
+}
+
+static bool connected_within(uint64_t timeout_us)
+{
+    const uint64_t end = host_time() + timeout_us;
+    while (!wifi_task_wait_connected(0))
+    {
+        if (host_time() >= end) return false;
+        host_run_for(SECONDS(1) / 10);
+    }
+    return true;
+}
+
+/**@brief the first connection scans and caches the access point
+ */
+static void test_first_connect(void)
+{
+    host_wifi_set_access_point(first_bssid, 6);
+    CHECK(wifi_task_init() == ESP_OK);
+    CHECK(connected_within(SECONDS(5)));
+    CHECK(host_wifi_scan_count() == 1);
+    check_station(first_bssid, 6);
+}
+
+/**@brief a reconnect uses the cached access point
+ */
+static void test_reconnect(uint32_t scans)
+{
+    host_wifi_disconnect();
+    CHECK(!wifi_task_wait_connected(0));
+    CHECK(connected_within(SECONDS(5)));
+    CHECK(host_wifi_scan_count() == scans);
+}
+
+/**@brief the access point got replaced, the cached one fails until the scan
+ * finds the new one, which is cached and used afterwards
+ */
+static void test_access_point_changed(void)
+{
+    host_wifi_set_access_point(second_bssid, 11);
+    CHECK(connected_within(SECONDS(30)));
+    CHECK(host_wifi_scan_count() == 2);
+    check_station(second_bssid, 11);
+
+    wifi_task_stats_t stats;
+    wifi_task_get_stats(&stats);
+    CHECK(stats.failures == 2);
+    CHECK(stats.full_scans == 2);
+}
+
+int main(void)
+{
+    host_nvs_erase();
+
+    test_first_connect();
+    test_reconnect(1);
+    test_access_point_changed();
+    test_reconnect(2);
+
+    wifi_task_stats_t stats;
+    wifi_task_get_stats(&stats);
+    CHECK(stats.connects == 4);
+    CHECK(stats.full_scans == 2);
+
+    printf("%s: %d failures\n", __FILE__, host_test_failures);
+    return host_test_failures != 0;
+}
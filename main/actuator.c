@@ -0,0 +1,81 @@
+/*  Contexts of the motors driven by the module.
+*   Each DRV8825 channel gets its own pins, position, queue and planner state,
+*   while the step generation and the motor control task are shared.
+*/
+#include "actuator.h"
+#include "motor_control_task.h"
+#include "esp_log.h"
+#include "esp_attr.h"
+
+static const char *TAG = "ACTUATOR";
+
+/*  the microstep pins are not routed on the current boards, the DRV8825
+*   pulls them low, which selects full steps */
+#define NO_MODE_PINS    { STEP_GENERATOR_PIN_UNUSED, STEP_GENERATOR_PIN_UNUSED, \
+                        STEP_GENERATOR_PIN_UNUSED }
+
+/*  no encoders are connected on the current boards, the input only GPIO 36
+*   and 39 are still free for one */
+#define NO_ENCODER      .encoder_a = ENCODER_PIN_UNUSED, \
+                        .encoder_b = ENCODER_PIN_UNUSED
+
+/*  pins of the DRV8825 channels, only GPIO 0-31 can be used for the
+*   direction, step and mode pins. GPIO 34 and 35 have no internal pull-ups,
+*   so the End Stops of the last channel need external ones */
+static DRAM_ATTR const actuator_pins_t actuator_pins[STEP_GENERATOR_MAX_CHANNELS] = {
+    { .enable = 21, .dir = 22, .step = 23, .high_end_stop = 4,  .low_end_stop = 5,
+        .mode = NO_MODE_PINS, NO_ENCODER },
+    { .enable = 25, .dir = 26, .step = 27, .high_end_stop = 18, .low_end_stop = 19,
+        .mode = NO_MODE_PINS, NO_ENCODER },
+    { .enable = 12, .dir = 13, .step = 14, .high_end_stop = 32, .low_end_stop = 33,
+        .mode = NO_MODE_PINS, NO_ENCODER },
+    { .enable = 15, .dir = 16, .step = 17, .high_end_stop = 34, .low_end_stop = 35,
+        .mode = NO_MODE_PINS, NO_ENCODER },
+};
+
+static actuator_t actuators[ACTUATOR_COUNT];
+
+/**@brief get the context of a motor
+ * 
+ * @details returns NULL when the id is not used. In the IRAM, since the
+ * End Stop interrupt uses it during flash writes.
+ */
+actuator_t * IRAM_ATTR actuator_get(uint8_t id)
+{
+    if (id >= ACTUATOR_COUNT) return NULL;
+    return &actuators[id];
+}
+
+/**@brief convert a position in percent to steps
+ */
+int32_t actuator_percent_to_steps(const actuator_t *actuator, uint8_t percent)
+{
+    return (int32_t)((int64_t)actuator->travel * percent / 100);
+}
+
+/**@brief convert a position in steps to the nearest percent (0-100)
+ */
+uint8_t actuator_steps_to_percent(const actuator_t *actuator, int32_t steps)
+{
+    if (steps <= 0) return 0;
+    if (steps >= actuator->travel) return 100;
+    return (uint8_t)(((int64_t)steps * 100 + actuator->travel / 2)
+        / actuator->travel);
+}
+
+/**@brief Function for initializing the motor contexts
+ * 
+ * @details the travel is replaced by the calibrated one when the position
+ * state gets loaded
+ */
+esp_err_t actuator_init(void)
+{
+    for (uint8_t id = 0; id < ACTUATOR_COUNT; ++id)
+    {
+        actuators[id].id = id;
+        actuators[id].pins = &actuator_pins[id];
+        actuators[id].travel = STEPPER_UNITS;
+    }
+    ESP_LOGI(TAG, "%d actuators configured", ACTUATOR_COUNT);
+    return ESP_OK;
+}
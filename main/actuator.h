@@ -0,0 +1,73 @@
+#ifndef __ACTUATOR__
+#define __ACTUATOR__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "esp_err.h"
+#include "step_generator.h"
+#include "position_queue.h"
+#include "encoder.h"
+
+/*  inform c++ compilers that the function should be compiled in C Style */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*  amount of DRV8825 channels driven by the module */
+#define ACTUATOR_COUNT          CONFIG_ACTUATOR_COUNT
+
+/*  GPIOs of a single DRV8825 channel and its End Stops */
+typedef struct {
+    uint8_t enable;         /* enable stepper driver */
+    uint8_t dir;            /* set direction for the stepper */
+    uint8_t step;           /* Pin that triggers steps */
+    uint8_t high_end_stop;  /* End stop for 100% */
+    uint8_t low_end_stop;   /* End stop for 0% */
+    uint8_t mode[STEP_GENERATOR_MODE_PINS]; /* M0-M2 microstep pins */
+    uint8_t encoder_a;      /* quadrature encoder, ENCODER_PIN_UNUSED without */
+    uint8_t encoder_b;
+} actuator_pins_t;
+
+/*  steps of the travel calibration, see calibration.c */
+typedef enum {
+    CALIBRATION_IDLE = 0,
+    CALIBRATION_LOW_FAST,       /* approach the low end stop fast */
+    CALIBRATION_LOW_BACK_OFF,   /* move away from the low end stop */
+    CALIBRATION_LOW_SLOW,       /* approach the low end stop slowly */
+    CALIBRATION_HIGH_FAST,      /* approach the high end stop fast */
+    CALIBRATION_HIGH_BACK_OFF,  /* move away from the high end stop */
+    CALIBRATION_HIGH_SLOW,      /* approach the high end stop slowly */
+} actuator_calibration_t;
+
+/*  context of a single motor */
+typedef struct {
+    uint8_t id;
+    const actuator_pins_t *pins;
+    step_channel_t channel;         /* position and planner state */
+    xQueueHandle queue;             /* newest position command */
+    position_command_t command;     /* last received command */
+    bool moving;                    /* move not finished by the motor task */
+    bool first_step_pending;        /* first step not measured yet */
+    bool woke;                      /* move started while all motors were idle */
+    bool driver_enabled;            /* driver energized */
+    TickType_t stopped_tick;        /* end of the last move */
+    int32_t travel;                 /* 1/32 steps between 0% and 100% */
+    bool has_encoder;               /* encoder feedback available */
+    int32_t encoder_offset;         /* position at encoder count 0 */
+    uint8_t stall_retries;          /* retries of the current command */
+    actuator_calibration_t calibration;
+} actuator_t;
+
+esp_err_t actuator_init(void);
+actuator_t *actuator_get(uint8_t id);
+int32_t actuator_percent_to_steps(const actuator_t *actuator, uint8_t percent);
+uint8_t actuator_steps_to_percent(const actuator_t *actuator, int32_t steps);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ACTUATOR__ */
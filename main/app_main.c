@@ -11,9 +11,16 @@
 #include "mqtts_task.h"
 #include "motor_control_task.h"
 #include "interrupt_task.h"
+#include "telemetry_task.h"
 #include "position_queue.h"
 #include "nvs_flash_initialize.h"
+#include "position_state.h"
+#include "actuator.h"
 #include "ota_update_task.h"
+#include "benchmark_task.h"
+#include "boot_timing.h"
+#include "time_sync.h"
+#include "power_manager.h"
 
 static const char *TAG = "MOTOR_CONTROL_MAIN";
 
@@ -23,6 +30,24 @@ static const char *TAG = "MOTOR_CONTROL_MAIN";
     #define OTA_UPDATE false
 #endif
 
+#if CONFIG_TIME_SYNC_ACTIVATED == 1
+    #define TIME_SYNC true
+#else
+    #define TIME_SYNC false
+#endif
+
+#if CONFIG_CALIBRATION_ON_FIRST_BOOT == 1
+    #define CALIBRATION_ON_FIRST_BOOT true
+#else
+    #define CALIBRATION_ON_FIRST_BOOT false
+#endif
+
+#if CONFIG_BENCHMARK == 1
+    #define BENCHMARK true
+#else
+    #define BENCHMARK false
+#endif
+
 
 void app_main()
 {
@@ -40,15 +65,17 @@ void app_main()
 
     /*  initialize the nvs flash */
     nvs_flash_initialize();
+    boot_timing_mark(BOOT_PHASE_NVS);
 
-    /*  create Queue for communication between the mqtt and motor control tasks */
-    position_queue_init();
+    /*  set up the contexts of the motors */
+    actuator_init();
 
-    /*  start Wifi task (runs on core 0) */
-    wifi_task_init();
+    /*  load the position of the blinds from the flash */
+    position_state_init();
 
-    /*  start MQTT task */
-    mqtts_task_init();
+    /*  create Queues for communication between the mqtt and motor control tasks */
+    position_queue_init();
+    boot_timing_mark(BOOT_PHASE_POSITION);
 
     /*  start motor control task */
     motor_control_task_init();
@@ -56,9 +83,44 @@ void app_main()
     /*  initialize the Interrupt task */
     interrupt_task_init();
 
+    /*  sleep while the motors stand still, uses the End Stops as wakeup */
+    power_manager_init();
+
+    /*  measure the travel of new actuators, needs the End Stops */
+    if (CALIBRATION_ON_FIRST_BOOT)
+    {
+        motor_control_calibrate_uncalibrated();
+    }
+
+    /*  publish the state of the blinds once mqtt is connected */
+    telemetry_task_init();
+    boot_timing_mark(BOOT_PHASE_MOTOR_READY);
+
+    /*  start Wifi task (runs on core 0), the motors work without it */
+    wifi_task_init();
+
+    /*  the network services are started after the first connection, the
+    *   mqtt client and the ota task handle later reconnects themselves */
+    wifi_task_wait_connected(portMAX_DELAY);
+
+    /*  synchronize the clock for moves with a start time */
+    if (TIME_SYNC)
+    {
+        time_sync_init();
+    }
+
+    /*  start MQTT task */
+    mqtts_task_init();
+
     /*  initialize over the air updates */
     if (OTA_UPDATE)
     {
         ota_update_task_init();
     }
+
+    /*  measure the command path after everything got started */
+    if (BENCHMARK)
+    {
+        benchmark_task_init();
+    }
 }
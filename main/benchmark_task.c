@@ -0,0 +1,321 @@
+/*  Benchmarks of the command path that run on the module after boot.
+*   The results are printed as a single JSON line starting with "BENCHMARK "
+*   and published to blinddiag/benchmark, so they can be collected from the
+*   serial log or the broker and compared between firmware versions.
+*/
+#include <stdio.h>
+#include <stdarg.h>
+#include "benchmark_task.h"
+#include "json_parser.h"
+#include "motion_planner.h"
+#include "position_queue.h"
+#include "command_handler.h"
+#include "latency_stats.h"
+#include "motor_control_task.h"
+#include "mqtts_task.h"
+#include "actuator.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+#define BENCHMARK_TOPIC         "blinddiag/benchmark"
+#define BENCHMARK_START_DELAY_MS 5000   /* let wifi and mqtt settle first */
+#define BENCHMARK_RUNS          3       /* best run is reported */
+#define BENCHMARK_JSON_LOOPS    1000
+#define BENCHMARK_PLANNER_LOOPS 100000
+#define BENCHMARK_QUEUE_LOOPS   1000
+#define BENCHMARK_MOVES         10
+#define BENCHMARK_MOVE_TIMEOUT_MS 10000
+
+static const char *TAG = "BENCHMARK_TASK";
+
+static char payload[4096 + 64];
+static char results[1024];
+static int results_len;
+
+/**@brief append a result to the JSON line
+ */
+static void add_result(const char *name, const char *format, ...)
+{
+    const int size = sizeof(results) - results_len;
+    int len = snprintf(results + results_len, size, "%s\"%s\":{",
+        results_len > 1 ? "," : "", name);
+    if (len < size)
+    {
+        va_list args;
+        va_start(args, format);
+        len += vsnprintf(results + results_len + len, size - len, format, args);
+        va_end(args);
+    }
+    if (len < size)
+    {
+        len += snprintf(results + results_len + len, size - len, "}");
+    }
+    if (len < size) results_len += len;
+}
+
+/**@brief build a command with padding in front of the value
+ * 
+ * @details the padding is a string member, so the parser has to skip it
+ */
+static int build_padded_command(int size)
+{
+    int len = snprintf(payload, sizeof(payload), "{\"padding\":\"");
+    const int padding = size - len - (int)strlen("\",\"value\":50}");
+    for (int i = 0; i < padding; ++i) payload[len++] = 'x';
+    len += snprintf(payload + len, sizeof(payload) - len, "\",\"value\":50}");
+    return len;
+}
+
+/**@brief build a scene with the given amount of entries
+ */
+static int build_scene(int entries)
+{
+    int len = snprintf(payload, sizeof(payload), "{\"scene\":[");
+    for (int i = 0; i < entries; ++i)
+    {
+        len += snprintf(payload + len, sizeof(payload) - len,
+            "%s{\"id\":%d,\"value\":%d,\"speed\":800}", i ? "," : "",
+            i % ACTUATOR_COUNT, i % 101);
+    }
+    len += snprintf(payload + len, sizeof(payload) - len, "]}");
+    return len;
+}
+
+/**@brief time of a single JSON value lookup at a given payload size
+ */
+static void benchmark_json_value(int size)
+{
+    const int len = build_padded_command(size);
+    uint32_t best = UINT32_MAX;
+
+    for (uint8_t run = 0; run < BENCHMARK_RUNS; ++run)
+    {
+        int64_t value;
+        const int64_t start = esp_timer_get_time();
+        for (int i = 0; i < BENCHMARK_JSON_LOOPS; ++i)
+        {
+            json_get_int(payload, len, "value", &value);
+        }
+        const uint32_t elapsed = esp_timer_get_time() - start;
+        if (elapsed < best) best = elapsed;
+    }
+
+    char name[24];
+    snprintf(name, sizeof(name), "json_value_%d", size);
+    add_result(name, "\"bytes\":%u,\"loops\":%u,\"ns_per_op\":%u",
+        (unsigned)len, BENCHMARK_JSON_LOOPS,
+        (unsigned)((uint64_t)best * 1000 / BENCHMARK_JSON_LOOPS));
+}
+
+/**@brief time of a scene scan like the command handler does it
+ */
+static void benchmark_json_scene(int entries)
+{
+    const int len = build_scene(entries);
+    uint32_t best = UINT32_MAX;
+
+    for (uint8_t run = 0; run < BENCHMARK_RUNS; ++run)
+    {
+        const int64_t start = esp_timer_get_time();
+        for (int i = 0; i < BENCHMARK_JSON_LOOPS / 10; ++i)
+        {
+            json_scanner_t scene;
+            json_scanner_t entry;
+            json_find(payload, len, "scene", &scene);
+            while (json_array_next(&scene, &entry) == ESP_OK)
+            {
+                int64_t value;
+                const int entry_len = entry.end - entry.pos;
+                json_get_int(entry.pos, entry_len, "id", &value);
+                json_get_int(entry.pos, entry_len, "value", &value);
+                json_get_int(entry.pos, entry_len, "speed", &value);
+            }
+        }
+        const uint32_t elapsed = esp_timer_get_time() - start;
+        if (elapsed < best) best = elapsed;
+    }
+
+    char name[24];
+    snprintf(name, sizeof(name), "json_scene_%d", entries);
+    add_result(name, "\"bytes\":%u,\"loops\":%u,\"ns_per_op\":%u",
+        (unsigned)len, BENCHMARK_JSON_LOOPS / 10,
+        (unsigned)((uint64_t)best * 10000 / BENCHMARK_JSON_LOOPS));
+}
+
+/**@brief time of a step interval calculation of the motion planner
+ * 
+ * @details runs complete moves, so accelerating, cruising and decelerating
+ * are part of the measurement
+ */
+static void benchmark_planner(void)
+{
+    const int32_t move = 20000;
+    uint32_t best = UINT32_MAX;
+    volatile uint32_t sink = 0;
+
+    for (uint8_t run = 0; run < BENCHMARK_RUNS; ++run)
+    {
+        motion_planner_t planner;
+        int32_t distance = 0;
+        const int64_t start = esp_timer_get_time();
+        for (int i = 0; i < BENCHMARK_PLANNER_LOOPS; ++i)
+        {
+            if (distance <= 0)
+            {
+                motion_planner_start(&planner, motion_planner_speed_index(0));
+                distance = move;
+            }
+            sink += motion_planner_step(&planner, --distance);
+        }
+        const uint32_t elapsed = esp_timer_get_time() - start;
+        if (elapsed < best) best = elapsed;
+    }
+
+    add_result("planner_step", "\"loops\":%u,\"ns_per_op\":%u",
+        BENCHMARK_PLANNER_LOOPS,
+        (unsigned)((uint64_t)best * 1000 / BENCHMARK_PLANNER_LOOPS));
+}
+
+/**@brief send a storm of commands to the motor control task
+ * 
+ * @details the commands contain the current position, so the motor does not
+ * move. The queue keeps only the newest command, consumed is the amount of
+ * commands the motor control task actually received. The storm runs above
+ * the priority of the motor control task, otherwise it would read every
+ * command right away and the queue would never collapse them.
+ */
+static void benchmark_queue_storm(void)
+{
+    actuator_t *actuator = actuator_get(0);
+    position_command_t command = { .position = actuator->command.position };
+    latency_histogram_t before;
+    latency_histogram_t after;
+
+    const UBaseType_t priority = uxTaskPriorityGet(NULL);
+    vTaskPrioritySet(NULL, uxTaskPriorityGet(motor_control_handle) + 1);
+    latency_stats_get(LATENCY_DEQUEUE, &before);
+    const int64_t start = esp_timer_get_time();
+    for (int i = 0; i < BENCHMARK_QUEUE_LOOPS; ++i)
+    {
+        command.received_time = latency_stats_timestamp();
+        position_queue_send(0, &command);
+    }
+    const uint32_t elapsed = esp_timer_get_time() - start;
+    vTaskPrioritySet(NULL, priority);
+    /*  give the motor control task time to read the last command */
+    vTaskDelay(100 / portTICK_PERIOD_MS);
+    latency_stats_get(LATENCY_DEQUEUE, &after);
+
+    add_result("queue_storm", "\"sent\":%u,\"consumed\":%u,\"ns_per_send\":%u",
+        BENCHMARK_QUEUE_LOOPS, (unsigned)(after.count - before.count),
+        (unsigned)((uint64_t)elapsed * 1000 / BENCHMARK_QUEUE_LOOPS));
+}
+
+#if CONFIG_BENCHMARK_MOVES
+/**@brief measure the time from a received command to the first step
+ * 
+ * @details actuator 0 moves 1% and back, the command goes through the same
+ * path as a MQTT message
+ */
+static void benchmark_first_step(void)
+{
+    actuator_t *actuator = actuator_get(0);
+    const uint8_t origin = actuator->command.position;
+    const uint8_t other = origin < 100 ? origin + 1 : origin - 1;
+    latency_histogram_t before;
+    latency_histogram_t after;
+    uint32_t count = 0;
+    uint64_t sum_us = 0;
+    uint32_t max_us = 0;
+    char command[24];
+
+    for (uint8_t i = 0; i < BENCHMARK_MOVES; ++i)
+    {
+        latency_stats_get(LATENCY_FIRST_STEP, &before);
+        const uint8_t target = (i % 2) ? origin : other;
+        const int len = snprintf(command, sizeof(command), "{\"value\":%d}",
+            target);
+        command_handler_process("blindcontrol/0", strlen("blindcontrol/0"),
+            command, len, latency_stats_timestamp());
+
+        /*  wait until the command got received and the move finished */
+        int timeout = BENCHMARK_MOVE_TIMEOUT_MS / 10;
+        do {
+            vTaskDelay(10 / portTICK_PERIOD_MS);
+        } while ((actuator->moving || actuator->command.position != target)
+            && --timeout > 0);
+
+        /*  the histogram keeps the maximum since boot, so the latency of
+        *   each move is taken from the difference */
+        latency_stats_get(LATENCY_FIRST_STEP, &after);
+        if (after.count != before.count + 1) continue;
+        const uint32_t latency = after.sum_us - before.sum_us;
+        if (latency > max_us) max_us = latency;
+        sum_us += latency;
+        ++count;
+    }
+
+    add_result("first_step", "\"moves\":%u,\"mean_us\":%u,\"max_us\":%u",
+        (unsigned)count, count ? (unsigned)(sum_us / count) : 0,
+        (unsigned)max_us);
+}
+#endif
+
+/**@brief report the lowest free stack of the motor control task
+ * 
+ * @details runs after the other benchmarks, so the moves and the command
+ * storm went through the task before
+ */
+static void benchmark_stack(void)
+{
+    add_result("stack_free", "\"motor_control\":%u,\"size\":%u",
+        (unsigned)uxTaskGetStackHighWaterMark(motor_control_handle),
+        MOTOR_CONTROL_STACK_SIZE);
+}
+
+/**@brief Task that runs all benchmarks once
+ */
+static void benchmark_task(void *arg)
+{
+    vTaskDelay(BENCHMARK_START_DELAY_MS / portTICK_PERIOD_MS);
+    ESP_LOGI(TAG, "Start Benchmarks");
+
+    results_len = snprintf(results, sizeof(results), "{");
+    benchmark_json_value(64);
+    benchmark_json_value(256);
+    benchmark_json_value(1024);
+    benchmark_json_value(4096);
+    benchmark_json_scene(4);
+    benchmark_json_scene(32);
+    benchmark_planner();
+    benchmark_queue_storm();
+#if CONFIG_BENCHMARK_MOVES
+    benchmark_first_step();
+#endif
+    benchmark_stack();
+    if (results_len < (int)sizeof(results) - 1)
+    {
+        results[results_len++] = '}';
+        results[results_len] = '\0';
+    }
+
+    printf("BENCHMARK %s\r\n", results);
+    mqtts_task_publish(BENCHMARK_TOPIC, results, results_len, 1, false);
+    vTaskDelete(NULL);
+}
+
+/**@brief Function for initializing the Task of the benchmarks
+ */
+esp_err_t benchmark_task_init(void)
+{
+    xTaskCreate(
+        benchmark_task,         /* Task function */
+        "BENCHMARK",            /* Name of task */
+        4096,                   /* Stack size of task */
+        NULL,                   /* parameter of the task */
+        1,                      /* priority of the task (high is important) */
+        NULL);                  /* Task handle to keep track of created Task */
+    return ESP_OK;
+}
@@ -0,0 +1,20 @@
+#ifndef __BENCHMARK_TASK__
+#define __BENCHMARK_TASK__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "esp_err.h"
+
+/*  inform c++ compilers that the function should be compiled in C Style */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t benchmark_task_init(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __BENCHMARK_TASK__ */
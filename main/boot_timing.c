@@ -0,0 +1,53 @@
+/*  Time from the boot until each startup phase finished the first time.
+*   The network phases finish in the background, so the motors can already
+*   move while the module is still connecting.
+*/
+#include <stdio.h>
+#include "boot_timing.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+static const char *TAG = "BOOT_TIMING";
+
+static const char *phase_names[BOOT_PHASE_COUNT] = {
+    "nvs", "position", "motor_ready", "wifi", "mqtt"
+};
+/*  time of each phase in us since boot, 0 while not finished */
+static uint32_t phase_times[BOOT_PHASE_COUNT];
+
+/**@brief record the time of a finished phase, only the first one counts
+ * 
+ * @details reconnects call it again, they do not change the boot timing
+ */
+void boot_timing_mark(boot_phase_t phase)
+{
+    if (phase >= BOOT_PHASE_COUNT || phase_times[phase]) return;
+
+    phase_times[phase] = (uint32_t)esp_timer_get_time();
+    ESP_LOGI(TAG, "Boot phase %s finished after %u ms", phase_names[phase],
+        (unsigned)(phase_times[phase] / 1000));
+}
+
+/**@brief write the time of all phases in ms as JSON into the buffer
+ * 
+ * @details {"nvs":35,"position":41,"motor_ready":44,"wifi":2210,"mqtt":null}
+ * returns the length or -1 when the buffer is too small
+ */
+int boot_timing_format(char *buffer, int size)
+{
+    int len = snprintf(buffer, size, "{");
+    for (uint8_t phase = 0; phase < BOOT_PHASE_COUNT && len < size; ++phase)
+    {
+        if (phase_times[phase])
+        {
+            len += snprintf(buffer + len, size - len, "%s\"%s\":%u",
+                phase ? "," : "", phase_names[phase],
+                (unsigned)(phase_times[phase] / 1000));
+        } else {
+            len += snprintf(buffer + len, size - len, "%s\"%s\":null",
+                phase ? "," : "", phase_names[phase]);
+        }
+    }
+    if (len < size) len += snprintf(buffer + len, size - len, "}");
+    return len < size ? len : -1;
+}
@@ -0,0 +1,31 @@
+#ifndef __BOOT_TIMING__
+#define __BOOT_TIMING__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "esp_err.h"
+
+/*  inform c++ compilers that the function should be compiled in C Style */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*  phases of the startup in the order they usually finish */
+typedef enum {
+    BOOT_PHASE_NVS = 0,         /* nvs flash initialized */
+    BOOT_PHASE_POSITION,        /* positions loaded from the flash */
+    BOOT_PHASE_MOTOR_READY,     /* motor control and end stops running */
+    BOOT_PHASE_WIFI,            /* first ip address received */
+    BOOT_PHASE_MQTT,            /* first connection to the broker */
+    BOOT_PHASE_COUNT
+} boot_phase_t;
+
+void boot_timing_mark(boot_phase_t phase);
+int boot_timing_format(char *buffer, int size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __BOOT_TIMING__ */
@@ -0,0 +1,172 @@
+/*  Calibration of the travel between the end stops of a actuator.
+*   Each end stop is approached fast, then the motor backs off and approaches
+*   it again slowly, so the switch point gets measured at a low speed. The
+*   low end stop becomes step 0 and the high end stop the travel. Distances
+*   are configured in full steps, positions are kept in 1/32 steps.
+*   Runs inside the motor control task, which hands over the end stop
+*   notifications and calls calibration_update every segment.
+*/
+#include "calibration.h"
+#include "motor_control_task.h"
+#include "position_state.h"
+#include "step_generator.h"
+#include "driver/gpio.h"
+#include "esp_log.h"
+
+#define MAX_DISTANCE    (CONFIG_CALIBRATION_MAX_STEPS * STEP_GENERATOR_UNITS_PER_STEP)
+#define BACK_OFF_DISTANCE (CONFIG_CALIBRATION_BACK_OFF_STEPS * STEP_GENERATOR_UNITS_PER_STEP)
+
+static const char *TAG = "CALIBRATION";
+
+/**@brief check whether a end stop is pressed, they pull the pins to ground
+ */
+static bool end_stop_pressed(const actuator_t *actuator, bool high_end_stop)
+{
+    return gpio_get_level(high_end_stop
+        ? actuator->pins->high_end_stop : actuator->pins->low_end_stop) == 0;
+}
+
+/**@brief move towards a end stop until its interrupt stops the motor
+ * 
+ * @details the move ends after CONFIG_CALIBRATION_MAX_STEPS when the end stop
+ * does not trigger
+ */
+static void approach(actuator_t *actuator, bool high_end_stop, uint16_t speed)
+{
+    const int32_t position = step_generator_get_position(&actuator->channel);
+    step_generator_set_target(&actuator->channel, high_end_stop
+        ? position + MAX_DISTANCE
+        : position - MAX_DISTANCE,
+        speed, step_generator_start_time());
+}
+
+/**@brief move away from a end stop, so it can be approached again
+ */
+static void back_off(actuator_t *actuator, bool high_end_stop)
+{
+    const int32_t position = step_generator_get_position(&actuator->channel);
+    step_generator_set_target(&actuator->channel, high_end_stop
+        ? position - BACK_OFF_DISTANCE
+        : position + BACK_OFF_DISTANCE,
+        0, step_generator_start_time());
+}
+
+/**@brief check whether the end stop of the current approach was reached
+ * 
+ * @details the interrupt stops the motor before it notifies the task, so a
+ * stopped motor with a pressed end stop counts as reached as well
+ */
+static bool end_stop_reached(const actuator_t *actuator, uint32_t notification,
+    bool high_end_stop)
+{
+    const uint32_t bit = high_end_stop
+        ? MOTOR_NOTIFY_HIGH_END_STOP(actuator->id)
+        : MOTOR_NOTIFY_LOW_END_STOP(actuator->id);
+    if (notification & bit) return true;
+    return !step_generator_is_running(&actuator->channel)
+        && end_stop_pressed(actuator, high_end_stop);
+}
+
+/**@brief start the calibration of a actuator
+ * 
+ * @details a running move gets stopped, the position is unknown until the
+ * low end stop is reached
+ */
+void calibration_start(actuator_t *actuator)
+{
+    ESP_LOGI(TAG, "Calibration of actuator %d started", actuator->id);
+    step_generator_stop(&actuator->channel);
+
+    /*  the end stop interrupt does not trigger when it is already pressed */
+    if (end_stop_pressed(actuator, false))
+    {
+        step_generator_set_position(&actuator->channel, 0);
+        actuator->calibration = CALIBRATION_LOW_BACK_OFF;
+        back_off(actuator, false);
+    } else {
+        actuator->calibration = CALIBRATION_LOW_FAST;
+        approach(actuator, false, 0);
+    }
+}
+
+/**@brief advance the calibration of a actuator
+ * 
+ * @details returns true when the calibration is finished or failed, the
+ * motor stands still then
+ */
+bool calibration_update(actuator_t *actuator, uint32_t notification)
+{
+    step_channel_t *channel = &actuator->channel;
+    const bool running = step_generator_is_running(channel);
+
+    switch (actuator->calibration)
+    {
+        case CALIBRATION_LOW_FAST:
+        case CALIBRATION_LOW_SLOW:
+            if (end_stop_reached(actuator, notification, false))
+            {
+                step_generator_set_position(channel, 0);
+                if (actuator->calibration == CALIBRATION_LOW_FAST)
+                {
+                    actuator->calibration = CALIBRATION_LOW_BACK_OFF;
+                    back_off(actuator, false);
+                } else {
+                    actuator->calibration = CALIBRATION_HIGH_FAST;
+                    approach(actuator, true, 0);
+                }
+                return false;
+            }
+            break;
+        case CALIBRATION_LOW_BACK_OFF:
+            if (!running)
+            {
+                actuator->calibration = CALIBRATION_LOW_SLOW;
+                approach(actuator, false, CONFIG_CALIBRATION_SLOW_SPEED);
+            }
+            return false;
+        case CALIBRATION_HIGH_FAST:
+            if (end_stop_reached(actuator, notification, true))
+            {
+                actuator->calibration = CALIBRATION_HIGH_BACK_OFF;
+                back_off(actuator, true);
+                return false;
+            }
+            break;
+        case CALIBRATION_HIGH_BACK_OFF:
+            if (!running)
+            {
+                actuator->calibration = CALIBRATION_HIGH_SLOW;
+                approach(actuator, true, CONFIG_CALIBRATION_SLOW_SPEED);
+            }
+            return false;
+        case CALIBRATION_HIGH_SLOW:
+            if (end_stop_reached(actuator, notification, true))
+            {
+                actuator->travel = step_generator_get_position(channel);
+                actuator->calibration = CALIBRATION_IDLE;
+                ESP_LOGI(TAG, "Calibration of actuator %d finished: %d/%d steps",
+                    actuator->id, actuator->travel, STEP_GENERATOR_UNITS_PER_STEP);
+
+                esp_err_t error_code = position_state_set_travel(actuator->id,
+                    actuator->travel);
+                if (error_code != ESP_OK)
+                {
+                    ESP_LOGI(TAG, "ERROR: %d", error_code);
+                }
+                return true;
+            }
+            break;
+        default:
+            return true;
+    }
+
+    /*  the approach ended without reaching the end stop */
+    if (!running)
+    {
+        ESP_LOGI(TAG, "Calibration of actuator %d failed, no end stop within %d steps",
+            actuator->id, CONFIG_CALIBRATION_MAX_STEPS);
+        actuator->calibration = CALIBRATION_IDLE;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,22 @@
+#ifndef __CALIBRATION__
+#define __CALIBRATION__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "esp_err.h"
+#include "actuator.h"
+
+/*  inform c++ compilers that the function should be compiled in C Style */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void calibration_start(actuator_t *actuator);
+bool calibration_update(actuator_t *actuator, uint32_t notification);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CALIBRATION__ */
@@ -0,0 +1,462 @@
+/*  Handles the commands received over MQTT.
+*   Independent of the MQTT client, so commands can be injected from
+*   other sources as well.
+*/
+#include "command_handler.h"
+#include "position_queue.h"
+#include "actuator.h"
+#include "mqtts_task.h"
+#include "latency_stats.h"
+#include "interrupt_task.h"
+#include "motor_control_task.h"
+#include "ota_update_task.h"
+#include "boot_timing.h"
+#include "wifi_task.h"
+#include "time_sync.h"
+#include "power_manager.h"
+#include "stall_detection.h"
+#include "position_state.h"
+#include "step_generator.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "json_parser.h"
+
+#define MQTT_BLINDS_TOPIC "blindcontrol"
+#define MQTT_BINARY_TOPIC "blindcontrol/bin"
+#define MQTT_SCENE_TOPIC "blindcontrol/scene"
+#define MQTT_DIAG_TOPIC "blindcontrol/diag"
+#define MQTT_CALIBRATE_TOPIC "blindcontrol/calibrate"
+#define MQTT_MICROSTEPS_TOPIC "blindcontrol/microsteps"
+#define MQTT_OTA_TOPIC "blindcontrol/ota"
+#define MQTT_LATENCY_TOPIC "blinddiag/latency"
+#define MQTT_END_STOPS_TOPIC "blinddiag/end_stops"
+#define MQTT_BOOT_TOPIC "blinddiag/boot"
+#define MQTT_WIFI_TOPIC "blinddiag/wifi"
+#define MQTT_TIME_TOPIC "blinddiag/time"
+#define MQTT_POWER_TOPIC "blinddiag/power"
+#define MQTT_ENCODER_TOPIC "blinddiag/encoder"
+#define MQTT_POSITION_TOPIC "blinddiag/position"
+#define MQTT_STEPS_TOPIC "blinddiag/steps"
+#define BINARY_COMMAND_SIZE 8
+
+static const char *TAG = "COMMAND_HANDLER";
+
+/**@brief get a position value (0-100%) from JSON strings
+ */
+static esp_err_t json_find_uint8(const char *data, int data_len,
+    const char *path, uint8_t *value)
+{
+    int64_t new_value;
+    esp_err_t error_code = json_get_int(data, data_len, path, &new_value);
+    if (error_code != ESP_OK) return error_code;
+
+    /*  value for Blinds can only be 0-100% */
+    if (new_value > 100 || new_value < 0) return ESP_ERR_INVALID_ARG;
+
+    *value = (uint8_t)new_value;
+    return ESP_OK;
+}
+
+#if CONFIG_MQTT_BINARY_COMMANDS
+/**@brief decode a command frame of the binary topic
+ * 
+ * @details frame layout (little-endian):
+ * target (u8), position (u8), speed (u16), sequence (u32)
+ */
+static esp_err_t decode_binary_command(const uint8_t *data, int data_len,
+    uint8_t *target, position_command_t *command)
+{
+    if (data_len != BINARY_COMMAND_SIZE) return ESP_ERR_INVALID_SIZE;
+    /*  value for Blinds can only be 0-100% */
+    if (data[1] > 100) return ESP_ERR_INVALID_ARG;
+
+    *target = data[0];
+    command->position = data[1];
+    command->speed = (uint16_t)data[2] | (uint16_t)data[3] << 8;
+    command->sequence = (uint32_t)data[4] | (uint32_t)data[5] << 8
+        | (uint32_t)data[6] << 16 | (uint32_t)data[7] << 24;
+    return ESP_OK;
+}
+
+/**@brief process a command of the binary topic
+ */
+static esp_err_t process_binary_command(const char *data, int data_len,
+    uint32_t received_time)
+{
+    uint8_t target;
+    /*  the frame has no start time, the fields it does not set stay 0 */
+    position_command_t command = { .received_time = received_time };
+    esp_err_t error_code = decode_binary_command((const uint8_t *)data,
+        data_len, &target, &command);
+    if (error_code != ESP_OK)
+    {
+        ESP_LOGI(TAG, "BINARY ERROR: %d", error_code);
+        return error_code;
+    }
+
+    latency_stats_record(LATENCY_PARSE, received_time);
+    return position_queue_send(target, &command);
+}
+#endif
+
+/**@brief get the optional sequence number of a command
+ * 
+ * @details a command with a sequence number that is not above the last one
+ * of the actuator is a duplicate, e.g. after a redelivery of the broker
+ */
+static uint32_t json_find_sequence(const char *data, int data_len)
+{
+    int64_t sequence;
+    if (json_get_int(data, data_len, "seq", &sequence) != ESP_OK
+        || sequence < 0 || sequence > UINT32_MAX)
+    {
+        return 0;
+    }
+    return (uint32_t)sequence;
+}
+
+/**@brief get the optional synchronized start time of a command
+ * 
+ * @details "start" is the server time in ms since 1970. Returns the
+ * esp_timer time of the start or 0 to start right away, e.g. when the clock
+ * is not synchronized yet.
+ */
+static int64_t json_find_start_time(const char *data, int data_len)
+{
+    int64_t start_ms;
+    int64_t start_time;
+    if (json_get_int(data, data_len, "start", &start_ms) != ESP_OK) return 0;
+
+    if (time_sync_to_local(start_ms, &start_time) != ESP_OK)
+    {
+        ESP_LOGI(TAG, "clock not synchronized, starting right away");
+        return 0;
+    }
+    if (start_time - esp_timer_get_time()
+        > (int64_t)CONFIG_TIME_SYNC_MAX_DELAY_S * 1000000)
+    {
+        ESP_LOGI(TAG, "start time too far in the future, starting right away");
+        return 0;
+    }
+    return start_time;
+}
+
+/**@brief process a command of the JSON topic
+ * 
+ * @details calls json_find_uint8 to get the new position for the blinds and
+ * hands it over to the motor control task. The speed, the sequence number
+ * "seq" and the start time "start" are optional.
+ */
+static esp_err_t process_json_command(uint8_t id, const char *data,
+    int data_len, uint32_t received_time)
+{
+    position_command_t command = { .received_time = received_time };
+    esp_err_t error_code = json_find_uint8(data, data_len, "value",
+        &command.position);
+    if (error_code != ESP_OK)
+    {
+        ESP_LOGI(TAG, "JSON ERROR: %d", error_code);
+        return error_code;
+    }
+
+    int64_t speed;
+    if (json_get_int(data, data_len, "speed", &speed) == ESP_OK
+        && speed > 0 && speed <= UINT16_MAX)
+    {
+        command.speed = (uint16_t)speed;
+    }
+    command.sequence = json_find_sequence(data, data_len);
+    command.start_time = json_find_start_time(data, data_len);
+    latency_stats_record(LATENCY_PARSE, received_time);
+
+    ESP_LOGI(TAG, "writing value: %d to the queue of actuator %d",
+        (int)command.position, id);
+    return position_queue_send(id, &command);
+}
+
+/**@brief process a scene that moves multiple actuators at once
+ * 
+ * @details payload: {"seq": 12, "start": 1700000000000, "scene": [{"id": 0,
+ * "value": 50, "speed": 800}, ...]}, the sequence number and the start time
+ * are optional and apply to every entry.
+ * The entries are applied while scanning, so the amount of entries is not
+ * limited. Later entries for the same actuator replace earlier ones and all
+ * actuators get handed over to the motor control task together.
+ */
+static esp_err_t process_scene_command(const char *data, int data_len,
+    uint32_t received_time)
+{
+    position_command_t commands[ACTUATOR_COUNT];
+    uint32_t id_mask = 0;
+    uint32_t skipped = 0;
+    const uint32_t sequence = json_find_sequence(data, data_len);
+    const int64_t start_time = json_find_start_time(data, data_len);
+
+    json_scanner_t scene;
+    esp_err_t error_code = json_find(data, data_len, "scene", &scene);
+    if (error_code != ESP_OK)
+    {
+        ESP_LOGI(TAG, "JSON ERROR: %d", error_code);
+        return error_code;
+    }
+
+    json_scanner_t entry;
+    while ((error_code = json_array_next(&scene, &entry)) == ESP_OK)
+    {
+        const int entry_len = entry.end - entry.pos;
+        int64_t id;
+        position_command_t command = {
+            .sequence = sequence,
+            .received_time = received_time,
+            .start_time = start_time,
+        };
+
+        if (json_get_int(entry.pos, entry_len, "id", &id) != ESP_OK
+            || id < 0 || id >= ACTUATOR_COUNT
+            || json_find_uint8(entry.pos, entry_len, "value",
+                &command.position) != ESP_OK)
+        {
+            ++skipped;
+            continue;
+        }
+
+        int64_t speed;
+        if (json_get_int(entry.pos, entry_len, "speed", &speed) == ESP_OK
+            && speed > 0 && speed <= UINT16_MAX)
+        {
+            command.speed = (uint16_t)speed;
+        }
+
+        commands[id] = command;
+        id_mask |= 1UL << id;
+    }
+    /*  the array has to be complete, otherwise the scene gets dropped */
+    if (error_code != ESP_ERR_NOT_FOUND)
+    {
+        ESP_LOGI(TAG, "JSON ERROR: %d", error_code);
+        return error_code;
+    }
+
+    if (skipped)
+    {
+        ESP_LOGI(TAG, "skipped %u invalid scene entries", (unsigned)skipped);
+    }
+    if (!id_mask) return ESP_ERR_NOT_FOUND;
+    latency_stats_record(LATENCY_PARSE, received_time);
+    return position_queue_send_batch(commands, id_mask);
+}
+
+/**@brief process a calibration request
+ * 
+ * @details {"id": 1} calibrates a single actuator, without an id all
+ * actuators get calibrated
+ */
+static esp_err_t process_calibrate_command(const char *data, int data_len)
+{
+    int64_t id;
+    esp_err_t error_code = json_get_int(data, data_len, "id", &id);
+    if (error_code == ESP_ERR_NOT_FOUND)
+    {
+        return motor_control_calibrate(UINT32_MAX);
+    }
+    if (error_code != ESP_OK || id < 0 || id >= ACTUATOR_COUNT)
+    {
+        ESP_LOGI(TAG, "JSON ERROR: %d", error_code);
+        return ESP_ERR_INVALID_ARG;
+    }
+    return motor_control_calibrate(1UL << id);
+}
+
+/**@brief process a change of the microstep modes
+ * 
+ * @details {"id": 1, "coarse": 1, "fine": 16} sets the microsteps per full
+ * step while cruising and for the approach, without an id all actuators
+ * are changed
+ */
+static esp_err_t process_microsteps_command(const char *data, int data_len)
+{
+    int64_t coarse;
+    int64_t fine;
+    if (json_get_int(data, data_len, "coarse", &coarse) != ESP_OK
+        || json_get_int(data, data_len, "fine", &fine) != ESP_OK
+        || coarse < 1 || coarse > UINT8_MAX || fine < 1 || fine > UINT8_MAX)
+    {
+        ESP_LOGI(TAG, "JSON ERROR: invalid microsteps");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    int64_t id;
+    uint32_t id_mask = UINT32_MAX;
+    esp_err_t error_code = json_get_int(data, data_len, "id", &id);
+    if (error_code == ESP_OK)
+    {
+        if (id < 0 || id >= ACTUATOR_COUNT) return ESP_ERR_INVALID_ARG;
+        id_mask = 1UL << id;
+    } else if (error_code != ESP_ERR_NOT_FOUND) {
+        ESP_LOGI(TAG, "JSON ERROR: %d", error_code);
+        return error_code;
+    }
+    return motor_control_set_microsteps(id_mask, (uint8_t)coarse, (uint8_t)fine);
+}
+
+/*  statistics that can be requested over the diagnostics topic */
+typedef struct {
+    const char *name;
+    const char *topic;
+    int (*format)(char *buffer, int size);
+    void (*reset)(void);
+} diag_entry_t;
+
+static const diag_entry_t diag_entries[] = {
+    { "latency", MQTT_LATENCY_TOPIC, latency_stats_format, latency_stats_reset },
+    { "end_stops", MQTT_END_STOPS_TOPIC, interrupt_task_format_stats,
+        interrupt_task_reset_stats },
+    { "boot", MQTT_BOOT_TOPIC, boot_timing_format, NULL },
+    { "wifi", MQTT_WIFI_TOPIC, wifi_task_format_stats, wifi_task_reset_stats },
+    { "time", MQTT_TIME_TOPIC, time_sync_format_stats, time_sync_reset_stats },
+    { "power", MQTT_POWER_TOPIC, power_manager_format_stats,
+        power_manager_reset_stats },
+    { "encoder", MQTT_ENCODER_TOPIC, stall_detection_format_stats,
+        stall_detection_reset_stats },
+    { "position", MQTT_POSITION_TOPIC, position_state_format_stats,
+        position_state_reset_stats },
+    { "steps", MQTT_STEPS_TOPIC, step_generator_format_stats,
+        step_generator_reset_stats },
+};
+
+/**@brief process a request of the diagnostics topic
+ * 
+ * @details {"<name>": "get"} publishes the statistics to blinddiag/<name>,
+ * {"<name>": "reset"} clears them. Available are "latency", "end_stops",
+ * "boot", "wifi", "time", "power", "encoder", "position" and "steps", the
+ * boot timing can not be reset.
+ */
+static esp_err_t process_diag_command(const char *data, int data_len)
+{
+    /*  only used by the mqtt task, so it does not need to be on the stack */
+    static char response[2048];
+    const char *request;
+    int request_len;
+
+    for (size_t i = 0; i < sizeof(diag_entries) / sizeof(diag_entries[0]); ++i)
+    {
+        const diag_entry_t *entry = &diag_entries[i];
+        if (json_get_string(data, data_len, entry->name,
+            &request, &request_len) != ESP_OK)
+        {
+            continue;
+        }
+
+        if (request_len == 5 && strncmp(request, "reset", 5) == 0)
+        {
+            if (!entry->reset) return ESP_ERR_NOT_SUPPORTED;
+            entry->reset();
+            return ESP_OK;
+        }
+        if (request_len == 3 && strncmp(request, "get", 3) == 0)
+        {
+            const int len = entry->format(response, sizeof(response));
+            if (len < 0) return ESP_ERR_INVALID_SIZE;
+            return mqtts_task_publish(entry->topic, response, len, 0, false);
+        }
+        return ESP_ERR_INVALID_ARG;
+    }
+    ESP_LOGI(TAG, "unknown diagnostics request");
+    return ESP_ERR_NOT_FOUND;
+}
+
+/**@brief check whether the topic matches, topic is not \0 terminated
+ */
+static bool topic_matches(const char *topic, int topic_len,
+    const char *expected, bool prefix)
+{
+    /*  strlen can be used since the expected string always \0 terminated */
+    const int expected_len = strlen(expected);
+    if (topic_len < expected_len || (!prefix && topic_len != expected_len))
+    {
+        return false;
+    }
+    return strncmp(topic, expected, expected_len) == 0;
+}
+
+/**@brief get the actuator id from a topic "blindcontrol/<id>"
+ * 
+ * @details the topic "blindcontrol" addresses actuator 0 for compatibility
+ */
+static esp_err_t parse_actuator_topic(const char *topic, int topic_len,
+    uint8_t *id)
+{
+    const int prefix_len = strlen(MQTT_BLINDS_TOPIC);
+    if (!topic_matches(topic, topic_len, MQTT_BLINDS_TOPIC, true))
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (topic_len == prefix_len)
+    {
+        *id = 0;
+        return ESP_OK;
+    }
+    if (topic[prefix_len] != '/' || topic_len == prefix_len + 1)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    uint32_t value = 0;
+    for (int i = prefix_len + 1; i < topic_len; ++i)
+    {
+        if (topic[i] < '0' || topic[i] > '9') return ESP_ERR_NOT_FOUND;
+        value = value * 10 + (topic[i] - '0');
+        if (value > UINT8_MAX) return ESP_ERR_NOT_FOUND;
+    }
+    *id = (uint8_t)value;
+    return ESP_OK;
+}
+
+/**@brief process a received command
+ * 
+ * @details received_time is a timestamp of latency_stats_timestamp taken when
+ * the message arrived, 0 excludes the command from the latency statistics
+ */
+esp_err_t command_handler_process(const char *topic, int topic_len,
+    const char *data, int data_len, uint32_t received_time)
+{
+#if CONFIG_MQTT_BINARY_COMMANDS
+    if (topic_matches(topic, topic_len, MQTT_BINARY_TOPIC, false))
+    {
+        return process_binary_command(data, data_len, received_time);
+    }
+#endif
+
+    if (topic_matches(topic, topic_len, MQTT_SCENE_TOPIC, false))
+    {
+        return process_scene_command(data, data_len, received_time);
+    }
+
+    if (topic_matches(topic, topic_len, MQTT_CALIBRATE_TOPIC, false))
+    {
+        return process_calibrate_command(data, data_len);
+    }
+
+    if (topic_matches(topic, topic_len, MQTT_MICROSTEPS_TOPIC, false))
+    {
+        return process_microsteps_command(data, data_len);
+    }
+
+    /*  a new firmware got released, the content is not used */
+    if (topic_matches(topic, topic_len, MQTT_OTA_TOPIC, false))
+    {
+        return ota_update_task_check();
+    }
+
+    if (topic_matches(topic, topic_len, MQTT_DIAG_TOPIC, false))
+    {
+        return process_diag_command(data, data_len);
+    }
+
+    uint8_t id;
+    if (parse_actuator_topic(topic, topic_len, &id) == ESP_OK)
+    {
+        return process_json_command(id, data, data_len, received_time);
+    }
+    return ESP_ERR_NOT_FOUND;
+}
@@ -0,0 +1,21 @@
+#ifndef __COMMAND_HANDLER__
+#define __COMMAND_HANDLER__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "esp_err.h"
+
+/*  inform c++ compilers that the function should be compiled in C Style */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t command_handler_process(const char *topic, int topic_len,
+    const char *data, int data_len, uint32_t received_time);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __COMMAND_HANDLER__ */
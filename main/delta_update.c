@@ -0,0 +1,252 @@
+/*  Applies a binary patch against the running firmware.
+*   The patch gets streamed from the server and the new image is written
+*   directly into the inactive OTA partition, so neither the patch nor the
+*   image has to fit into the RAM.
+*
+*   Patch format (all numbers little-endian):
+*       header:  "BDP1", size of the new image (u32)
+*       COPY:    0x01, offset in the running image (u32), length (u32)
+*       INSERT:  0x02, length (u32), followed by length bytes of data
+*   The commands are applied in order until the new image is complete.
+*   Patches get created by tools/delta_patch.py.
+*/
+#include "delta_update.h"
+#include "firmware_download.h"
+#include "motor_control_task.h"
+#include "esp_http_client.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "esp_log.h"
+#include "mbedtls/sha256.h"
+
+#define PATCH_MAGIC             "BDP1"
+#define PATCH_HEADER_SIZE       8
+#define PATCH_COMMAND_COPY      0x01
+#define PATCH_COMMAND_INSERT    0x02
+#define PATCH_BUFFER_SIZE       1024
+
+static const char *TAG = "DELTA_UPDATE";
+
+/*  state of a running patch */
+typedef struct {
+    esp_http_client_handle_t client;
+    const esp_partition_t *source;
+    esp_ota_handle_t ota_handle;
+    mbedtls_sha256_context sha256;
+    uint32_t written;
+    uint8_t buffer[PATCH_BUFFER_SIZE];
+} delta_patch_t;
+
+/**@brief read a little-endian u32
+ */
+static uint32_t read_u32(const uint8_t *data)
+{
+    return (uint32_t)data[0] | (uint32_t)data[1] << 8
+        | (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24;
+}
+
+/**@brief read exactly len bytes of the patch
+ */
+static esp_err_t read_patch(delta_patch_t *patch, uint8_t *data, uint32_t len)
+{
+    while (len > 0)
+    {
+        const int read = esp_http_client_read(patch->client, (char *)data, len);
+        if (read <= 0) return ESP_ERR_INVALID_SIZE;
+        data += read;
+        len -= read;
+    }
+    return ESP_OK;
+}
+
+/**@brief write a part of the new image and add it to the hash
+ */
+static esp_err_t write_image(delta_patch_t *patch, const uint8_t *data,
+    uint32_t len)
+{
+    /*  flash writes stall the tasks of a running move */
+    motor_control_wait_idle();
+    esp_err_t error_code = esp_ota_write(patch->ota_handle, data, len);
+    if (error_code != ESP_OK) return error_code;
+
+    mbedtls_sha256_update_ret(&patch->sha256, data, len);
+    patch->written += len;
+    return ESP_OK;
+}
+
+/**@brief copy a part of the running image into the new one
+ */
+static esp_err_t apply_copy(delta_patch_t *patch, uint32_t offset,
+    uint32_t len)
+{
+    if (offset > patch->source->size || len > patch->source->size - offset)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    while (len > 0)
+    {
+        const uint32_t chunk = len < PATCH_BUFFER_SIZE ? len : PATCH_BUFFER_SIZE;
+        esp_err_t error_code = esp_partition_read(patch->source, offset,
+            patch->buffer, chunk);
+        if (error_code != ESP_OK) return error_code;
+        error_code = write_image(patch, patch->buffer, chunk);
+        if (error_code != ESP_OK) return error_code;
+        offset += chunk;
+        len -= chunk;
+    }
+    return ESP_OK;
+}
+
+/**@brief copy new data from the patch into the new image
+ */
+static esp_err_t apply_insert(delta_patch_t *patch, uint32_t len)
+{
+    while (len > 0)
+    {
+        const uint32_t chunk = len < PATCH_BUFFER_SIZE ? len : PATCH_BUFFER_SIZE;
+        esp_err_t error_code = read_patch(patch, patch->buffer, chunk);
+        if (error_code != ESP_OK) return error_code;
+        error_code = write_image(patch, patch->buffer, chunk);
+        if (error_code != ESP_OK) return error_code;
+        len -= chunk;
+    }
+    return ESP_OK;
+}
+
+/**@brief apply all commands of the patch until the image is complete
+ */
+static esp_err_t apply_commands(delta_patch_t *patch, uint32_t image_size)
+{
+    uint8_t command[9];
+    esp_err_t error_code = ESP_OK;
+
+    while (error_code == ESP_OK && patch->written < image_size)
+    {
+        error_code = read_patch(patch, command, 5);
+        if (error_code != ESP_OK) return error_code;
+
+        const uint32_t remaining = image_size - patch->written;
+        if (command[0] == PATCH_COMMAND_COPY)
+        {
+            error_code = read_patch(patch, command + 5, 4);
+            if (error_code != ESP_OK) return error_code;
+            const uint32_t len = read_u32(command + 5);
+            if (len > remaining) return ESP_ERR_INVALID_SIZE;
+            error_code = apply_copy(patch, read_u32(command + 1), len);
+        } else if (command[0] == PATCH_COMMAND_INSERT) {
+            const uint32_t len = read_u32(command + 1);
+            if (len > remaining) return ESP_ERR_INVALID_SIZE;
+            error_code = apply_insert(patch, len);
+        } else {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+    return error_code;
+}
+
+/**@brief convert the hex string of a sha256 hash
+ */
+esp_err_t delta_update_parse_hash(const char *hex, uint8_t *sha256)
+{
+    if (strlen(hex) != DELTA_UPDATE_HASH_SIZE * 2) return ESP_ERR_INVALID_SIZE;
+
+    for (uint8_t i = 0; i < DELTA_UPDATE_HASH_SIZE * 2; ++i)
+    {
+        const char c = hex[i];
+        uint8_t value;
+        if (c >= '0' && c <= '9') value = c - '0';
+        else if (c >= 'a' && c <= 'f') value = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') value = c - 'A' + 10;
+        else return ESP_ERR_INVALID_ARG;
+
+        if (i % 2) sha256[i / 2] |= value;
+        else sha256[i / 2] = value << 4;
+    }
+    return ESP_OK;
+}
+
+/**@brief download a patch and write the patched image into the inactive
+ * OTA partition
+ * 
+ * @details the new image only becomes the boot partition when its hash
+ * matches, otherwise the running firmware stays active and the caller can
+ * fall back to the full image
+ */
+esp_err_t delta_update_apply(const delta_update_t *update)
+{
+    static delta_patch_t patch;
+    uint8_t header[PATCH_HEADER_SIZE];
+    uint8_t hash[DELTA_UPDATE_HASH_SIZE];
+    esp_err_t error_code;
+
+    const esp_partition_t *target = esp_ota_get_next_update_partition(NULL);
+    patch.source = esp_ota_get_running_partition();
+    patch.written = 0;
+    if (!target || !patch.source) return ESP_ERR_NOT_FOUND;
+
+    esp_http_client_config_t config = {
+        .url = update->url,
+        .cert_pem = update->cert_pem,
+    };
+    patch.client = esp_http_client_init(&config);
+    if (!patch.client) return ESP_ERR_NO_MEM;
+
+    error_code = esp_http_client_open(patch.client, 0);
+    if (error_code != ESP_OK)
+    {
+        esp_http_client_cleanup(patch.client);
+        return error_code;
+    }
+    esp_http_client_fetch_headers(patch.client);
+
+    error_code = esp_http_client_get_status_code(patch.client) == 200
+        ? read_patch(&patch, header, sizeof(header)) : ESP_ERR_NOT_FOUND;
+    if (error_code == ESP_OK && memcmp(header, PATCH_MAGIC, 4) != 0)
+    {
+        error_code = ESP_ERR_INVALID_VERSION;
+    }
+
+    const uint32_t image_size = read_u32(header + 4);
+    if (error_code == ESP_OK)
+    {
+        ESP_LOGI(TAG, "Patching %s into %s, new image has %u bytes",
+            patch.source->label, target->label, (unsigned)image_size);
+        /*  only the size of the new image gets erased, which also destroys
+        *   the part of a interrupted full download */
+        firmware_download_clear_checkpoint();
+        /*  the erase stalls the tasks of a running move for seconds */
+        motor_control_wait_idle();
+        error_code = esp_ota_begin(target, image_size, &patch.ota_handle);
+    }
+
+    if (error_code == ESP_OK)
+    {
+        mbedtls_sha256_init(&patch.sha256);
+        mbedtls_sha256_starts_ret(&patch.sha256, 0);
+        error_code = apply_commands(&patch, image_size);
+        mbedtls_sha256_finish_ret(&patch.sha256, hash);
+        mbedtls_sha256_free(&patch.sha256);
+
+        if (error_code == ESP_OK
+            && memcmp(hash, update->sha256, DELTA_UPDATE_HASH_SIZE) != 0)
+        {
+            ESP_LOGI(TAG, "Hash of the patched image does not match");
+            error_code = ESP_ERR_INVALID_CRC;
+        }
+        /*  also validates the image, has to be called to free the handle */
+        const esp_err_t end_error = esp_ota_end(patch.ota_handle);
+        if (error_code == ESP_OK) error_code = end_error;
+    }
+
+    esp_http_client_close(patch.client);
+    esp_http_client_cleanup(patch.client);
+
+    if (error_code == ESP_OK)
+    {
+        error_code = esp_ota_set_boot_partition(target);
+    }
+    ESP_LOGI(TAG, "Patch finished after %u bytes, error: %d",
+        (unsigned)patch.written, error_code);
+    return error_code;
+}
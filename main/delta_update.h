@@ -0,0 +1,30 @@
+#ifndef __DELTA_UPDATE__
+#define __DELTA_UPDATE__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "esp_err.h"
+
+/*  inform c++ compilers that the function should be compiled in C Style */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DELTA_UPDATE_HASH_SIZE  32
+
+/*  patch from the running firmware to a new one */
+typedef struct {
+    const char *url;
+    const char *cert_pem;
+    uint8_t sha256[DELTA_UPDATE_HASH_SIZE];    /* hash of the new image */
+} delta_update_t;
+
+esp_err_t delta_update_parse_hash(const char *hex, uint8_t *sha256);
+esp_err_t delta_update_apply(const delta_update_t *patch);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __DELTA_UPDATE__ */
@@ -0,0 +1,113 @@
+/*  Pulse counter backend for the quadrature encoders.
+*   Both channels of a PCNT unit count the edges of one encoder signal, while
+*   the other signal sets the direction, so every edge is counted in hardware.
+*   The 16 bit counter resets at its limits, the interrupt only adds the limit
+*   to a 32 bit offset then.
+*/
+#include "encoder.h"
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_attr.h"
+#include "driver/pcnt.h"
+#include "soc/pcnt_struct.h"
+
+#define ENCODER_LIMIT           30000 /* counter range before it overflows */
+#define ENCODER_FILTER          100   /* ignore pulses shorter than 1.25 us */
+
+static const char *TAG = "ENCODER";
+static volatile int32_t overflow[ENCODER_MAX_UNITS];
+static bool isr_installed = false;
+
+/**@brief collect the overflows of all units
+ */
+static void IRAM_ATTR encoder_isr(void *arg)
+{
+    const uint32_t intr_status = PCNT.int_st.val;
+    for (uint8_t unit = 0; unit < ENCODER_MAX_UNITS; ++unit)
+    {
+        if (!(intr_status & BIT(unit))) continue;
+
+        const uint32_t status = PCNT.status_unit[unit].val;
+        PCNT.int_clr.val = BIT(unit);
+        if (status & PCNT_STATUS_H_LIM_M) overflow[unit] += ENCODER_LIMIT;
+        if (status & PCNT_STATUS_L_LIM_M) overflow[unit] -= ENCODER_LIMIT;
+    }
+}
+
+/**@brief configure a channel of a unit to count the edges of pulse_gpio
+ * 
+ * @details the direction of the edges depends on the level of ctrl_gpio,
+ * the second channel uses the pins swapped and the opposite direction
+ */
+static esp_err_t config_channel(uint8_t unit, pcnt_channel_t channel,
+    uint8_t pulse_gpio, uint8_t ctrl_gpio, bool reverse)
+{
+    const pcnt_config_t config = {
+        .pulse_gpio_num = pulse_gpio,
+        .ctrl_gpio_num = ctrl_gpio,
+        .lctrl_mode = PCNT_MODE_REVERSE,
+        .hctrl_mode = PCNT_MODE_KEEP,
+        .pos_mode = reverse ? PCNT_COUNT_INC : PCNT_COUNT_DEC,
+        .neg_mode = reverse ? PCNT_COUNT_DEC : PCNT_COUNT_INC,
+        .counter_h_lim = ENCODER_LIMIT,
+        .counter_l_lim = -ENCODER_LIMIT,
+        .unit = (pcnt_unit_t)unit,
+        .channel = channel,
+    };
+    return pcnt_unit_config(&config);
+}
+
+/**@brief Function for initializing a encoder
+ * 
+ * @details the count starts at 0
+ */
+esp_err_t encoder_init(uint8_t unit, uint8_t a_gpio, uint8_t b_gpio)
+{
+    if (unit >= ENCODER_MAX_UNITS) return ESP_ERR_INVALID_ARG;
+
+    esp_err_t error_code = config_channel(unit, PCNT_CHANNEL_0, a_gpio, b_gpio,
+        false);
+    if (error_code == ESP_OK)
+    {
+        error_code = config_channel(unit, PCNT_CHANNEL_1, b_gpio, a_gpio, true);
+    }
+    if (error_code != ESP_OK) return error_code;
+
+    pcnt_set_filter_value((pcnt_unit_t)unit, ENCODER_FILTER);
+    pcnt_filter_enable((pcnt_unit_t)unit);
+    pcnt_event_enable((pcnt_unit_t)unit, PCNT_EVT_H_LIM);
+    pcnt_event_enable((pcnt_unit_t)unit, PCNT_EVT_L_LIM);
+
+    pcnt_counter_pause((pcnt_unit_t)unit);
+    pcnt_counter_clear((pcnt_unit_t)unit);
+    overflow[unit] = 0;
+
+    if (!isr_installed)
+    {
+        error_code = pcnt_isr_register(encoder_isr, NULL, 0, NULL);
+        if (error_code != ESP_OK) return error_code;
+        isr_installed = true;
+    }
+    pcnt_intr_enable((pcnt_unit_t)unit);
+    pcnt_counter_resume((pcnt_unit_t)unit);
+
+    ESP_LOGI(TAG, "Encoder %d on GPIO %d/%d", unit, a_gpio, b_gpio);
+    return ESP_OK;
+}
+
+/**@brief read the count of a encoder
+ * 
+ * @details the offset is read again, since the counter might have
+ * overflowed in between. A pending overflow is waited for, the counter is
+ * already reset then.
+ */
+int32_t encoder_get_count(uint8_t unit)
+{
+    int32_t offset;
+    int16_t count;
+    do {
+        offset = overflow[unit];
+        pcnt_get_counter_value((pcnt_unit_t)unit, &count);
+    } while (offset != overflow[unit] || (PCNT.int_raw.val & BIT(unit)));
+    return offset + count;
+}
@@ -0,0 +1,28 @@
+#ifndef __ENCODER__
+#define __ENCODER__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "esp_err.h"
+
+/*  inform c++ compilers that the function should be compiled in C Style */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*  maximum amount of encoders, one pulse counter unit each */
+#define ENCODER_MAX_UNITS       8
+#define ENCODER_PIN_UNUSED      0xFF /* encoder not connected */
+
+/*  The counts are quadrature decoded (4 counts per line) and extended to
+*   32 bit. Like pulse_output this is the only hardware dependency of the
+*   feedback, a host build can replace it with a simulated motor. */
+esp_err_t encoder_init(uint8_t unit, uint8_t a_gpio, uint8_t b_gpio);
+int32_t encoder_get_count(uint8_t unit);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ENCODER__ */
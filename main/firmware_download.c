@@ -0,0 +1,391 @@
+/*  Downloads a firmware image into the inactive OTA partition in the
+*   background. The bandwidth can be limited and the task pauses between
+*   the chunks, so MQTT and the motor control are not slowed down.
+*   The progress is saved in the NVS, an interrupted download continues
+*   with a HTTP range request after a reconnect or reboot. The checkpoint
+*   belongs to the url and version of the image and to the ETag the server
+*   sent for it. The range request carries the ETag in If-Range, so a server
+*   whose image changed since answers with the whole new image.
+*/
+#include <strings.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "firmware_download.h"
+#include "motor_control_task.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "nvs.h"
+
+#define DOWNLOAD_NAMESPACE      "ota"
+#define DOWNLOAD_CHUNK_SIZE     1024
+/*  progress is saved every 16 sectors to limit the NVS writes */
+#define DOWNLOAD_CHECKPOINT_SIZE (16 * SPI_FLASH_SEC_SIZE)
+#define DOWNLOAD_ETAG_SIZE      64
+
+static const char *TAG = "FIRMWARE_DOWNLOAD";
+
+/*  state of a running download */
+typedef struct {
+    esp_http_client_handle_t client;
+    const esp_partition_t *partition;
+    uint32_t image_hash;        /* url and version of the image */
+    char etag[DOWNLOAD_ETAG_SIZE];  /* ETag of the image, empty when unknown */
+    char received_etag[DOWNLOAD_ETAG_SIZE]; /* ETag of the current response */
+    int64_t range_start;        /* start of the Content-Range, -1 without */
+    uint32_t offset;            /* bytes written to the partition */
+    uint32_t erased;            /* end of the erased part of the partition */
+    uint32_t size;              /* size of the image, 0 when unknown */
+    char buffer[DOWNLOAD_CHUNK_SIZE];
+} download_t;
+
+/**@brief FNV-1a hash of the url and the version of the image
+ * 
+ * @details a checkpoint only belongs to this image, a new release under
+ * the same url starts from the beginning
+ */
+static uint32_t hash_image(const char *url, double version)
+{
+    uint32_t hash = 2166136261UL;
+    while (*url)
+    {
+        hash = (hash ^ (uint8_t)*url++) * 16777619UL;
+    }
+    const uint8_t *bytes = (const uint8_t *)&version;
+    for (size_t i = 0; i < sizeof(version); ++i)
+    {
+        hash = (hash ^ bytes[i]) * 16777619UL;
+    }
+    return hash;
+}
+
+/**@brief get the offset of a interrupted download of the same image
+ * 
+ * @details also loads the ETag of the image, a checkpoint without one can
+ * not be resumed safely
+ */
+static uint32_t load_checkpoint(download_t *download)
+{
+    nvs_handle task_nvs_handle;
+    uint32_t image_hash = 0;
+    uint32_t address = 0;
+    uint32_t offset = 0;
+    size_t etag_length = sizeof(download->etag);
+
+    download->etag[0] = '\0';
+    if (nvs_open(DOWNLOAD_NAMESPACE, NVS_READONLY, &task_nvs_handle) != ESP_OK)
+    {
+        return 0;
+    }
+    nvs_get_u32(task_nvs_handle, "image_hash", &image_hash);
+    nvs_get_u32(task_nvs_handle, "address", &address);
+    nvs_get_u32(task_nvs_handle, "offset", &offset);
+    if (nvs_get_str(task_nvs_handle, "etag", download->etag, &etag_length)
+        != ESP_OK)
+    {
+        download->etag[0] = '\0';
+    }
+    nvs_close(task_nvs_handle);
+
+    if (image_hash != download->image_hash || !download->etag[0]
+        || address != download->partition->address
+        || offset > download->partition->size)
+    {
+        download->etag[0] = '\0';
+        return 0;
+    }
+    return offset;
+}
+
+/**@brief save the progress, offset has to be at a sector boundary
+ * 
+ * @details without a ETag of the image the progress is not saved
+ */
+static esp_err_t save_checkpoint(const download_t *download, uint32_t offset)
+{
+    if (!download->etag[0]) return ESP_ERR_NOT_SUPPORTED;
+
+    nvs_handle task_nvs_handle;
+    esp_err_t error_code = nvs_open(DOWNLOAD_NAMESPACE, NVS_READWRITE,
+        &task_nvs_handle);
+    if (error_code != ESP_OK) return error_code;
+
+    error_code = nvs_set_u32(task_nvs_handle, "image_hash", download->image_hash);
+    if (error_code == ESP_OK)
+    {
+        error_code = nvs_set_str(task_nvs_handle, "etag", download->etag);
+    }
+    if (error_code == ESP_OK)
+    {
+        error_code = nvs_set_u32(task_nvs_handle, "address",
+            download->partition->address);
+    }
+    if (error_code == ESP_OK)
+    {
+        error_code = nvs_set_u32(task_nvs_handle, "offset", offset);
+    }
+    if (error_code == ESP_OK)
+    {
+        error_code = nvs_commit(task_nvs_handle);
+    }
+    nvs_close(task_nvs_handle);
+    return error_code;
+}
+
+/**@brief remove the progress, e.g. after a finished download or when the
+ * partition got erased by someone else
+ */
+void firmware_download_clear_checkpoint(void)
+{
+    nvs_handle task_nvs_handle;
+    if (nvs_open(DOWNLOAD_NAMESPACE, NVS_READWRITE, &task_nvs_handle) != ESP_OK)
+    {
+        return;
+    }
+    nvs_erase_key(task_nvs_handle, "offset");
+    nvs_commit(task_nvs_handle);
+    nvs_close(task_nvs_handle);
+}
+
+/**@brief check whether a interrupted download can be resumed
+ */
+bool firmware_download_has_checkpoint(void)
+{
+    nvs_handle task_nvs_handle;
+    uint32_t offset = 0;
+    if (nvs_open(DOWNLOAD_NAMESPACE, NVS_READONLY, &task_nvs_handle) != ESP_OK)
+    {
+        return false;
+    }
+    nvs_get_u32(task_nvs_handle, "offset", &offset);
+    nvs_close(task_nvs_handle);
+    return offset != 0;
+}
+
+/**@brief get the first byte of a Content-Range "bytes <start>-<end>/<size>"
+ * 
+ * @details returns -1 when the header can not be parsed
+ */
+static int64_t parse_range_start(const char *content_range)
+{
+    if (strncasecmp(content_range, "bytes ", 6) != 0) return -1;
+    const char *start = content_range + 6;
+    char *end;
+    const unsigned long value = strtoul(start, &end, 10);
+    if (end == start || *end != '-') return -1;
+    return value;
+}
+
+/**@brief collect the ETag and the Content-Range of the response
+ */
+static esp_err_t download_event_handler(esp_http_client_event_t *evt)
+{
+    download_t *download = evt->user_data;
+    if (evt->event_id != HTTP_EVENT_ON_HEADER) return ESP_OK;
+
+    if (strcasecmp(evt->header_key, "ETag") == 0)
+    {
+        strncpy(download->received_etag, evt->header_value,
+            DOWNLOAD_ETAG_SIZE - 1);
+        download->received_etag[DOWNLOAD_ETAG_SIZE - 1] = '\0';
+    } else if (strcasecmp(evt->header_key, "Content-Range") == 0) {
+        download->range_start = parse_range_start(evt->header_value);
+    }
+    return ESP_OK;
+}
+
+/**@brief write a chunk of the image, the sectors get erased when needed
+ */
+static esp_err_t write_chunk(download_t *download, int len)
+{
+    esp_err_t error_code;
+
+    if (download->offset + len > download->partition->size)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    while (download->offset + len > download->erased)
+    {
+        error_code = esp_partition_erase_range(download->partition,
+            download->erased, SPI_FLASH_SEC_SIZE);
+        if (error_code != ESP_OK) return error_code;
+        download->erased += SPI_FLASH_SEC_SIZE;
+    }
+
+    error_code = esp_partition_write(download->partition, download->offset,
+        download->buffer, len);
+    if (error_code != ESP_OK) return error_code;
+    download->offset += len;
+    return ESP_OK;
+}
+
+/**@brief drop the checkpoint, the download starts from the beginning
+ */
+static void restart_download(download_t *download)
+{
+    firmware_download_clear_checkpoint();
+    download->offset = 0;
+    download->etag[0] = '\0';
+    esp_http_client_delete_header(download->client, "Range");
+    esp_http_client_delete_header(download->client, "If-Range");
+}
+
+/**@brief open the request, continues at the offset when it is not 0
+ * 
+ * @details the range is only sent together with the ETag of the image in
+ * If-Range. When the image changed or the server does not support ranges it
+ * answers with the whole image, then the checkpoint is dropped and the
+ * download starts from the beginning. The same happens when a partial
+ * answer does not start at the offset.
+ */
+static esp_err_t open_download(download_t *download)
+{
+    if (download->offset)
+    {
+        char range[32];
+        snprintf(range, sizeof(range), "bytes=%u-", (unsigned)download->offset);
+        esp_http_client_set_header(download->client, "Range", range);
+        esp_http_client_set_header(download->client, "If-Range", download->etag);
+    }
+
+    download->received_etag[0] = '\0';
+    download->range_start = -1;
+    esp_err_t error_code = esp_http_client_open(download->client, 0);
+    if (error_code != ESP_OK) return error_code;
+
+    const int content_length = esp_http_client_fetch_headers(download->client);
+    const int status = esp_http_client_get_status_code(download->client);
+    if (status == 200)
+    {
+        if (download->offset)
+        {
+            ESP_LOGI(TAG, "Image changed, downloading it from the beginning");
+            restart_download(download);
+        }
+        strcpy(download->etag, download->received_etag);
+    } else if (status == 206 && download->offset
+        && download->range_start != download->offset) {
+        ESP_LOGI(TAG, "Range starts at %d instead of %u, restarting",
+            (int)download->range_start, (unsigned)download->offset);
+        esp_http_client_close(download->client);
+        restart_download(download);
+        return open_download(download);
+    } else if (status != 206 || !download->offset) {
+        ESP_LOGI(TAG, "Download failed with status %d", status);
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+
+    download->erased = download->offset;
+    download->size = content_length > 0 ? download->offset + content_length : 0;
+    if (download->size > download->partition->size) return ESP_ERR_INVALID_SIZE;
+
+    ESP_LOGI(TAG, "Downloading into %s from byte %u, image size %u",
+        download->partition->label, (unsigned)download->offset,
+        (unsigned)download->size);
+    return ESP_OK;
+}
+
+/**@brief wait until the download stays below the configured bandwidth
+ * 
+ * @details always pauses for a tick, so tasks with a lower priority get the
+ * cpu between the chunks as well
+ */
+static void throttle(int64_t start_time, uint32_t received)
+{
+    TickType_t delay = 1;
+#if CONFIG_OTA_DOWNLOAD_RATE_KBPS > 0
+    const int64_t planned = (int64_t)received * 1000000
+        / (CONFIG_OTA_DOWNLOAD_RATE_KBPS * 1024);
+    const int64_t ahead = planned - (esp_timer_get_time() - start_time);
+    if (ahead > 0) delay += ahead / 1000 / portTICK_PERIOD_MS;
+#endif
+    vTaskDelay(delay);
+}
+
+/**@brief download the image into the partition
+ */
+static esp_err_t download_image(download_t *download)
+{
+    const int64_t start_time = esp_timer_get_time();
+    uint32_t received = 0;
+    uint32_t next_checkpoint = download->offset + DOWNLOAD_CHECKPOINT_SIZE;
+
+    for(;;)
+    {
+        const int len = esp_http_client_read(download->client,
+            download->buffer, DOWNLOAD_CHUNK_SIZE);
+        if (len < 0) return ESP_ERR_INVALID_RESPONSE;
+        if (len == 0) break;
+
+        /*  the cache is disabled during flash writes, which stalls the tasks
+        *   of a running move */
+        motor_control_wait_idle();
+        esp_err_t error_code = write_chunk(download, len);
+        if (error_code != ESP_OK) return error_code;
+
+        received += len;
+        if (download->offset >= next_checkpoint)
+        {
+            /*  the sector at the checkpoint gets erased again on resume */
+            save_checkpoint(download, download->offset & ~(SPI_FLASH_SEC_SIZE - 1));
+            next_checkpoint += DOWNLOAD_CHECKPOINT_SIZE;
+        }
+        throttle(start_time, received);
+    }
+
+    if (download->size && download->offset != download->size)
+    {
+        ESP_LOGI(TAG, "Download interrupted after %u bytes",
+            (unsigned)download->offset);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return ESP_OK;
+}
+
+/**@brief download a firmware image and make it the boot partition
+ * 
+ * @details version is the one of the update information. A interrupted
+ * download of the same url and version continues at the last checkpoint
+ * when the server still has the same image. The image gets verified before
+ * it becomes the boot partition.
+ */
+esp_err_t firmware_download_install(const esp_http_client_config_t *config,
+    double version)
+{
+    static download_t download;
+    esp_err_t error_code;
+
+    download.partition = esp_ota_get_next_update_partition(NULL);
+    if (!download.partition) return ESP_ERR_NOT_FOUND;
+    download.image_hash = hash_image(config->url, version);
+    download.offset = load_checkpoint(&download);
+    if (download.offset)
+    {
+        ESP_LOGI(TAG, "Resuming the download at %u bytes",
+            (unsigned)download.offset);
+    }
+
+    esp_http_client_config_t download_config = *config;
+    download_config.event_handler = download_event_handler;
+    download_config.user_data = &download;
+    download.client = esp_http_client_init(&download_config);
+    if (!download.client) return ESP_ERR_NO_MEM;
+
+    error_code = open_download(&download);
+    if (error_code == ESP_OK)
+    {
+        error_code = download_image(&download);
+    }
+    esp_http_client_close(download.client);
+    esp_http_client_cleanup(download.client);
+    if (error_code != ESP_OK) return error_code;
+
+    /*  verifies the image, a broken one has to be downloaded again */
+    motor_control_wait_idle();
+    error_code = esp_ota_set_boot_partition(download.partition);
+    firmware_download_clear_checkpoint();
+    return error_code;
+}
@@ -0,0 +1,24 @@
+#ifndef __FIRMWARE_DOWNLOAD__
+#define __FIRMWARE_DOWNLOAD__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "esp_err.h"
+#include "esp_http_client.h"
+
+/*  inform c++ compilers that the function should be compiled in C Style */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t firmware_download_install(const esp_http_client_config_t *config,
+    double version);
+void firmware_download_clear_checkpoint(void);
+bool firmware_download_has_checkpoint(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __FIRMWARE_DOWNLOAD__ */
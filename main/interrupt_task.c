@@ -1,123 +1,247 @@
-#include <math.h>
+#include <stdio.h>
 #include "interrupt_task.h"
 #include "motor_control_task.h"
+#include "step_generator.h"
+#include "actuator.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/semphr.h"
-#include "freertos/queue.h"
 #include "esp_log.h"
-#include "nvs_flash.h"
+#include "esp_attr.h"
+#include "esp_intr_alloc.h"
 #include "driver/gpio.h"
+#include "soc/gpio_struct.h"
+#include "xtensa/hal.h"
 
 /*  END STOP DEFINITIONS */
-#define GPIO_HIGH_END_STOP      4   /* End stop for 100% */
-#define GPIO_LOW_END_STOP       5   /* End stop for 0% */
-#define GPIO_END_STOPS  ((1ULL<<GPIO_HIGH_END_STOP) | (1ULL<<GPIO_LOW_END_STOP))
-#define ESP_INTR_FLAG_DEFAULT 0
+/*  the interrupt has to stop the motor during flash writes as well, so the
+*   whole handler path runs from the IRAM and accesses the GPIO registers
+*   directly instead of the gpio driver functions in the flash */
+#define ESP_INTR_FLAG_END_STOPS ESP_INTR_FLAG_IRAM
+/*  the isr argument holds the actuator id and which end stop triggered */
+#define END_STOP_ARG(id, high)  ((void*)(uintptr_t)(((id) << 1) | (high)))
+/*  debounce window in cpu cycles and ticks */
+#define DEBOUNCE_CYCLES         (CONFIG_END_STOP_DEBOUNCE_MS * 1000UL \
+                                * CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ)
+#define DEBOUNCE_TICKS          (CONFIG_END_STOP_DEBOUNCE_MS / portTICK_PERIOD_MS + 1)
+
+/*  debounce state of a single end stop, only used by the ISR */
+typedef struct {
+    uint32_t last_edge;     /* cycle count of the last edge */
+    TickType_t last_tick;   /* tick of the last edge, the cycle count wraps */
+    end_stop_stats_t stats;
+} end_stop_t;
 
 static const char *TAG = "INTERRUPT_TASK";
-/* queue that handles handles GPIO events from isr */
-static xQueueHandle gpio_evt_queue = NULL;
+static end_stop_t end_stops[ACTUATOR_COUNT][2];
+/*  the End Stops use level interrupts as light sleep wakeup while idle */
+static volatile bool wakeup_armed = false;
+static portMUX_TYPE wakeup_mux = portMUX_INITIALIZER_UNLOCKED;
 
-static esp_err_t set_end_stop_position(uint32_t io_num)
+/**@brief get the GPIO of a End Stop
+ */
+static inline gpio_num_t IRAM_ATTR end_stop_gpio(uint8_t id, bool high_end_stop)
 {
-    nvs_handle task_nvs_handle;
-    esp_err_t error_code;
-    uint8_t new_position;
+    const actuator_pins_t *pins = actuator_get(id)->pins;
+    return high_end_stop ? pins->high_end_stop : pins->low_end_stop;
+}
 
-    /*  open NVS flash */
-    error_code = nvs_open("position", NVS_READWRITE, &task_nvs_handle);
-    if (error_code != ESP_OK) return error_code;
+/**@brief read the level of a End Stop from inside the ISR
+ */
+static inline int IRAM_ATTR end_stop_level(gpio_num_t gpio)
+{
+    if (gpio < 32) return (GPIO.in >> gpio) & 1;
+    return (GPIO.in1.data >> (gpio - 32)) & 1;
+}
 
-    /* Move the blinds to the new position */
-    if (io_num == GPIO_HIGH_END_STOP)
+/**@brief restore the edge interrupts of all End Stops, wakeup_mux has to be
+ * taken
+ * 
+ * @details same as gpio_wakeup_disable and gpio_set_intr_type, which are not
+ * in the IRAM
+ */
+static void IRAM_ATTR disarm_wakeup(void)
+{
+    for (uint8_t id = 0; id < ACTUATOR_COUNT; ++id)
     {
-        new_position = 100;
-    } else {
-        new_position = 0;
+        for (uint8_t high = 0; high < 2; ++high)
+        {
+            const gpio_num_t gpio = end_stop_gpio(id, high);
+            GPIO.pin[gpio].wakeup_enable = 0;
+            GPIO.pin[gpio].int_type = GPIO_INTR_NEGEDGE;
+        }
     }
+    wakeup_armed = false;
+}
 
-    /*  Read old position from NVS
-    *   old position defaults to 0 if not set in NVS */
-    uint8_t old_position = 0;
-    error_code = nvs_get_u8(task_nvs_handle, "old_position", &old_position);
-    /*  value can´t be found on first run -> ESP_ERR_NVS_NOT_FOUND */
-    if (error_code != ESP_OK && error_code != ESP_ERR_NVS_NOT_FOUND){
-        return error_code;
-    }
+/**@brief handle a reached End Stop, has to be called from a ISR
+ * 
+ * @details stops the step generator right away and notifies the motor
+ * control task, which corrects the position afterwards. Separated from the
+ * GPIO interrupt, so End Stop events can be injected from other sources.
+ */
+void IRAM_ATTR interrupt_task_end_stop_from_isr(uint8_t id, bool high_end_stop)
+{
+    actuator_t *actuator = actuator_get(id);
+    if (!actuator) return;
+    end_stop_stats_t *stats = &end_stops[id][high_end_stop].stats;
 
-    /*  make sure the event does not get triggered multiple times
-    *   because the interrupt gets triggered more than once */
-    if (new_position == old_position)
+    /*  ignore the end stop when the motor moves away from it */
+    if (!step_generator_end_stop(&actuator->channel, high_end_stop))
     {
-        nvs_close(task_nvs_handle);
-        return ESP_OK;
+        ++stats->ignored;
+        return;
     }
+    ++stats->events;
 
-    ESP_LOGI(TAG, "End Stop reached: Correcting the current position to: %d", new_position);
-    /*  delete motor control task, so nothing gets destroyed */
-    vTaskDelete(motor_control_handle);
+    BaseType_t higher_priority_task_woken = pdFALSE;
+    xTaskNotifyFromISR(motor_control_handle,
+        high_end_stop ? MOTOR_NOTIFY_HIGH_END_STOP(id) : MOTOR_NOTIFY_LOW_END_STOP(id),
+        eSetBits, &higher_priority_task_woken);
+    if (higher_priority_task_woken) portYIELD_FROM_ISR();
+}
 
-    /*  Write new position to NVS */
-    ESP_LOGI(TAG, "save end stop position in Non Volatile Storage");
-    error_code = nvs_set_u8(task_nvs_handle, "old_position", new_position);
-    if (error_code != ESP_OK) return error_code;
+/**@brief Interrupt of the End Stops
+ * 
+ * @details the first edge stops the motor right away, all edges until the
+ * switch was quiet for the debounce window are bounces. The window restarts
+ * with each edge, so a long burst still only causes a single event.
+ */
+static void IRAM_ATTR gpio_isr_handler(void* arg)
+{
+    const uint32_t end_stop = (uintptr_t) arg;
+    end_stop_t *state = &end_stops[end_stop >> 1][end_stop & 1];
 
-    /*  Commit written value.
-    *   After setting any values, nvs_commit() must be called to ensure changes are written
-    *   to flash storage. */
-    ESP_LOGI(TAG, "Commit changes to Non Volatile Storage");
-    error_code = nvs_commit(task_nvs_handle);
-    if (error_code != ESP_OK) return error_code;
+    /*  the level interrupt fires until the edge interrupts are restored */
+    if (wakeup_armed)
+    {
+        portENTER_CRITICAL_ISR(&wakeup_mux);
+        if (wakeup_armed) disarm_wakeup();
+        portEXIT_CRITICAL_ISR(&wakeup_mux);
 
-    /*  Close NVS */
-    ESP_LOGI(TAG, "Close Non Volatile Storage");
-    nvs_close(task_nvs_handle);
+        /*  the motor control task arms the wakeups again */
+        BaseType_t higher_priority_task_woken = pdFALSE;
+        xTaskNotifyFromISR(motor_control_handle, MOTOR_NOTIFY_WAKEUP,
+            eSetBits, &higher_priority_task_woken);
+        if (higher_priority_task_woken) portYIELD_FROM_ISR();
+        /*  a opened switch is no End Stop event */
+        if (end_stop_level(end_stop_gpio(end_stop >> 1, end_stop & 1))) return;
+    }
+    const uint32_t now = xthal_get_ccount();
+    const TickType_t tick = xTaskGetTickCountFromISR();
 
-    /*  create motor control task again */
-    motor_control_task_init();
+    const bool bounce = (now - state->last_edge) < DEBOUNCE_CYCLES
+        && (tick - state->last_tick) <= DEBOUNCE_TICKS;
+    state->last_edge = now;
+    state->last_tick = tick;
+    if (bounce)
+    {
+        ++state->stats.filtered;
+        return;
+    }
+    interrupt_task_end_stop_from_isr(end_stop >> 1, end_stop & 1);
+}
 
-    return ESP_OK;
+/**@brief copy the edge counters of a end stop
+ */
+void interrupt_task_get_stats(uint8_t id, bool high_end_stop,
+    end_stop_stats_t *stats)
+{
+    if (id >= ACTUATOR_COUNT)
+    {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    *stats = end_stops[id][high_end_stop].stats;
 }
 
-static void IRAM_ATTR gpio_isr_handler(void* arg)
+/**@brief clear the edge counters of all end stops
+ */
+void interrupt_task_reset_stats(void)
 {
-    uint32_t gpio_num = (uint32_t) arg;
-    xQueueSendFromISR(gpio_evt_queue, &gpio_num, NULL);
+    for (uint8_t id = 0; id < ACTUATOR_COUNT; ++id)
+    {
+        memset(&end_stops[id][0].stats, 0, sizeof(end_stop_stats_t));
+        memset(&end_stops[id][1].stats, 0, sizeof(end_stop_stats_t));
+    }
 }
 
-static void gpio_task(void* arg)
+/**@brief write the edge counters of all end stops as JSON into the buffer
+ * 
+ * @details {"debounce_ms":20,"actuators":[{"high":{"events":1,"filtered":12,
+ * "ignored":0},"low":{...}},...]} returns the length or -1 when the buffer
+ * is too small
+ */
+int interrupt_task_format_stats(char *buffer, int size)
 {
-    uint32_t io_num;
-    for(;;) {
-        if(xQueueReceive(gpio_evt_queue, &io_num, portMAX_DELAY)) {
-            /*  when the interrupt is caused by a End Stop */
-            if (io_num == GPIO_HIGH_END_STOP || io_num == GPIO_LOW_END_STOP)
+    int len = snprintf(buffer, size, "{\"debounce_ms\":%d,\"actuators\":[",
+        CONFIG_END_STOP_DEBOUNCE_MS);
+
+    for (uint8_t id = 0; id < ACTUATOR_COUNT && len < size; ++id)
+    {
+        end_stop_stats_t high;
+        end_stop_stats_t low;
+        interrupt_task_get_stats(id, true, &high);
+        interrupt_task_get_stats(id, false, &low);
+        len += snprintf(buffer + len, size - len,
+            "%s{\"high\":{\"events\":%u,\"filtered\":%u,\"ignored\":%u},"
+            "\"low\":{\"events\":%u,\"filtered\":%u,\"ignored\":%u}}",
+            id ? "," : "",
+            (unsigned)high.events, (unsigned)high.filtered, (unsigned)high.ignored,
+            (unsigned)low.events, (unsigned)low.filtered, (unsigned)low.ignored);
+    }
+    if (len < size) len += snprintf(buffer + len, size - len, "]}");
+    return len < size ? len : -1;
+}
+
+/**@brief use the End Stops to wake up from the light sleep
+ * 
+ * @details each End Stop wakes up on the level it does not have right now,
+ * so a blind resting on a closed switch can still sleep. The edge interrupts
+ * get restored by the first wakeup or when disabled, which has to happen
+ * before a motor moves.
+ */
+void interrupt_task_set_wakeup(bool enabled)
+{
+    portENTER_CRITICAL(&wakeup_mux);
+    if (enabled && !wakeup_armed)
+    {
+        for (uint8_t id = 0; id < ACTUATOR_COUNT; ++id)
+        {
+            for (uint8_t high = 0; high < 2; ++high)
             {
-                /*  set the position to the end stop 
-                *   if it fails it retries each second, since it will not work
-                *   properly with a false current position */
-                while (set_end_stop_position(io_num) != ESP_OK)
-                {
-                    ESP_LOGI(TAG, "Failed to set the right current position");
-                    vTaskDelay(1000 / portTICK_PERIOD_MS);
-                }
+                const gpio_num_t gpio = end_stop_gpio(id, high);
+                gpio_wakeup_enable(gpio, gpio_get_level(gpio)
+                    ? GPIO_INTR_LOW_LEVEL : GPIO_INTR_HIGH_LEVEL);
             }
         }
+        wakeup_armed = true;
+    } else if (!enabled && wakeup_armed) {
+        disarm_wakeup();
     }
+    portEXIT_CRITICAL(&wakeup_mux);
 }
 
 /**@brief Function for initializing the used GPIO Pins
+ * 
+ * @details the motor control task has to be created before, since the
+ * interrupts notify it
  */
 esp_err_t interrupt_task_init(void)
 {
     gpio_config_t io_conf;
+    uint64_t end_stops = 0;
+
+    for (uint8_t id = 0; id < ACTUATOR_COUNT; ++id)
+    {
+        const actuator_pins_t *pins = actuator_get(id)->pins;
+        end_stops |= (1ULL << pins->high_end_stop) | (1ULL << pins->low_end_stop);
+    }
 
     /* SET GPIO CONFIG FOR END STOPS */
     /*  interrupt of rising edge */
     io_conf.intr_type = GPIO_PIN_INTR_NEGEDGE;
     /*  bit mask of the pins */
-    io_conf.pin_bit_mask = GPIO_END_STOPS;
+    io_conf.pin_bit_mask = end_stops;
     /*  set as input mode */ 
     io_conf.mode = GPIO_MODE_INPUT;
     /*  disable pull-down mode */
@@ -127,21 +251,15 @@ esp_err_t interrupt_task_init(void)
     /*  configure GPIO with the given settings */
     gpio_config(&io_conf);
 
-    /*  create a queue to handle gpio event from isr */
-    gpio_evt_queue = xQueueCreate(10, sizeof(uint32_t));
-    /*  start gpio task */
-    xTaskCreate(
-        gpio_task,      /* Task function */
-        "gpio_task",    /* Name of task */
-        2048,           /* Stack size of task */
-        NULL,           /* parameter of the task */
-        10,             /* priority of the task (high is important) */
-        NULL);          /* Task handle to keep track of created Task */
-
     /*  install gpio isr service */
-    gpio_install_isr_service(ESP_INTR_FLAG_DEFAULT);
+    gpio_install_isr_service(ESP_INTR_FLAG_END_STOPS);
     /*  hook isr handlers for specific end stops */
-    gpio_isr_handler_add(GPIO_HIGH_END_STOP, gpio_isr_handler, (void*) GPIO_HIGH_END_STOP);
-    gpio_isr_handler_add(GPIO_LOW_END_STOP, gpio_isr_handler, (void*) GPIO_LOW_END_STOP);
+    for (uint8_t id = 0; id < ACTUATOR_COUNT; ++id)
+    {
+        const actuator_pins_t *pins = actuator_get(id)->pins;
+        gpio_isr_handler_add(pins->high_end_stop, gpio_isr_handler, END_STOP_ARG(id, 1));
+        gpio_isr_handler_add(pins->low_end_stop, gpio_isr_handler, END_STOP_ARG(id, 0));
+    }
+    ESP_LOGI(TAG, "End Stop interrupts installed");
     return ESP_OK;
 }
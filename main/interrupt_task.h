@@ -11,7 +11,20 @@
 extern "C" {
 #endif
 
+/*  edge counters of a single end stop */
+typedef struct {
+    uint32_t events;        /* edges that stopped the motor */
+    uint32_t filtered;      /* bounces within the debounce window */
+    uint32_t ignored;       /* edges while the motor moved away */
+} end_stop_stats_t;
+
 esp_err_t interrupt_task_init(void);
+void interrupt_task_end_stop_from_isr(uint8_t id, bool high_end_stop);
+void interrupt_task_get_stats(uint8_t id, bool high_end_stop,
+    end_stop_stats_t *stats);
+void interrupt_task_reset_stats(void);
+int interrupt_task_format_stats(char *buffer, int size);
+void interrupt_task_set_wakeup(bool enabled);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,255 @@
+/*  Minimal JSON parser that works in place on the received data.
+*   It only scans the data for the requested values, so it does not allocate
+*   any memory and does not require the data to be \0 terminated.
+*/
+#include "json_parser.h"
+
+/*  maximum nesting of objects and arrays that get skipped */
+#define JSON_MAX_DEPTH          16
+
+static void skip_whitespace(json_scanner_t *scanner)
+{
+    while (scanner->pos < scanner->end
+        && (*scanner->pos == ' ' || *scanner->pos == '\t'
+            || *scanner->pos == '\n' || *scanner->pos == '\r'))
+    {
+        ++scanner->pos;
+    }
+}
+
+/**@brief check the next character and consume it when it matches
+ */
+static bool accept(json_scanner_t *scanner, char c)
+{
+    skip_whitespace(scanner);
+    if (scanner->pos < scanner->end && *scanner->pos == c)
+    {
+        ++scanner->pos;
+        return true;
+    }
+    return false;
+}
+
+/**@brief scan a string and return it without the quotes
+ * 
+ * @details escape sequences are skipped but not decoded
+ */
+esp_err_t json_scan_string(json_scanner_t *scanner, const char **str, int *str_len)
+{
+    if (!accept(scanner, '"')) return ESP_ERR_INVALID_ARG;
+
+    const char *start = scanner->pos;
+    while (scanner->pos < scanner->end && *scanner->pos != '"')
+    {
+        /*  skip the escaped character */
+        if (*scanner->pos == '\\') ++scanner->pos;
+        ++scanner->pos;
+    }
+    if (scanner->pos >= scanner->end) return ESP_ERR_INVALID_SIZE;
+
+    *str = start;
+    *str_len = scanner->pos - start;
+    /*  closing quote */
+    ++scanner->pos;
+    return ESP_OK;
+}
+
+/**@brief scan a integer value, a fraction gets truncated
+ */
+esp_err_t json_scan_int(json_scanner_t *scanner, int64_t *value)
+{
+    skip_whitespace(scanner);
+
+    bool negative = false;
+    if (scanner->pos < scanner->end && *scanner->pos == '-')
+    {
+        negative = true;
+        ++scanner->pos;
+    }
+
+    const char *start = scanner->pos;
+    int64_t result = 0;
+    while (scanner->pos < scanner->end
+        && *scanner->pos >= '0' && *scanner->pos <= '9')
+    {
+        /*  values with more than 18 digits would overflow */
+        if (scanner->pos - start >= 18) return ESP_ERR_INVALID_SIZE;
+        result = result * 10 + (*scanner->pos - '0');
+        ++scanner->pos;
+    }
+    if (scanner->pos == start) return ESP_ERR_INVALID_ARG;
+
+    if (scanner->pos < scanner->end && *scanner->pos == '.')
+    {
+        ++scanner->pos;
+        while (scanner->pos < scanner->end
+            && *scanner->pos >= '0' && *scanner->pos <= '9')
+        {
+            ++scanner->pos;
+        }
+    }
+    /*  exponents are not supported */
+    if (scanner->pos < scanner->end
+        && (*scanner->pos == 'e' || *scanner->pos == 'E'))
+    {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    *value = negative ? -result : result;
+    return ESP_OK;
+}
+
+/**@brief skip a complete value including nested objects and arrays
+ */
+static esp_err_t skip_value(json_scanner_t *scanner)
+{
+    int depth = 0;
+    skip_whitespace(scanner);
+
+    do {
+        if (scanner->pos >= scanner->end) return ESP_ERR_INVALID_SIZE;
+
+        const char c = *scanner->pos;
+        if (c == '"')
+        {
+            const char *str;
+            int str_len;
+            esp_err_t error_code = json_scan_string(scanner, &str, &str_len);
+            if (error_code != ESP_OK) return error_code;
+        } else if (c == '{' || c == '[') {
+            if (++depth > JSON_MAX_DEPTH) return ESP_ERR_INVALID_SIZE;
+            ++scanner->pos;
+        } else if (c == '}' || c == ']') {
+            if (--depth < 0) return ESP_ERR_INVALID_ARG;
+            ++scanner->pos;
+        } else {
+            /*  numbers, literals and separators */
+            ++scanner->pos;
+            while (depth == 0 && scanner->pos < scanner->end
+                && *scanner->pos != ',' && *scanner->pos != '}'
+                && *scanner->pos != ']')
+            {
+                ++scanner->pos;
+            }
+        }
+        skip_whitespace(scanner);
+    } while (depth > 0);
+
+    return ESP_OK;
+}
+
+/**@brief search a key in the object the scanner points to
+ * 
+ * @details on success the scanner points to the value of the key
+ */
+static esp_err_t find_key(json_scanner_t *scanner, const char *key, int key_len)
+{
+    if (!accept(scanner, '{')) return ESP_ERR_INVALID_ARG;
+    if (accept(scanner, '}')) return ESP_ERR_NOT_FOUND;
+
+    do {
+        const char *name;
+        int name_len;
+        esp_err_t error_code = json_scan_string(scanner, &name, &name_len);
+        if (error_code != ESP_OK) return error_code;
+        if (!accept(scanner, ':')) return ESP_ERR_INVALID_ARG;
+
+        if (name_len == key_len && strncmp(name, key, key_len) == 0)
+        {
+            skip_whitespace(scanner);
+            return ESP_OK;
+        }
+
+        error_code = skip_value(scanner);
+        if (error_code != ESP_OK) return error_code;
+    } while (accept(scanner, ','));
+
+    return ESP_ERR_NOT_FOUND;
+}
+
+/**@brief search a value by its objectpath e.g. "object/value"
+ * 
+ * @details on success value points to the start of the value
+ */
+esp_err_t json_find(const char *data, int data_len, const char *path,
+    json_scanner_t *value)
+{
+    if (!data || data_len <= 0) return ESP_ERR_INVALID_ARG;
+
+    json_scanner_t scanner = {
+        .pos = data,
+        .end = data + data_len,
+    };
+
+    /*  compare the objectpath one object at a time */
+    while (*path)
+    {
+        const char *separator = strchr(path, '/');
+        const int key_len = separator ? separator - path : (int)strlen(path);
+
+        esp_err_t error_code = find_key(&scanner, path, key_len);
+        if (error_code != ESP_OK) return error_code;
+
+        path += key_len;
+        if (*path == '/') ++path;
+    }
+
+    *value = scanner;
+    return ESP_OK;
+}
+
+/**@brief get the next element of a array
+ * 
+ * @details array has to point to the start of the array and gets moved behind
+ * the element, element only covers the slice of the element. Returns
+ * ESP_ERR_NOT_FOUND after the last element.
+ */
+esp_err_t json_array_next(json_scanner_t *array, json_scanner_t *element)
+{
+    skip_whitespace(array);
+    if (array->pos >= array->end) return ESP_ERR_INVALID_SIZE;
+
+    /*  start of the array, elements always end at ',' or ']' */
+    if (*array->pos == '[')
+    {
+        ++array->pos;
+        if (accept(array, ']')) return ESP_ERR_NOT_FOUND;
+    } else if (*array->pos == ',') {
+        ++array->pos;
+    } else if (*array->pos == ']') {
+        return ESP_ERR_NOT_FOUND;
+    } else {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    skip_whitespace(array);
+    element->pos = array->pos;
+    esp_err_t error_code = skip_value(array);
+    if (error_code != ESP_OK) return error_code;
+    element->end = array->pos;
+    return ESP_OK;
+}
+
+/**@brief get a integer value by its objectpath
+ */
+esp_err_t json_get_int(const char *data, int data_len, const char *path,
+    int64_t *value)
+{
+    json_scanner_t scanner;
+    esp_err_t error_code = json_find(data, data_len, path, &scanner);
+    if (error_code != ESP_OK) return error_code;
+    return json_scan_int(&scanner, value);
+}
+
+/**@brief get a string value by its objectpath
+ * 
+ * @details str points into data, so it is not \0 terminated
+ */
+esp_err_t json_get_string(const char *data, int data_len, const char *path,
+    const char **str, int *str_len)
+{
+    json_scanner_t scanner;
+    esp_err_t error_code = json_find(data, data_len, path, &scanner);
+    if (error_code != ESP_OK) return error_code;
+    return json_scan_string(&scanner, str, str_len);
+}
@@ -0,0 +1,34 @@
+#ifndef __JSON_PARSER__
+#define __JSON_PARSER__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "esp_err.h"
+
+/*  inform c++ compilers that the function should be compiled in C Style */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*  slice of the JSON data that is still to be scanned */
+typedef struct {
+    const char *pos;
+    const char *end;
+} json_scanner_t;
+
+esp_err_t json_find(const char *data, int data_len, const char *path,
+    json_scanner_t *value);
+esp_err_t json_get_int(const char *data, int data_len, const char *path,
+    int64_t *value);
+esp_err_t json_get_string(const char *data, int data_len, const char *path,
+    const char **str, int *str_len);
+esp_err_t json_array_next(json_scanner_t *array, json_scanner_t *element);
+esp_err_t json_scan_int(json_scanner_t *scanner, int64_t *value);
+esp_err_t json_scan_string(json_scanner_t *scanner, const char **str, int *str_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __JSON_PARSER__ */
@@ -0,0 +1,96 @@
+/*  Latency histograms of the command path from the MQTT receive to the
+*   finished move. Each command carries its receive timestamp, so every stage
+*   only costs a subtraction and a few counter updates.
+*/
+#include <stdio.h>
+#include "latency_stats.h"
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+
+static const char *TAG = "LATENCY_STATS";
+
+static const char *stage_names[LATENCY_STAGE_COUNT] = {
+    "parse", "enqueue", "dequeue", "first_step", "complete"
+};
+static latency_histogram_t histograms[LATENCY_STAGE_COUNT];
+static portMUX_TYPE latency_mux = portMUX_INITIALIZER_UNLOCKED;
+
+/**@brief add a latency to the histogram of a stage
+ */
+void latency_stats_add(latency_stage_t stage, uint32_t latency_us)
+{
+    /*  amount of bits of the latency is the index of the bucket */
+    uint8_t bucket = latency_us ? 32 - __builtin_clz(latency_us) : 0;
+    if (bucket >= LATENCY_BUCKETS) bucket = LATENCY_BUCKETS - 1;
+
+    portENTER_CRITICAL(&latency_mux);
+    latency_histogram_t *histogram = &histograms[stage];
+    ++histogram->count;
+    histogram->sum_us += latency_us;
+    if (latency_us > histogram->max_us) histogram->max_us = latency_us;
+    ++histogram->buckets[bucket];
+    portEXIT_CRITICAL(&latency_mux);
+}
+
+/**@brief add the time since start to the histogram of a stage
+ * 
+ * @details start is a timestamp of latency_stats_timestamp, 0 is ignored
+ */
+void latency_stats_record(latency_stage_t stage, uint32_t start)
+{
+    if (!start) return;
+    latency_stats_add(stage, latency_stats_timestamp() - start);
+}
+
+/**@brief get a copy of the histogram of a stage
+ */
+void latency_stats_get(latency_stage_t stage, latency_histogram_t *histogram)
+{
+    portENTER_CRITICAL(&latency_mux);
+    *histogram = histograms[stage];
+    portEXIT_CRITICAL(&latency_mux);
+}
+
+/**@brief clear all histograms
+ */
+void latency_stats_reset(void)
+{
+    portENTER_CRITICAL(&latency_mux);
+    memset(histograms, 0, sizeof(histograms));
+    portEXIT_CRITICAL(&latency_mux);
+    ESP_LOGI(TAG, "Latency statistics reset");
+}
+
+/**@brief write all histograms as JSON into the buffer
+ * 
+ * @details {"unit":"us","parse":{"count":1,"mean":80,"max":80,
+ * "buckets":[0,0,0,0,0,0,0,1]},...} the buckets end with the last used one.
+ * Returns the length or -1 when the buffer is too small.
+ */
+int latency_stats_format(char *buffer, int size)
+{
+    int len = snprintf(buffer, size, "{\"unit\":\"us\"");
+
+    for (uint8_t stage = 0; stage < LATENCY_STAGE_COUNT && len < size; ++stage)
+    {
+        latency_histogram_t histogram;
+        latency_stats_get(stage, &histogram);
+
+        uint8_t used = LATENCY_BUCKETS;
+        while (used > 0 && histogram.buckets[used - 1] == 0) --used;
+
+        len += snprintf(buffer + len, size - len,
+            ",\"%s\":{\"count\":%u,\"mean\":%u,\"max\":%u,\"buckets\":[",
+            stage_names[stage], (unsigned)histogram.count,
+            histogram.count ? (unsigned)(histogram.sum_us / histogram.count) : 0,
+            (unsigned)histogram.max_us);
+        for (uint8_t i = 0; i < used && len < size; ++i)
+        {
+            len += snprintf(buffer + len, size - len, i ? ",%u" : "%u",
+                (unsigned)histogram.buckets[i]);
+        }
+        if (len < size) len += snprintf(buffer + len, size - len, "]}");
+    }
+    if (len < size) len += snprintf(buffer + len, size - len, "}");
+    return len < size ? len : -1;
+}
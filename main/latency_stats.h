@@ -0,0 +1,57 @@
+#ifndef __LATENCY_STATS__
+#define __LATENCY_STATS__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "esp_err.h"
+#include "esp_timer.h"
+
+/*  inform c++ compilers that the function should be compiled in C Style */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*  bucket i counts latencies below 2^i us, the last one all above */
+#define LATENCY_BUCKETS         24
+
+/*  stages of a command, all measured from the MQTT receive */
+typedef enum {
+    LATENCY_PARSE = 0,      /* command parsed */
+    LATENCY_ENQUEUE,        /* command written to the position queue */
+    LATENCY_DEQUEUE,        /* command read by the motor control task */
+    LATENCY_FIRST_STEP,     /* first step generated for the command */
+    LATENCY_COMPLETE,       /* move finished, seen by the motor control task */
+    LATENCY_STAGE_COUNT
+} latency_stage_t;
+
+/*  histogram of a single stage */
+typedef struct {
+    uint32_t count;
+    uint32_t max_us;
+    uint64_t sum_us;
+    uint32_t buckets[LATENCY_BUCKETS];
+} latency_histogram_t;
+
+/**@brief get a timestamp for the latency measurement in us
+ * 
+ * @details wraps after 71 minutes, which is far above any measured latency.
+ * 0 marks commands that are not measured.
+ */
+static inline uint32_t latency_stats_timestamp(void)
+{
+    const uint32_t now = (uint32_t)esp_timer_get_time();
+    return now ? now : 1;
+}
+
+void latency_stats_add(latency_stage_t stage, uint32_t latency_us);
+void latency_stats_record(latency_stage_t stage, uint32_t start);
+void latency_stats_get(latency_stage_t stage, latency_histogram_t *histogram);
+void latency_stats_reset(void);
+int latency_stats_format(char *buffer, int size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LATENCY_STATS__ */
@@ -0,0 +1,112 @@
+/*  Trapezoidal motion planner for the stepper motor.
+*   The step intervals of the acceleration ramp are calculated once at boot,
+*   so each step only needs a table lookup inside the timer interrupt.
+*/
+#include <math.h>
+#include "motion_planner.h"
+#include "esp_log.h"
+#include "esp_attr.h"
+
+#define RAMP_TABLE_SIZE         1024 /* maximum steps of the acceleration ramp */
+#define RAMP_INTERVAL_MAX       UINT16_MAX
+
+static const char *TAG = "MOTION_PLANNER";
+
+/*  interval in us between two steps for each step of the ramp */
+static uint16_t ramp_table[RAMP_TABLE_SIZE];
+static uint16_t ramp_length;
+
+/**@brief prepare the planner for a move from standstill
+ */
+void motion_planner_start(motion_planner_t *planner, uint16_t max_index)
+{
+    planner->ramp_index = 0;
+    planner->max_index = max_index;
+}
+
+/**@brief get the ramp index of the cruise speed for a speed in steps/s
+ * 
+ * @details 0 or a speed above the max speed returns the end of the ramp
+ */
+uint16_t motion_planner_speed_index(uint32_t speed)
+{
+    if (speed == 0) return ramp_length - 1;
+
+    const uint32_t interval = 1000000 / speed;
+    /*  intervals are descending, so search the last one above the interval */
+    uint16_t low = 0;
+    uint16_t high = ramp_length - 1;
+    while (low < high)
+    {
+        const uint16_t mid = (low + high + 1) / 2;
+        if (ramp_table[mid] >= interval)
+        {
+            low = mid;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return low;
+}
+
+/**@brief called after each step to get the time until the next step
+ * 
+ * @details distance is the amount of steps left to the target in the current
+ * direction and negative when the target is behind the motor. The motor
+ * accelerates until the cruise speed is reached and decelerates as soon as
+ * the remaining steps are needed to stop or the cruise speed got lowered.
+ */
+uint32_t IRAM_ATTR motion_planner_step(motion_planner_t *planner, int32_t distance)
+{
+    if (distance <= planner->ramp_index
+        || planner->ramp_index > planner->max_index)
+    {
+        if (planner->ramp_index > 0) --planner->ramp_index;
+    } else if (planner->ramp_index < planner->max_index) {
+        ++planner->ramp_index;
+    }
+    return ramp_table[planner->ramp_index];
+}
+
+/**@brief get the time of a full step at the current speed
+ */
+uint32_t IRAM_ATTR motion_planner_interval(const motion_planner_t *planner)
+{
+    return ramp_table[planner->ramp_index];
+}
+
+/**@brief Function for initializing the acceleration ramp
+ * 
+ * @details step n is reached after t(n) = sqrt(2 * n / a), so the interval
+ * of step n is t(n+1) - t(n). The ramp ends when the max speed is reached.
+ */
+esp_err_t motion_planner_init(void)
+{
+    const double acceleration = CONFIG_STEPPER_ACCELERATION;
+    const double cruise_interval = 1000000.0 / CONFIG_STEPPER_MAX_SPEED;
+
+    ramp_length = 0;
+    double last_time = 0;
+    while (ramp_length < RAMP_TABLE_SIZE)
+    {
+        const double time = sqrt(2.0 * (ramp_length + 1) / acceleration) * 1000000;
+        double interval = time - last_time;
+        last_time = time;
+
+        if (interval <= cruise_interval) break;
+        if (interval > RAMP_INTERVAL_MAX) interval = RAMP_INTERVAL_MAX;
+        ramp_table[ramp_length++] = (uint16_t)interval;
+    }
+
+    /*  last entry is the cruise speed */
+    if (ramp_length == RAMP_TABLE_SIZE)
+    {
+        ESP_LOGW(TAG, "Ramp table too small, max speed is limited to %d steps/s",
+            (int)(1000000 / ramp_table[ramp_length - 1]));
+    } else {
+        ramp_table[ramp_length++] = (uint16_t)cruise_interval;
+    }
+
+    ESP_LOGI(TAG, "Acceleration ramp with %d steps calculated", ramp_length);
+    return ESP_OK;
+}
@@ -0,0 +1,30 @@
+#ifndef __MOTION_PLANNER__
+#define __MOTION_PLANNER__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "esp_err.h"
+
+/*  inform c++ compilers that the function should be compiled in C Style */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*  speed state of the motor on the acceleration ramp */
+typedef struct {
+    uint16_t ramp_index;    /* current speed as position on the ramp */
+    uint16_t max_index;     /* ramp index of the cruise speed */
+} motion_planner_t;
+
+esp_err_t motion_planner_init(void);
+void motion_planner_start(motion_planner_t *planner, uint16_t max_index);
+uint16_t motion_planner_speed_index(uint32_t speed);
+uint32_t motion_planner_step(motion_planner_t *planner, int32_t distance);
+uint32_t motion_planner_interval(const motion_planner_t *planner);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __MOTION_PLANNER__ */
@@ -1,126 +1,318 @@
 /*  Example Configuration for the steppermotor driver DRV8825
 */
-#include <math.h>
 #include "motor_control_task.h"
 #include "position_queue.h"
+#include "step_generator.h"
+#include "position_state.h"
+#include "telemetry_task.h"
+#include "latency_stats.h"
+#include "calibration.h"
+#include "actuator.h"
+#include "power_manager.h"
+#include "stall_detection.h"
 #include "esp_log.h"
-#include "nvs_flash.h"
-#include "nvs.h"
+#include "esp_timer.h"
 #include "driver/gpio.h"
 
-/* STEPPER DEFINITIONS */
-#define STEPPER_COUNT           2000 /* steps needed to open blinds from 0-100% */
-#define STEPPER_DELAY           20   /* Minimum delay required between steps */
-#define GPIO_STEPPER_ENABLE     21    /* enable stepper driver */
-#define GPIO_STEPPER_DIR        22    /* set direction for the stepper */
-#define GPIO_STEPPER_STEP       23    /* Pin that triggers steps */
-#define GPIO_STEPPER_PINS  ((1ULL<<GPIO_STEPPER_ENABLE) \
-    | (1ULL<<GPIO_STEPPER_DIR) | (1ULL<<GPIO_STEPPER_STEP))
+#define MOTOR_SEGMENT_MS        10   /* queue check interval while moving */
+#define DRIVER_ENABLE_LEVEL     1    /* level of the enable pin to energize */
+#define DRIVER_HOLD_TICKS       (CONFIG_STEPPER_HOLD_MS / portTICK_PERIOD_MS + 1)
+
+#if CONFIG_STEPPER_IDLE_DISABLE == 1
+    #define DRIVER_IDLE_DISABLE true
+#else
+    #define DRIVER_IDLE_DISABLE false
+#endif
 
 static const char *TAG = "MOTOR_CONTROL_TASK";
 TaskHandle_t motor_control_handle = NULL;
+/*  actuators that should start a calibration */
+static uint32_t calibrate_mask = 0;
+static portMUX_TYPE calibrate_mux = portMUX_INITIALIZER_UNLOCKED;
 
-static esp_err_t set_new_position(uint8_t new_position)
+/**@brief energize or release the driver of a actuator
+ */
+static void set_driver(actuator_t *actuator, bool enabled)
 {
-    nvs_handle task_nvs_handle;
-    esp_err_t error_code;
+    if (actuator->driver_enabled == enabled) return;
+    gpio_set_level(actuator->pins->enable,
+        enabled ? DRIVER_ENABLE_LEVEL : !DRIVER_ENABLE_LEVEL);
+    actuator->driver_enabled = enabled;
+}
 
-    /*  open NVS flash */
-    ESP_LOGI(TAG, "Opening NVS handle");
-    error_code = nvs_open("position", NVS_READWRITE, &task_nvs_handle);
-    if (error_code != ESP_OK) return error_code;
-    ESP_LOGI(TAG, "NVS storage partition opened");
+/**@brief prepare a actuator for a move
+ * 
+ * @details has to be called before the move gets handed over to the step
+ * generator, so the driver and the step timer are ready for the first step
+ */
+static void wake_actuator(actuator_t *actuator)
+{
+    actuator->woke = motor_control_is_idle();
+    power_manager_set_active(true);
+    position_state_hold(true);
+    set_driver(actuator, true);
+}
+
+/**@brief release the drivers of the actuators that stood still for the
+ * holding time
+ * 
+ * @details returns the ticks until the next driver gets released
+ */
+static TickType_t release_drivers(void)
+{
+    TickType_t timeout = portMAX_DELAY;
+    if (!DRIVER_IDLE_DISABLE) return timeout;
 
-    /*  Read old position from NVS
-    *   old position defaults to 0 if not set in NVS */
-    uint8_t old_position = 0;
-    error_code = nvs_get_u8(task_nvs_handle, "old_position", &old_position);
-    /*  value can´t be found on first run -> ESP_ERR_NVS_NOT_FOUND */
-    if (error_code == ESP_OK)
+    const TickType_t now = xTaskGetTickCount();
+    for (uint8_t id = 0; id < ACTUATOR_COUNT; ++id)
     {
-        ESP_LOGI(TAG, "NVS old position was %d", old_position);
-    }else if (error_code == ESP_ERR_NVS_NOT_FOUND)
+        actuator_t *actuator = actuator_get(id);
+        if (!actuator->driver_enabled || actuator->moving) continue;
+
+        const TickType_t elapsed = now - actuator->stopped_tick;
+        if (elapsed >= DRIVER_HOLD_TICKS)
+        {
+            set_driver(actuator, false);
+        } else if (DRIVER_HOLD_TICKS - elapsed < timeout) {
+            timeout = DRIVER_HOLD_TICKS - elapsed;
+        }
+    }
+    return timeout;
+}
+
+/**@brief correct the position after a end stop was reached
+ * 
+ * @details the step generator already got stopped by the interrupt, so the
+ * motor stands still and the position can be overwritten
+ */
+static void handle_end_stop(actuator_t *actuator, bool high_end_stop)
+{
+    const int32_t end_position = high_end_stop ? actuator->travel : 0;
+
+    /*  the interrupt might get triggered more than once */
+    if (step_generator_get_position(&actuator->channel) != end_position)
     {
-        ESP_LOGI(TAG, "Value it not initialized yet");
-    }else{
-        return error_code;
+        ESP_LOGI(TAG, "End Stop of actuator %d reached: Correcting the current position to: %d",
+            actuator->id, high_end_stop ? 100 : 0);
+        step_generator_set_position(&actuator->channel, end_position);
+        stall_detection_sync(actuator);
+        position_state_update(actuator->id, end_position);
+        telemetry_task_notify(1UL << actuator->id);
     }
 
-    /* Calculate how many Steps are needed */
-    int32_t movement = round((new_position - old_position) * (STEPPER_COUNT/100));
-    /* set direction for the stepper */
-    if (movement > 0)
+    /*  continue an interrupted move from the corrected position */
+    if (actuator->moving)
     {
-        gpio_set_level(GPIO_STEPPER_DIR, 1);
-    }else if (movement < 0){
-        gpio_set_level(GPIO_STEPPER_DIR, 0);
-        movement*=-1;
+        step_generator_set_target(&actuator->channel,
+            actuator_percent_to_steps(actuator, actuator->command.position),
+            actuator->command.speed, step_generator_start_time());
     }
+}
 
-    /*  Move to new position */
-    for (int32_t steps = 0; steps < movement; ++steps )
+/**@brief get the step generator time of a command
+ * 
+ * @details commands with a synchronized start are scheduled for their start
+ * time, all others and late ones use the start time of the cycle
+ */
+static uint64_t command_start_time(const position_command_t *command,
+    uint64_t start_time)
+{
+    if (!command->start_time) return start_time;
+
+    const int64_t delay = command->start_time - esp_timer_get_time();
+    if (delay <= 0)
     {
-        gpio_set_level(GPIO_STEPPER_STEP, 1);
-        vTaskDelay(STEPPER_DELAY / portTICK_PERIOD_MS);
-        gpio_set_level(GPIO_STEPPER_STEP, 0);
-        vTaskDelay(STEPPER_DELAY / portTICK_PERIOD_MS);
+        ESP_LOGI(TAG, "Start time passed %d ms ago", (int)(-delay / 1000));
+        return start_time;
     }
+    return step_generator_delayed_start_time((uint32_t)delay);
+}
 
-    /*  Write new position to NVS */
-    ESP_LOGI(TAG, "save new position in Non Volatile Storage");
-    error_code = nvs_set_u8(task_nvs_handle, "old_position", new_position);
-    if (error_code != ESP_OK) return error_code;
+/**@brief hand over a new position of a actuator to the step generator
+ * 
+ * @details all actuators that receive a position in the same cycle get the
+ * same start time, so they start together. A running move changes its
+ * target right away, even when the command has a later start time.
+ */
+static void receive_command(actuator_t *actuator, uint64_t start_time)
+{
+    /*  a new position waits in the queue until the calibration is done */
+    if (actuator->calibration != CALIBRATION_IDLE) return;
 
-    /*  Commit written value.
-    *   After setting any values, nvs_commit() must be called to ensure changes are written
-    *   to flash storage. */
-    ESP_LOGI(TAG, "Commit changes to Non Volatile Storage");
-    error_code = nvs_commit(task_nvs_handle);
-    if (error_code != ESP_OK) return error_code;
+    if (position_queue_receive(actuator->id, &actuator->command))
+    {
+        ESP_LOGI(TAG, "Received a new value for actuator %d from the queue: %d",
+            actuator->id, (int)actuator->command.position);
+        latency_stats_record(LATENCY_DEQUEUE, actuator->command.received_time);
+        wake_actuator(actuator);
+        stall_detection_start(actuator);
+        step_generator_set_target(&actuator->channel,
+            actuator_percent_to_steps(actuator, actuator->command.position),
+            actuator->command.speed,
+            command_start_time(&actuator->command, start_time));
+        actuator->first_step_pending = actuator->channel.first_step_pending;
+        actuator->moving = true;
+        telemetry_task_notify(1UL << actuator->id);
+    }
+}
 
-    /*  Close NVS */
-    ESP_LOGI(TAG, "Close Non Volatile Storage");
-    nvs_close(task_nvs_handle);
-    return ESP_OK;
+/**@brief start the calibration of the requested actuators
+ */
+static void start_calibrations(void)
+{
+    portENTER_CRITICAL(&calibrate_mux);
+    const uint32_t id_mask = calibrate_mask;
+    calibrate_mask = 0;
+    portEXIT_CRITICAL(&calibrate_mux);
+
+    for (uint8_t id = 0; id < ACTUATOR_COUNT; ++id)
+    {
+        actuator_t *actuator = actuator_get(id);
+        if (!(id_mask & (1UL << id))
+            || actuator->calibration != CALIBRATION_IDLE)
+        {
+            continue;
+        }
+        /*  the command is not measured, it only gets resumed afterwards */
+        actuator->command.received_time = 0;
+        actuator->first_step_pending = false;
+        wake_actuator(actuator);
+        actuator->moving = true;
+        calibration_start(actuator);
+        telemetry_task_notify(1UL << id);
+    }
+}
+
+/**@brief advance a running calibration of a actuator
+ * 
+ * @details after the calibration the actuator moves back to the position
+ * of its last command
+ */
+static void update_calibration(actuator_t *actuator, uint32_t notification)
+{
+    if (!calibration_update(actuator, notification)) return;
+
+    /*  the calibration moved the position, the retries start over */
+    stall_detection_sync(actuator);
+    stall_detection_start(actuator);
+    const int32_t position = step_generator_get_position(&actuator->channel);
+    position_state_update(actuator->id, position);
+    step_generator_set_target(&actuator->channel,
+        actuator_percent_to_steps(actuator, actuator->command.position),
+        actuator->command.speed, step_generator_start_time());
+    telemetry_task_notify(1UL << actuator->id);
+}
+
+/**@brief handle the end stops and finished moves of a single actuator
+ */
+static void update_actuator(actuator_t *actuator, uint32_t notification)
+{
+    if (actuator->calibration != CALIBRATION_IDLE)
+    {
+        update_calibration(actuator, notification);
+        return;
+    }
+
+    if (notification & MOTOR_NOTIFY_HIGH_END_STOP(actuator->id))
+    {
+        handle_end_stop(actuator, true);
+    }
+    if (notification & MOTOR_NOTIFY_LOW_END_STOP(actuator->id))
+    {
+        handle_end_stop(actuator, false);
+    }
+
+    /*  the step generator only stores the time of the first step */
+    if (actuator->first_step_pending && !actuator->channel.first_step_pending)
+    {
+        actuator->first_step_pending = false;
+        if (actuator->command.received_time)
+        {
+            const uint32_t latency = actuator->channel.first_step_time
+                - actuator->command.received_time;
+            latency_stats_add(LATENCY_FIRST_STEP, latency);
+            /*  includes the wakeup from the light sleep */
+            if (actuator->woke) power_manager_add_wake_latency(latency);
+        }
+    }
+
+    /*  stalls and lost steps restart the move from the measured position */
+    if (actuator->moving && stall_detection_update(actuator)) return;
+
+    /*  update the position state once the move is finished, it gets
+    *   written to the flash after the motor stood still for a while */
+    if (actuator->moving && !step_generator_is_running(&actuator->channel))
+    {
+        actuator->moving = false;
+        actuator->stopped_tick = xTaskGetTickCount();
+        latency_stats_record(LATENCY_COMPLETE, actuator->command.received_time);
+        position_state_update(actuator->id,
+            step_generator_get_position(&actuator->channel));
+        telemetry_task_notify(1UL << actuator->id);
+    }
 }
 
-/**@brief Task that reads the new position from the queue an adjusts the blind
- * position
+/**@brief Task that reads the new positions from the queues an adjusts the
+ * blind positions
+ * 
+ * @details the steps are generated by the step generator, so a single task
+ * handles all actuators and only hands over new targets. The task gets
+ * notified about new positions and end stops, while a motor is moving it
+ * also wakes up every segment to check whether the move is finished.
+ * Otherwise it only wakes up to release the drivers after the holding time,
+ * so the module can sleep while the motors stand still.
  */
 static void motor_control_task(void *arg)
 {
     ESP_LOGI(TAG, "Start Motor Control Task");
-    /* activate stepper driver so it does not move */
-    gpio_set_level(GPIO_STEPPER_ENABLE, 1);
-
-    uint8_t new_position;
+    TickType_t idle_timeout = portMAX_DELAY;
 
     for(;;)
     {
-        /*  if a message could be received from the queue within 10 sek */
-        if (xQueueReceive(position_queue, &new_position,
-            10000/portTICK_RATE_MS) == pdTRUE)
+        bool moving = false;
+        for (uint8_t id = 0; id < ACTUATOR_COUNT; ++id)
+        {
+            moving |= actuator_get(id)->moving;
+        }
+
+        const TickType_t timeout = moving
+            ? MOTOR_SEGMENT_MS / portTICK_PERIOD_MS : idle_timeout;
+        uint32_t notification = 0;
+        xTaskNotifyWait(0, UINT32_MAX, &notification, timeout);
+
+        if (notification & MOTOR_NOTIFY_CALIBRATE)
+        {
+            start_calibrations();
+        }
+
+        /*  read all queues at once, so a batch gets applied completely */
+        position_queue_lock();
+        const uint64_t start_time = step_generator_start_time();
+        for (uint8_t id = 0; id < ACTUATOR_COUNT; ++id)
         {
-            ESP_LOGI(TAG, "Received a new value from the queue: %d",
-                (int)new_position);
-            esp_err_t error_code = set_new_position(new_position);
-            if (error_code != ESP_OK)
-            {
-                ESP_LOGI(TAG, "ERROR: %d", error_code);
-            }
+            receive_command(actuator_get(id), start_time);
         }
+        position_queue_unlock();
 
-        /*  pause the task for 1sek, so a other task could be started if required */
-        vTaskDelay(1000 / portTICK_PERIOD_MS);
+        for (uint8_t id = 0; id < ACTUATOR_COUNT; ++id)
+        {
+            update_actuator(actuator_get(id), notification);
+        }
+
+        idle_timeout = release_drivers();
+        const bool idle = motor_control_is_idle();
+        power_manager_set_active(!idle);
+        position_state_hold(!idle);
     }
 }
 
-/**@brief Function for initializing the Output Pins
- * for the stepper driver
+/**@brief Function for initializing the Output Pins and the step generator
+ * channel of a actuator
  */
-static void task_gpio_init(void)
+static esp_err_t actuator_gpio_init(actuator_t *actuator)
 {
     gpio_config_t io_conf;
+    const actuator_pins_t *pins = actuator->pins;
 
     /* SET GPIO CONFIG FOR STEPPER PINS */
     /*  disable interrupt */
@@ -128,27 +320,159 @@ static void task_gpio_init(void)
     /*  set as output mode */
     io_conf.mode = GPIO_MODE_OUTPUT;
     /*  bit mask of the pins */
-    io_conf.pin_bit_mask = GPIO_STEPPER_PINS;
+    io_conf.pin_bit_mask = (1ULL << pins->enable) | (1ULL << pins->dir)
+        | (1ULL << pins->step);
+    for (uint8_t i = 0; i < STEP_GENERATOR_MODE_PINS; ++i)
+    {
+        if (pins->mode[i] != STEP_GENERATOR_PIN_UNUSED)
+        {
+            io_conf.pin_bit_mask |= 1ULL << pins->mode[i];
+        }
+    }
     /*  disable pull-down mode */
     io_conf.pull_down_en = 0;
     /*  disable pull-up mode */
     io_conf.pull_up_en = 0;
     /*  configure GPIO with the given settings */
     gpio_config(&io_conf);
+
+    /*  the driver only gets energized for moves, unless it has to hold
+    *   the blind */
+    gpio_set_level(pins->enable, !DRIVER_ENABLE_LEVEL);
+    actuator->driver_enabled = false;
+    if (!DRIVER_IDLE_DISABLE) set_driver(actuator, true);
+
+    esp_err_t error_code = step_generator_add_channel(&actuator->channel,
+        pins->step, pins->dir);
+    if (error_code != ESP_OK) return error_code;
+    error_code = step_generator_set_mode_pins(&actuator->channel, pins->mode);
+    if (error_code != ESP_OK) return error_code;
+
+    /*  the microsteps set at runtime replace the configured ones */
+    uint8_t coarse = CONFIG_STEPPER_COARSE_MICROSTEPS;
+    uint8_t fine = CONFIG_STEPPER_MICROSTEPS;
+    position_state_get_microsteps(actuator->id, &coarse, &fine);
+    if (step_generator_set_microsteps(&actuator->channel, coarse, fine) != ESP_OK)
+    {
+        ESP_LOGI(TAG, "Actuator %d can not use %d/%d microsteps, using full steps",
+            actuator->id, coarse, fine);
+    }
+
+    /*  position and travel are loaded from the flash once at boot */
+    const int32_t travel = position_state_get_travel(actuator->id);
+    if (travel > 0) actuator->travel = travel;
+    const int32_t position = position_state_get(actuator->id);
+    step_generator_set_position(&actuator->channel, position);
+    actuator->command.position = actuator_steps_to_percent(actuator, position);
+    return stall_detection_init(actuator);
+}
+
+/**@brief check whether all motors stand still
+ */
+bool motor_control_is_idle(void)
+{
+    for (uint8_t id = 0; id < ACTUATOR_COUNT; ++id)
+    {
+        if (actuator_get(id)->moving) return false;
+    }
+    return true;
+}
+
+/**@brief block until all motors stand still, e.g. before flash writes
+ * 
+ * @details a move can start right after it returned. During flash writes
+ * only the IRAM interrupts keep running: the steps continue and a End Stop
+ * still stops its motor, but the motor control task can not correct the
+ * position or continue the move until the write is done.
+ */
+void motor_control_wait_idle(void)
+{
+    while (!motor_control_is_idle())
+    {
+        vTaskDelay(MOTOR_SEGMENT_MS / portTICK_PERIOD_MS);
+    }
+}
+
+/**@brief request the calibration of the travel of actuators
+ * 
+ * @details id_mask contains a bit for each actuator, the calibration runs
+ * in the motor control task. New positions are applied afterwards.
+ */
+esp_err_t motor_control_calibrate(uint32_t id_mask)
+{
+    id_mask &= (1UL << ACTUATOR_COUNT) - 1;
+    if (!id_mask || motor_control_handle == NULL) return ESP_ERR_INVALID_ARG;
+
+    portENTER_CRITICAL(&calibrate_mux);
+    calibrate_mask |= id_mask;
+    portEXIT_CRITICAL(&calibrate_mux);
+    xTaskNotify(motor_control_handle, MOTOR_NOTIFY_CALIBRATE, eSetBits);
+    return ESP_OK;
+}
+
+/**@brief request the calibration of all actuators without a measured travel
+ * 
+ * @details the End Stop interrupts have to be installed before
+ */
+esp_err_t motor_control_calibrate_uncalibrated(void)
+{
+    uint32_t id_mask = 0;
+    for (uint8_t id = 0; id < ACTUATOR_COUNT; ++id)
+    {
+        if (position_state_get_travel(id) <= 0) id_mask |= 1UL << id;
+    }
+    if (!id_mask) return ESP_OK;
+    return motor_control_calibrate(id_mask);
+}
+
+/**@brief set the microsteps per full step of actuators
+ * 
+ * @details id_mask contains a bit for each actuator. The setting is saved
+ * and applies to running moves from the next suitable step on.
+ */
+esp_err_t motor_control_set_microsteps(uint32_t id_mask, uint8_t coarse,
+    uint8_t fine)
+{
+    id_mask &= (1UL << ACTUATOR_COUNT) - 1;
+    if (!id_mask) return ESP_ERR_INVALID_ARG;
+
+    for (uint8_t id = 0; id < ACTUATOR_COUNT; ++id)
+    {
+        if (!(id_mask & (1UL << id))) continue;
+
+        esp_err_t error_code = step_generator_set_microsteps(
+            &actuator_get(id)->channel, coarse, fine);
+        if (error_code == ESP_OK)
+        {
+            error_code = position_state_set_microsteps(id, coarse, fine);
+        }
+        if (error_code != ESP_OK) return error_code;
+        ESP_LOGI(TAG, "Actuator %d uses %d/%d microsteps", id, coarse, fine);
+    }
+    return ESP_OK;
 }
 
 /**@brief Function for initializing the Task of the motor control
  */
 esp_err_t motor_control_task_init(void)
 {
+    /*  steps are generated by the hardware timer */
+    esp_err_t error_code = step_generator_init();
+    if (error_code != ESP_OK) return error_code;
+
+    for (uint8_t id = 0; id < ACTUATOR_COUNT; ++id)
+    {
+        error_code = actuator_gpio_init(actuator_get(id));
+        if (error_code != ESP_OK) return error_code;
+    }
+
     xTaskCreate(
         motor_control_task,     /* Task function */
         "MOTOR_CONTROL",        /* Name of task */
-        2048,                   /* Stack size of task */
+        MOTOR_CONTROL_STACK_SIZE,   /* Stack size of task */
         NULL,                   /* parameter of the task */
         4,                      /* priority of the task (high is important) */
         &motor_control_handle);   /* Task handle to keep track of created Task */
 
-    task_gpio_init();
     return ESP_OK;
 }
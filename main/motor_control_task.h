@@ -9,17 +9,46 @@
 #include "freertos/semphr.h"
 #include "freertos/queue.h"
 #include "esp_err.h"
+#include "step_generator.h"
 
 /*  inform c++ compilers that the function should be compiled in C Style */
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-/*  Make position queue extern so the task can be killed when a End Stop 
-*   causes an interrupt */
+/*  full steps needed to open blinds from 0-100% until the actuator got
+*   calibrated, older firmware versions always used it */
+#define STEPPER_COUNT           2000
+/*  positions are kept in 1/32 steps */
+#define STEPPER_UNITS           (STEPPER_COUNT * STEP_GENERATOR_UNITS_PER_STEP)
+#define STEPS_PER_PERCENT       (STEPPER_UNITS / 100)
+
+/*  stack of the motor control task in bytes. host/test/test_stack.c
+*   measures 2120 bytes with the debug messages enabled, 1680 of them are
+*   the formatting of a ESP_LOGI. The rest leaves room for the larger frames
+*   of the target, stack_free of the benchmark shows the value there. The
+*   test fails when less than 512 bytes stay free */
+#define MOTOR_CONTROL_STACK_SIZE 3072
+
+/*  notification bits that wake up the motor control task, the End Stop
+*   bits exist once per actuator */
+#define MOTOR_NOTIFY_POSITION           BIT0    /* new position in a queue */
+#define MOTOR_NOTIFY_HIGH_END_STOP(id)  (1UL << (1 + 2 * (id))) /* 100% reached */
+#define MOTOR_NOTIFY_LOW_END_STOP(id)   (1UL << (2 + 2 * (id))) /* 0% reached */
+#define MOTOR_NOTIFY_WAKEUP             BIT30   /* End Stop woke the module */
+#define MOTOR_NOTIFY_CALIBRATE          BIT31   /* calibration requested */
+
+/*  Make the task handle extern so other tasks and the End Stop interrupt
+*   can notify the task */
 extern TaskHandle_t motor_control_handle;
 
 esp_err_t motor_control_task_init(void);
+esp_err_t motor_control_calibrate(uint32_t id_mask);
+esp_err_t motor_control_calibrate_uncalibrated(void);
+esp_err_t motor_control_set_microsteps(uint32_t id_mask, uint8_t coarse,
+    uint8_t fine);
+bool motor_control_is_idle(void);
+void motor_control_wait_idle(void);
 
 #ifdef __cplusplus
 }
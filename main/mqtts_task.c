@@ -1,94 +1,52 @@
 #include "mqtts_task.h"
-#include "position_queue.h"
+#include "command_handler.h"
+#include "telemetry_task.h"
+#include "latency_stats.h"
+#include "boot_timing.h"
 #include "mqtt_client.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
 #include "freertos/queue.h"
 #include "esp_log.h"
-#include "cJSON.h"
+#include "esp_system.h"
+#include "position_queue.h"
 
 #define MQTT_TOPIC "blindcontrol/#"
-#define MQTT_BLINDS_TOPIC "blindcontrol"
+#define CLIENT_ID_SIZE 24
 
 static const char *TAG = "MQTTS_TASK";
+static esp_mqtt_client_handle_t mqtt_client = NULL;
+static volatile bool mqtt_connected = false;
+/*  the broker keeps the session and the missed commands of this id */
+static char client_id[CLIENT_ID_SIZE];
 
 /*  mqtt tls certificate */
 extern const char tls_cert_pem_start[]   asm("_binary_mqtt_tls_cert_pem_start");
 extern const char tls_cert_pem_end[]   asm("_binary_mqtt_tls_cert_pem_end");
 
 
-/**@brief get a value from JSON strings
- */
-static esp_err_t json_find_uint8(const cJSON* item, char* str, uint8_t* value)
-{
-    /*  return with error when there is no JSON content */
-    esp_err_t error_code = ESP_FAIL;
-    if (!item) return error_code;
-
-    cJSON *subitem = item->child;
-
-    /*  split objectpath so the objectnames can be compared */
-    char* token = strtok_r(str, "/", &str);
-
-    /*  while there are objects to compare */
-    while (subitem)
-    {
-        /*  when the object is wrong the next object gets compared
-        * strlen can be used since strings from strtok_r are always
-        * \0 terminated*/
-        if(strncmp(subitem->string, token, strlen(token)))
-        {
-            subitem = subitem->next;
-        /*  if the object is right the childobjects get compared */
-        }else if (subitem->child && str){
-            subitem = subitem->child;
-            token = strtok_r(str, "/", &str);
-        /*  when the whole objectpath is found and the objects value is a integer */
-        }else if (!str && cJSON_IsNumber(subitem)){
-            const int new_value = subitem->valueint;
-            /*  value for Blinds can only be 0-100% */
-            if (new_value <= 100 && new_value >= 0)
-            {
-                *value = (uint8_t)new_value;
-                error_code = ESP_OK;
-            }
-            break;
-        }
-    }
-    return error_code;
-}
-
 /**@brief Callback function when new MQTT data is avaible
  * 
- * @details calls json_find_uint8 to get the new position for the blinds and
- * controls a Relay according to the new position
+ * @details hands the received data over to the command handler
  */
 static void received_callback(const esp_mqtt_event_handle_t event)
 {
+    /*  taken before the logs, they take longer than the parsing */
+    const uint32_t received_time = latency_stats_timestamp();
+
     printf("TOPIC=%.*s\r\n", event->topic_len, event->topic);
     printf("DATA=%.*s\r\n", event->data_len, event->data);
 
-    const char *topic = MQTT_BLINDS_TOPIC;
-    /*  strlen can be used since the topic string always \0 terminated */
-    if (strncmp(event->topic, topic, strlen(topic)) == 0)
+    /*  messages larger than the buffer arrive in multiple parts */
+    if (event->data_len != event->total_data_len)
     {
-        uint8_t value;
-        char string[] = "value";
-
-        esp_err_t error_code = json_find_uint8(
-            cJSON_Parse(event->data), string, &value);
-        if (error_code == ESP_OK)
-        {
-            ESP_LOGI(TAG, "writing value: %d to the queue", (int)value);
-
-            /* overwrite the item in the position queue when it´s still
-            in there (motor control was to slow) or add it when the queue
-            is already empty */
-            xQueueOverwrite(position_queue, &value);
-        }else{
-            ESP_LOGI(TAG, "JSON ERROR: %d", error_code);
-        }
+        ESP_LOGI(TAG, "message of %d bytes exceeds the MQTT buffer",
+            event->total_data_len);
+        return;
     }
+
+    command_handler_process(event->topic, event->topic_len,
+        event->data, event->data_len, received_time);
 }
 
 /**@brief Function handles all MQTT events
@@ -102,12 +60,25 @@ static esp_err_t mqtt_event_handler(esp_mqtt_event_handle_t event)
     switch (event->event_id) {
         /*  when connected subscribe to a topic */
         case MQTT_EVENT_CONNECTED:
-            ESP_LOGI(TAG, "MQTT_EVENT_CONNECTED");
-            msg_id = esp_mqtt_client_subscribe(client, MQTT_TOPIC, 0);
+            ESP_LOGI(TAG, "MQTT_EVENT_CONNECTED, session present: %d",
+                event->session_present);
+            /*  the missed commands arrive right after the connect, only the
+            *   newest one of each actuator gets applied */
+            if (CONFIG_MQTT_RESYNC_MS > 0)
+            {
+                position_queue_hold(CONFIG_MQTT_RESYNC_MS);
+            }
+            /*  QoS 1, so the broker queues the commands while offline */
+            msg_id = esp_mqtt_client_subscribe(client, MQTT_TOPIC, 1);
             ESP_LOGI(TAG, "sent subscribe successful, msg_id=%d", msg_id);
+            mqtt_connected = true;
+            boot_timing_mark(BOOT_PHASE_MQTT);
+            /*  refresh the retained states, they might have changed offline */
+            telemetry_task_notify(TELEMETRY_ALL_ACTUATORS);
             break;
         case MQTT_EVENT_DISCONNECTED:
             ESP_LOGI(TAG, "MQTT_EVENT_DISCONNECTED");
+            mqtt_connected = false;
             break;
         case MQTT_EVENT_SUBSCRIBED:
             ESP_LOGI(TAG, "MQTT_EVENT_SUBSCRIBED, msg_id=%d", event->msg_id);
@@ -133,26 +104,66 @@ static esp_err_t mqtt_event_handler(esp_mqtt_event_handle_t event)
     return ESP_OK;
 }
 
+/**@brief publish a message to the broker
+ * 
+ * @details messages are dropped while the client is not connected
+ */
+esp_err_t mqtts_task_publish(const char *topic, const char *data, int len,
+    int qos, bool retain)
+{
+    if (!mqtt_connected) return ESP_ERR_INVALID_STATE;
+
+    const int msg_id = esp_mqtt_client_publish(mqtt_client, topic, data, len,
+        qos, retain);
+    return msg_id < 0 ? ESP_FAIL : ESP_OK;
+}
+
+/**@brief set the client id of the persistent session
+ * 
+ * @details uses the configured id or one derived from the MAC address, so it
+ * stays the same across restarts
+ */
+static void init_client_id(void)
+{
+    if (strlen(CONFIG_MQTT_CLIENT_ID) > 0)
+    {
+        strncpy(client_id, CONFIG_MQTT_CLIENT_ID, CLIENT_ID_SIZE - 1);
+        return;
+    }
+    uint8_t mac[6];
+    esp_read_mac(mac, ESP_MAC_WIFI_STA);
+    snprintf(client_id, CLIENT_ID_SIZE, "blind-%02x%02x%02x%02x%02x%02x",
+        mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+}
+
 /**@brief Function for initializing the MQTTS Connection
  * 
  * @details starts a MQTTS Connection using Username + Password and TLS.
+ * The session is persistent, so commands sent while the module is offline
+ * get delivered after the reconnect.
  */
 esp_err_t mqtts_task_init(void)
 {
+    init_client_id();
+
     /*  set all config parameters */
     const esp_mqtt_client_config_t mqtt_cfg = {
         .host = CONFIG_BROKER_HOST,
         .port = CONFIG_BROKER_PORT,
         .username = CONFIG_BROKER_USERNAME,
         .password = CONFIG_BROKER_PASSWORD,
+        .client_id = client_id,
+        .disable_clean_session = 1,
         .event_handle = mqtt_event_handler,
+        /*  scenes can contain a lot of entries */
+        .buffer_size = CONFIG_MQTT_BUFFER_SIZE,
         /*  tls not activated on the mqtt broker yet */
         //.cert_pem = (const char *)tls_cert_pem_start,
     };
 
     ESP_LOGI(TAG, "[APP] Free memory: %d bytes", esp_get_free_heap_size());
-    esp_mqtt_client_handle_t client = esp_mqtt_client_init(&mqtt_cfg);
-    esp_err_t error_code = esp_mqtt_client_start(client);
+    mqtt_client = esp_mqtt_client_init(&mqtt_cfg);
+    esp_err_t error_code = esp_mqtt_client_start(mqtt_client);
     ESP_LOGI(TAG, "[APP] Error %d", error_code);
     return error_code;
 }
@@ -12,6 +12,8 @@ extern "C" {
 #endif
 
 esp_err_t mqtts_task_init(void);
+esp_err_t mqtts_task_publish(const char *topic, const char *data, int len,
+    int qos, bool retain);
 
 #ifdef __cplusplus
 }
@@ -1,4 +1,6 @@
 #include <string.h>
+#include <strings.h>
+#include <stdlib.h>
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -7,10 +9,15 @@
 #include "esp_system.h"
 #include "esp_log.h"
 #include "esp_http_client.h"
-#include "esp_https_ota.h"
 #include "esp_log.h"
+#include "position_state.h"
+#include "delta_update.h"
+#include "firmware_download.h"
+#include "motor_control_task.h"
 
 #define FIRMWARE_VERSION 0.1
+#define MANIFEST_MIN_SIZE 512
+#define ETAG_SIZE 64
 
 static const char *TAG = "OTA_TASK";
 
@@ -18,8 +25,56 @@ static const char *TAG = "OTA_TASK";
 extern const char server_cert_pem_start[] asm("_binary_ota_tls_cert_pem_start");
 extern const char server_cert_pem_end[] asm("_binary_ota_tls_cert_pem_end");
 
-/*  receive buffer */
-char rcv_buffer[200];
+static TaskHandle_t ota_update_handle = NULL;
+
+/*  update information, grows with the received data and gets freed after
+*   each check */
+static char *manifest = NULL;
+static size_t manifest_len = 0;
+static size_t manifest_size = 0;
+static bool manifest_incomplete = false;
+
+/*  ETag of the last processed update information and of the current one */
+static char etag[ETAG_SIZE];
+static char received_etag[ETAG_SIZE];
+
+/**@brief append received data to the update information
+ * 
+ * @details works for chunked responses as well, since the data is only
+ * collected until the request is finished
+ */
+static void append_manifest(const char *data, int data_len)
+{
+    /*  keep space for the terminating \0 */
+    if (manifest_len + data_len + 1 > manifest_size)
+    {
+        size_t size = manifest_size ? manifest_size : MANIFEST_MIN_SIZE;
+        while (manifest_len + data_len + 1 > size) size *= 2;
+
+        char *buffer = realloc(manifest, size);
+        if (!buffer)
+        {
+            manifest_incomplete = true;
+            return;
+        }
+        manifest = buffer;
+        manifest_size = size;
+    }
+    memcpy(manifest + manifest_len, data, data_len);
+    manifest_len += data_len;
+    manifest[manifest_len] = '\0';
+}
+
+/**@brief free the update information after a check
+ */
+static void free_manifest(void)
+{
+    free(manifest);
+    manifest = NULL;
+    manifest_len = 0;
+    manifest_size = 0;
+    manifest_incomplete = false;
+}
 
 /*  esp_http_client event handler */
 static esp_err_t _http_event_handler(esp_http_client_event_t *evt)
@@ -33,13 +88,15 @@ static esp_err_t _http_event_handler(esp_http_client_event_t *evt)
         case HTTP_EVENT_HEADER_SENT:
             break;
         case HTTP_EVENT_ON_HEADER:
-            break;
-        case HTTP_EVENT_ON_DATA:
-            if (!esp_http_client_is_chunked_response(evt->client))
+            if (strcasecmp(evt->header_key, "ETag") == 0)
             {
-				strncpy(rcv_buffer, (char*)evt->data, evt->data_len);
+                strncpy(received_etag, evt->header_value, ETAG_SIZE - 1);
+                received_etag[ETAG_SIZE - 1] = '\0';
             }
             break;
+        case HTTP_EVENT_ON_DATA:
+            append_manifest((char*)evt->data, evt->data_len);
+            break;
         case HTTP_EVENT_ON_FINISH:
             break;
         case HTTP_EVENT_DISCONNECTED:
@@ -48,11 +105,42 @@ static esp_err_t _http_event_handler(esp_http_client_event_t *evt)
     return ESP_OK;
 }
 
-static esp_err_t parse_update_info(esp_http_client_config_t* ota_client_config)
+/**@brief look for a patch against the running firmware in the update info
+ * 
+ * @details "patches": [{"from": 0.1, "file": "<url>", "sha256": "<hash of
+ * the new image>"}, ...]
+ */
+static esp_err_t parse_patch_info(cJSON *json, delta_update_t *patch)
 {
-    /*  parse the json file */
-	cJSON *json = cJSON_Parse(rcv_buffer);
+    cJSON *patches = cJSON_GetObjectItemCaseSensitive(json, "patches");
+    cJSON *entry;
+
+    cJSON_ArrayForEach(entry, patches)
+    {
+        cJSON *from = cJSON_GetObjectItemCaseSensitive(entry, "from");
+        cJSON *file = cJSON_GetObjectItemCaseSensitive(entry, "file");
+        cJSON *sha256 = cJSON_GetObjectItemCaseSensitive(entry, "sha256");
 
+        if (!cJSON_IsNumber(from) || from->valuedouble != FIRMWARE_VERSION
+            || !cJSON_IsString(file) || !cJSON_IsString(sha256))
+        {
+            continue;
+        }
+        if (delta_update_parse_hash(sha256->valuestring, patch->sha256) != ESP_OK)
+        {
+            ESP_LOGI(TAG, "Invalid hash of the patch");
+            continue;
+        }
+        patch->url = file->valuestring;
+        patch->cert_pem = server_cert_pem_start;
+        return ESP_OK;
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+static esp_err_t parse_update_info(cJSON *json,
+    esp_http_client_config_t* ota_client_config, double *available_version)
+{
     /*  return with error when there is no JSON content */
     esp_err_t error_code = ESP_FAIL;
 	if(!json) return error_code;
@@ -77,6 +165,7 @@ static esp_err_t parse_update_info(esp_http_client_config_t* ota_client_config)
 
 				ota_client_config->url = file->valuestring;
 				ota_client_config->cert_pem = server_cert_pem_start;
+                *available_version = new_version;
 
                 error_code = ESP_OK;
 			}
@@ -87,53 +176,181 @@ static esp_err_t parse_update_info(esp_http_client_config_t* ota_client_config)
 	return error_code;
 }
 
+/**@brief install the update described by the update information
+ * 
+ * @details returns ESP_ERR_NOT_FOUND when the firmware is up to date,
+ * restarts the module after a successful update
+ */
+static esp_err_t install_update(void)
+{
+    /*  the urls point into the json, so it is freed after the update */
+    cJSON *json = cJSON_Parse(manifest);
+    esp_http_client_config_t ota_client_config = { 0 };
+    delta_update_t patch;
+    double new_version = 0;
+
+    esp_err_t error_code = parse_update_info(json, &ota_client_config,
+        &new_version);
+    if (error_code != ESP_OK)
+    {
+        cJSON_Delete(json);
+        return json ? ESP_ERR_NOT_FOUND : ESP_ERR_INVALID_RESPONSE;
+    }
+
+    /*  a patch only contains the changes to the running firmware */
+    error_code = parse_patch_info(json, &patch);
+    if (error_code == ESP_OK)
+    {
+        ESP_LOGI(TAG, "Installing the patch for version %.1f", FIRMWARE_VERSION);
+        error_code = delta_update_apply(&patch);
+        if (error_code != ESP_OK)
+        {
+            ESP_LOGI(TAG, "Patch failed (%d), downloading the full firmware", error_code);
+        }
+    }
+    if (error_code != ESP_OK)
+    {
+        error_code = firmware_download_install(&ota_client_config, new_version);
+    }
+    cJSON_Delete(json);
+
+	if (error_code == ESP_OK)
+    {
+		ESP_LOGI(TAG, "OTA OK, restarting...");
+        /*  let a running move finish and write its position before the restart */
+        motor_control_wait_idle();
+        position_state_flush();
+		esp_restart();
+	} else {
+		ESP_LOGI(TAG, "OTA Failed");
+	}
+    return error_code;
+}
+
+/**@brief download the update information and install a newer firmware
+ * 
+ * @details the request contains the ETag of the last processed update
+ * information, so an unchanged file is answered with 304 and no content
+ */
+static esp_err_t check_for_update(void)
+{
+	ESP_LOGI(TAG, "Getting latest firmware information");
+
+	/*  configure the esp_http_client */
+	esp_http_client_config_t config = {
+        .url = CONFIG_UPDATE_JSON_URL,
+        .event_handler = _http_event_handler,
+        .cert_pem = server_cert_pem_start,
+	};
+	esp_http_client_handle_t client = esp_http_client_init(&config);
+    if (!client) return ESP_ERR_NO_MEM;
+    if (etag[0])
+    {
+        esp_http_client_set_header(client, "If-None-Match", etag);
+    }
+    received_etag[0] = '\0';
+
+	/*  downloading the firmware information */
+	esp_err_t error_code = esp_http_client_perform(client);
+    const int status = esp_http_client_get_status_code(client);
+	/*  cleanup */
+	esp_http_client_cleanup(client);
+
+	if (error_code != ESP_OK || manifest_incomplete
+        || (status != 200 && status != 304))
+    {
+        ESP_LOGI(TAG, "Failed to get the latest firmware information (%d)", status);
+        free_manifest();
+        return error_code != ESP_OK ? error_code : ESP_ERR_INVALID_RESPONSE;
+    }
+
+    if (status == 304)
+    {
+        ESP_LOGI(TAG, "Firmware information did not change");
+        free_manifest();
+        return ESP_OK;
+    }
+
+    error_code = install_update();
+    free_manifest();
+    /*  a failed update gets retried with the next check */
+    if (error_code == ESP_ERR_NOT_FOUND)
+    {
+        strcpy(etag, received_etag);
+        return ESP_OK;
+    }
+    etag[0] = '\0';
+    return error_code;
+}
+
+/**@brief get a random time within the given seconds in ticks
+ */
+static TickType_t random_delay(uint32_t seconds)
+{
+    return (TickType_t)((uint64_t)(esp_random() % (seconds * 1000 + 1))
+        / portTICK_PERIOD_MS);
+}
+
+/**@brief get the delay until the next retry of a interrupted download
+ * 
+ * @details doubles with each failed retry and is randomized between 50%
+ * and 100%, like the WiFi reconnects
+ */
+static TickType_t retry_delay(uint32_t retries)
+{
+    uint32_t delay = CONFIG_OTA_RETRY_MAX_S;
+    if (retries < 16 && ((uint32_t)CONFIG_OTA_RETRY_MIN_S << retries) < delay)
+    {
+        delay = CONFIG_OTA_RETRY_MIN_S << retries;
+    }
+    return (TickType_t)((uint64_t)delay * 1000 / 2 / portTICK_PERIOD_MS)
+        + random_delay(delay / 2);
+}
+
 /**@brief Task that checks for updates and installs them automatically
+ * 
+ * @details checks when the update notification is received over MQTT and
+ * otherwise every CONFIG_OTA_POLL_INTERVAL_S +-25%. The random delays spread
+ * the requests of many modules that got notified or powered on together.
+ * A interrupted download that left a checkpoint is retried after a short
+ * backoff instead, so it resumes within minutes.
  */
 static void ota_update_task(void *args)
 {
-	
+    const uint32_t interval = CONFIG_OTA_POLL_INTERVAL_S;
+    uint32_t retries = 0;
+
+    vTaskDelay(random_delay(CONFIG_OTA_CHECK_JITTER_S));
 	for(;;)
     {
-		ESP_LOGI(TAG, "Getting latest firmware information");
-	
-		/*  configure the esp_http_client */
-		esp_http_client_config_t config = {
-            .url = CONFIG_UPDATE_JSON_URL,
-            .event_handler = _http_event_handler,
-            .cert_pem = server_cert_pem_start,
-		};
-		esp_http_client_handle_t client = esp_http_client_init(&config);
-	
-		/*  downloading the firmware information */
-		esp_err_t error_code = esp_http_client_perform(client);
-		if(error_code == ESP_OK)
+        TickType_t poll_delay;
+        if (check_for_update() != ESP_OK && firmware_download_has_checkpoint())
         {
-            esp_http_client_config_t ota_client_config;
-			error_code = parse_update_info(&ota_client_config);
-            if (error_code == ESP_OK)
-            {
-                error_code = esp_https_ota(&ota_client_config);
-				if (error_code == ESP_OK)
-                {
-					ESP_LOGI(TAG, "OTA OK, restarting...");
-                    // might cause problems to just restart when the position is getting changed at the same time
-                    // should allow motor_control_task to finish first using a event group
-					esp_restart();
-				} else {
-					ESP_LOGI(TAG, "OTA Failed");
-				}
-            }
-		} else {
-            ESP_LOGI(TAG, "Failed to get the latest firmware information");
+            poll_delay = retry_delay(retries++);
+            ESP_LOGI(TAG, "Download interrupted, retrying in %u s",
+                (unsigned)(poll_delay * portTICK_PERIOD_MS / 1000));
+        } else {
+            retries = 0;
+            poll_delay = (TickType_t)((uint64_t)(interval - interval / 4)
+                * 1000 / portTICK_PERIOD_MS) + random_delay(interval / 2);
+        }
+        if (xTaskNotifyWait(0, UINT32_MAX, NULL, poll_delay) == pdTRUE)
+        {
+            ESP_LOGI(TAG, "Update notification received");
+            vTaskDelay(random_delay(CONFIG_OTA_CHECK_JITTER_S));
         }
-
-		/*  cleanup */
-		esp_http_client_cleanup(client);
-        /*  pause task for 30 sec */
-        vTaskDelay(30000 / portTICK_PERIOD_MS);
     }
 }
 
+/**@brief request a update check, e.g. after a new firmware got released
+ */
+esp_err_t ota_update_task_check(void)
+{
+    if (ota_update_handle == NULL) return ESP_ERR_INVALID_STATE;
+    xTaskNotify(ota_update_handle, 1, eSetBits);
+    return ESP_OK;
+}
+
 /**@brief Function for initializing the Task of the over the air updates (ota)
  */
 esp_err_t ota_update_task_init()
@@ -145,8 +362,8 @@ esp_err_t ota_update_task_init()
         "ota_update_task",    /* Name of task */
         8192,                   /* Stack size of task */
         NULL,                   /* parameter of the task */
-        3,                      /* priority of the task (high is important) */
-        NULL);                  /* Task handle to keep track of created Task */
+        1,                      /* priority of the task (high is important) */
+        &ota_update_handle);    /* Task handle to keep track of created Task */
     
     return ESP_OK;
 }
@@ -12,6 +12,7 @@ extern "C" {
 #endif
 
 esp_err_t ota_update_task_init(void);
+esp_err_t ota_update_task_check(void);
 
 #ifdef __cplusplus
 }
@@ -1,16 +1,148 @@
 #include "position_queue.h"
+#include "actuator.h"
+#include "motor_control_task.h"
+#include "latency_stats.h"
 #include "esp_log.h"
 
 static const char *TAG = "POSITION_QUEUE";
-/* queue that handles new positions */
-xQueueHandle position_queue = NULL;
+/*  makes sure the motor control task never sees half of a batch */
+static SemaphoreHandle_t queue_mutex = NULL;
+/*  sequence number of the last accepted command of each actuator */
+static uint32_t last_sequence[ACTUATOR_COUNT];
+/*  commands are collected without handing them over while held */
+static volatile bool held = false;
+static TimerHandle_t hold_timer = NULL;
 
-/**@brief Function for initializing the queue thats used to transmit the new
- * position of the blind between the MQTT task and the motor_control task
+/**@brief check whether a command is newer than the last accepted one
+ * 
+ * @details commands without a sequence number are always accepted,
+ * queue_mutex has to be taken
+ */
+static bool accept_sequence(uint8_t id, uint32_t sequence)
+{
+    if (sequence == 0) return true;
+    /*  the difference handles the overflow of the sequence number */
+    if (last_sequence[id] && (int32_t)(sequence - last_sequence[id]) <= 0)
+    {
+        ESP_LOGI(TAG, "Dropped command %u of actuator %d, already got %u",
+            (unsigned)sequence, id, (unsigned)last_sequence[id]);
+        return false;
+    }
+    last_sequence[id] = sequence;
+    return true;
+}
+
+/**@brief hand the collected commands over after the hold time
+ */
+static void hold_timer_callback(TimerHandle_t timer)
+{
+    held = false;
+    xTaskNotify(motor_control_handle, MOTOR_NOTIFY_POSITION, eSetBits);
+}
+
+/**@brief hand over a new position to the motor control task
+ * 
+ * @details overwrite the item in the position queue when it´s still in there
+ * (motor control was to slow) or add it when the queue is already empty
+ */
+esp_err_t position_queue_send(uint8_t id, const position_command_t *command)
+{
+    actuator_t *actuator = actuator_get(id);
+    if (!actuator) return ESP_ERR_NOT_FOUND;
+
+    xSemaphoreTake(queue_mutex, portMAX_DELAY);
+    const bool accepted = accept_sequence(id, command->sequence);
+    if (accepted) xQueueOverwrite(actuator->queue, command);
+    xSemaphoreGive(queue_mutex);
+    if (!accepted) return ESP_ERR_INVALID_STATE;
+    latency_stats_record(LATENCY_ENQUEUE, command->received_time);
+    xTaskNotify(motor_control_handle, MOTOR_NOTIFY_POSITION, eSetBits);
+    return ESP_OK;
+}
+
+/**@brief hand over new positions for multiple actuators at once
+ * 
+ * @details commands is indexed by the actuator id, only the actuators in
+ * id_mask get updated. The motor control task receives all of them in the
+ * same cycle.
+ */
+esp_err_t position_queue_send_batch(const position_command_t *commands,
+    uint32_t id_mask)
+{
+    uint32_t received_time = 0;
+
+    xSemaphoreTake(queue_mutex, portMAX_DELAY);
+    for (uint8_t id = 0; id < ACTUATOR_COUNT; ++id)
+    {
+        if ((id_mask & (1UL << id))
+            && accept_sequence(id, commands[id].sequence))
+        {
+            xQueueOverwrite(actuator_get(id)->queue, &commands[id]);
+            received_time = commands[id].received_time;
+        }
+    }
+    xSemaphoreGive(queue_mutex);
+    /*  the commands of a batch are received together */
+    latency_stats_record(LATENCY_ENQUEUE, received_time);
+    xTaskNotify(motor_control_handle, MOTOR_NOTIFY_POSITION, eSetBits);
+    return ESP_OK;
+}
+
+/**@brief block senders while the motor control task reads the queues
+ */
+void position_queue_lock(void)
+{
+    xSemaphoreTake(queue_mutex, portMAX_DELAY);
+}
+
+void position_queue_unlock(void)
+{
+    xSemaphoreGive(queue_mutex);
+}
+
+/**@brief collect the commands for a while without handing them over
+ * 
+ * @details used after a reconnect, when the broker delivers all commands
+ * that were sent while the module was offline. Only the newest command of
+ * each actuator gets applied after the hold time.
+ */
+void position_queue_hold(uint32_t time_ms)
+{
+    held = true;
+    xTimerChangePeriod(hold_timer, time_ms / portTICK_PERIOD_MS + 1, 0);
+}
+
+/**@brief get the newest position without waiting
+ * 
+ * @details returns false while the queues are held
+ */
+bool position_queue_receive(uint8_t id, position_command_t *command)
+{
+    actuator_t *actuator = actuator_get(id);
+    if (!actuator || held) return false;
+
+    return xQueueReceive(actuator->queue, command, 0) == pdTRUE;
+}
+
+/**@brief Function for initializing the queues thats used to transmit the new
+ * position of the blinds between the MQTT task and the motor_control task
+ * 
+ * @details each actuator gets its own queue, so a new position only replaces
+ * a waiting position of the same actuator
  */
 esp_err_t position_queue_init(void)
 {
-    position_queue = xQueueCreate(1, sizeof(uint8_t));
-    ESP_LOGI(TAG, "Position Queue created");
+    queue_mutex = xSemaphoreCreateMutex();
+    hold_timer = xTimerCreate("position_hold", 1, pdFALSE, NULL,
+        hold_timer_callback);
+    if (!queue_mutex || !hold_timer) return ESP_ERR_NO_MEM;
+
+    for (uint8_t id = 0; id < ACTUATOR_COUNT; ++id)
+    {
+        actuator_t *actuator = actuator_get(id);
+        actuator->queue = xQueueCreate(1, sizeof(position_command_t));
+        if (!actuator->queue) return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "Position Queues created");
     return ESP_OK;
 }
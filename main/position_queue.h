@@ -7,6 +7,7 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
 #include "freertos/queue.h"
+#include "freertos/timers.h"
 #include "esp_err.h"
 
 /*  inform c++ compilers that the function should be compiled in C Style */
@@ -14,10 +15,23 @@
 extern "C" {
 #endif
 
-/*  Make position queue extern so tasks including the file can access it*/
-extern xQueueHandle position_queue;
+/*  command that gets transmitted to the motor control task */
+typedef struct {
+    uint8_t position;       /* new position 0-100% */
+    uint16_t speed;         /* max speed in steps/s, 0 for the default */
+    uint32_t sequence;      /* sequence number of the sender, 0 for none */
+    uint32_t received_time; /* receive timestamp for the latency statistics */
+    int64_t start_time;     /* esp_timer time of a synchronized start, 0 for none */
+} position_command_t;
 
 esp_err_t position_queue_init(void);
+esp_err_t position_queue_send(uint8_t id, const position_command_t *command);
+esp_err_t position_queue_send_batch(const position_command_t *commands,
+    uint32_t id_mask);
+bool position_queue_receive(uint8_t id, position_command_t *command);
+void position_queue_hold(uint32_t time_ms);
+void position_queue_lock(void);
+void position_queue_unlock(void);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,447 @@
+/*  Holds the positions of the blinds in RAM and persists them to the NVS.
+*   A position is only written after the motors stood still for a while, so
+*   multiple moves in a row only cause a single flash write. The travel and
+*   the microsteps take the same deferred write, nothing gets written while
+*   a motor is running. The writes rotate
+*   over multiple slots per actuator, the slot with the highest sequence
+*   number is the current one.
+*   Positions and the travel are stored in 1/32 steps.
+*/
+#include <stdio.h>
+#include "position_state.h"
+#include "motor_control_task.h"
+#include "actuator.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/timers.h"
+#include "esp_log.h"
+#include "nvs.h"
+
+#define POSITION_NAMESPACE      "position"
+#define POSITION_LEGACY_KEY     "old_position" /* percent, written by old firmware */
+#define POSITION_SLOTS          4
+#define POSITION_TRAVEL_KEY     "m%u_travel" /* 1/32 steps between the end stops */
+#define POSITION_MICROSTEPS_KEY "m%u_mode"   /* coarse << 8 | fine microsteps */
+
+static const char *TAG = "POSITION_STATE";
+
+/*  content of a single slot in the NVS */
+typedef struct {
+    uint32_t sequence;
+    int32_t position;
+} position_slot_t;
+
+/*  position of a single actuator */
+typedef struct {
+    int32_t current;
+    position_slot_t saved;
+    int32_t travel;         /* 0 until the actuator got calibrated */
+    uint16_t microsteps;    /* 0 until they got set at runtime */
+    bool travel_pending;
+    bool microsteps_pending;
+} position_entry_t;
+
+static position_entry_t positions[ACTUATOR_COUNT];
+static TimerHandle_t save_timer = NULL;
+static bool write_pending = false;
+static bool held = false;      /* a motor is running */
+static portMUX_TYPE state_mux = portMUX_INITIALIZER_UNLOCKED;
+static position_state_stats_t stats;
+
+/**@brief get the NVS key of a slot, each actuator uses its own keys
+ */
+static void slot_key(uint8_t id, uint32_t sequence, char *key, size_t key_size)
+{
+    snprintf(key, key_size, "m%u_slot%u", id,
+        (unsigned)(sequence % POSITION_SLOTS));
+}
+
+/**@brief write the current position of a actuator into its next slot
+ */
+static esp_err_t write_position(nvs_handle task_nvs_handle, uint8_t id)
+{
+    esp_err_t error_code;
+    position_entry_t *entry = &positions[id];
+
+    portENTER_CRITICAL(&state_mux);
+    const position_slot_t slot = {
+        .sequence = entry->saved.sequence + 1,
+        .position = entry->current,
+    };
+    portEXIT_CRITICAL(&state_mux);
+
+    /*  position did not change since the last write */
+    if (slot.position == entry->saved.position) return ESP_OK;
+
+    char key[16];
+    slot_key(id, slot.sequence, key, sizeof(key));
+    error_code = nvs_set_blob(task_nvs_handle, key, &slot, sizeof(slot));
+    if (error_code != ESP_OK) return error_code;
+
+    entry->saved = slot;
+    ++stats.writes;
+    ESP_LOGI(TAG, "Position %d of actuator %d saved in %s",
+        slot.position, id, key);
+    return ESP_OK;
+}
+
+/**@brief write the changed travel and microsteps of a actuator
+ * 
+ * @details the written settings are added to the mask, they are pending
+ * again when the commit fails
+ */
+static esp_err_t write_settings(nvs_handle task_nvs_handle, uint8_t id,
+    uint32_t *written)
+{
+    esp_err_t error_code = ESP_OK;
+    position_entry_t *entry = &positions[id];
+    char key[16];
+
+    portENTER_CRITICAL(&state_mux);
+    const bool travel_pending = entry->travel_pending;
+    const bool microsteps_pending = entry->microsteps_pending;
+    const int32_t travel = entry->travel;
+    const uint16_t microsteps = entry->microsteps;
+    entry->travel_pending = false;
+    entry->microsteps_pending = false;
+    portEXIT_CRITICAL(&state_mux);
+
+    if (travel_pending)
+    {
+        *written |= 1UL << (id * 2);
+        snprintf(key, sizeof(key), POSITION_TRAVEL_KEY, id);
+        error_code = nvs_set_i32(task_nvs_handle, key, travel);
+    }
+    if (microsteps_pending)
+    {
+        *written |= 1UL << (id * 2 + 1);
+        if (error_code != ESP_OK) return error_code;
+        snprintf(key, sizeof(key), POSITION_MICROSTEPS_KEY, id);
+        error_code = nvs_set_u16(task_nvs_handle, key, microsteps);
+    }
+    return error_code;
+}
+
+/**@brief write the pending positions and settings of all actuators
+ */
+static esp_err_t write_positions(void)
+{
+    nvs_handle task_nvs_handle;
+    esp_err_t error_code;
+    uint32_t written = 0;
+
+    portENTER_CRITICAL(&state_mux);
+    write_pending = false;
+    portEXIT_CRITICAL(&state_mux);
+
+    error_code = nvs_open(POSITION_NAMESPACE, NVS_READWRITE, &task_nvs_handle);
+    if (error_code == ESP_OK)
+    {
+        for (uint8_t id = 0; id < ACTUATOR_COUNT && error_code == ESP_OK; ++id)
+        {
+            error_code = write_position(task_nvs_handle, id);
+            if (error_code == ESP_OK)
+            {
+                error_code = write_settings(task_nvs_handle, id, &written);
+            }
+        }
+        if (error_code == ESP_OK)
+        {
+            error_code = nvs_commit(task_nvs_handle);
+        }
+        nvs_close(task_nvs_handle);
+    }
+
+    /*  retried with the next update or once the motors stopped again */
+    if (error_code != ESP_OK)
+    {
+        portENTER_CRITICAL(&state_mux);
+        write_pending = true;
+        for (uint8_t id = 0; id < ACTUATOR_COUNT; ++id)
+        {
+            if (written & (1UL << (id * 2))) positions[id].travel_pending = true;
+            if (written & (1UL << (id * 2 + 1)))
+            {
+                positions[id].microsteps_pending = true;
+            }
+        }
+        portEXIT_CRITICAL(&state_mux);
+    }
+    return error_code;
+}
+
+/**@brief restart the debounce time of the write
+ * 
+ * @details while a motor is running the timer stays stopped, it gets
+ * started once all motors stand still
+ */
+static void schedule_write(void)
+{
+    portENTER_CRITICAL(&state_mux);
+    write_pending = true;
+    const bool start = !held;
+    portEXIT_CRITICAL(&state_mux);
+
+    if (start)
+    {
+        xTimerReset(save_timer, 0);
+    }
+}
+
+/**@brief called when the motors stood still for the debounce time
+ */
+static void save_timer_callback(TimerHandle_t timer)
+{
+    /*  a move started right before the timer expired */
+    portENTER_CRITICAL(&state_mux);
+    const bool skip = held;
+    portEXIT_CRITICAL(&state_mux);
+    if (skip) return;
+
+    if (write_positions() != ESP_OK)
+    {
+        ++stats.write_errors;
+        ESP_LOGI(TAG, "Failed to save the positions");
+    }
+}
+
+/**@brief read the newest slot of a actuator from the NVS
+ * 
+ * @details actuator 0 falls back to the percent value of older firmware
+ * versions
+ */
+static esp_err_t read_position(nvs_handle task_nvs_handle, uint8_t id)
+{
+    esp_err_t error_code;
+    position_entry_t *entry = &positions[id];
+
+    bool found = false;
+    for (uint32_t i = 0; i < POSITION_SLOTS; ++i)
+    {
+        char key[16];
+        position_slot_t slot;
+        size_t length = sizeof(slot);
+
+        slot_key(id, i, key, sizeof(key));
+        error_code = nvs_get_blob(task_nvs_handle, key, &slot, &length);
+        if (error_code == ESP_OK && length == sizeof(slot)
+            && (!found || slot.sequence > entry->saved.sequence))
+        {
+            entry->saved = slot;
+            found = true;
+        }
+    }
+
+    if (!found)
+    {
+        uint8_t old_position = 0;
+        if (id == 0)
+        {
+            /*  value can´t be found on first run -> ESP_ERR_NVS_NOT_FOUND */
+            error_code = nvs_get_u8(task_nvs_handle, POSITION_LEGACY_KEY,
+                &old_position);
+            if (error_code != ESP_OK && error_code != ESP_ERR_NVS_NOT_FOUND)
+            {
+                return error_code;
+            }
+        }
+        entry->saved.sequence = 0;
+        entry->saved.position = old_position * STEPS_PER_PERCENT;
+    }
+
+    entry->current = entry->saved.position;
+    ESP_LOGI(TAG, "Position %d of actuator %d loaded", entry->current, id);
+
+    char key[16];
+    snprintf(key, sizeof(key), POSITION_MICROSTEPS_KEY, id);
+    error_code = nvs_get_u16(task_nvs_handle, key, &entry->microsteps);
+    if (error_code == ESP_ERR_NVS_NOT_FOUND)
+    {
+        entry->microsteps = 0;
+    } else if (error_code != ESP_OK) {
+        return error_code;
+    }
+
+    snprintf(key, sizeof(key), POSITION_TRAVEL_KEY, id);
+    error_code = nvs_get_i32(task_nvs_handle, key, &entry->travel);
+    if (error_code == ESP_ERR_NVS_NOT_FOUND)
+    {
+        entry->travel = 0;
+        return ESP_OK;
+    }
+    return error_code;
+}
+
+/**@brief get the current position of a actuator in 1/32 steps
+ */
+int32_t position_state_get(uint8_t id)
+{
+    portENTER_CRITICAL(&state_mux);
+    const int32_t position = positions[id].current;
+    portEXIT_CRITICAL(&state_mux);
+    return position;
+}
+
+/**@brief update the position of a actuator after the motor stopped
+ * 
+ * @details the flash write is delayed, every update within the debounce time
+ * restarts it
+ */
+void position_state_update(uint8_t id, int32_t position)
+{
+    position_entry_t *entry = &positions[id];
+
+    portENTER_CRITICAL(&state_mux);
+    const bool pending = (entry->current != entry->saved.position);
+    const bool changed = (position != entry->saved.position);
+    entry->current = position;
+    ++stats.updates;
+    /*  the update replaces a pending write or nothing changed */
+    if (pending || !changed) ++stats.writes_avoided;
+    portEXIT_CRITICAL(&state_mux);
+
+    if (changed)
+    {
+        schedule_write();
+    }
+}
+
+/**@brief hold the pending write while a motor is running
+ * 
+ * @details the flash write stalls the tasks, so it only starts after all
+ * motors stood still for the debounce time
+ */
+void position_state_hold(bool hold)
+{
+    portENTER_CRITICAL(&state_mux);
+    const bool changed = (hold != held);
+    held = hold;
+    const bool start = !hold && write_pending;
+    portEXIT_CRITICAL(&state_mux);
+
+    if (!changed) return;
+    if (hold)
+    {
+        xTimerStop(save_timer, 0);
+    } else if (start) {
+        xTimerReset(save_timer, 0);
+    }
+}
+
+/**@brief write pending positions right away, e.g. before a restart
+ */
+esp_err_t position_state_flush(void)
+{
+    xTimerStop(save_timer, portMAX_DELAY);
+    return write_positions();
+}
+
+/**@brief get the calibrated 1/32 steps between the end stops of a actuator
+ * 
+ * @details returns 0 when the actuator was never calibrated
+ */
+int32_t position_state_get_travel(uint8_t id)
+{
+    return positions[id].travel;
+}
+
+/**@brief save the calibrated 1/32 steps between the end stops of a actuator
+ * 
+ * @details written together with the positions after the motors stood still
+ */
+esp_err_t position_state_set_travel(uint8_t id, int32_t travel)
+{
+    portENTER_CRITICAL(&state_mux);
+    positions[id].travel = travel;
+    positions[id].travel_pending = true;
+    portEXIT_CRITICAL(&state_mux);
+
+    schedule_write();
+    return ESP_OK;
+}
+
+/**@brief get the microsteps set at runtime
+ * 
+ * @details returns ESP_ERR_NOT_FOUND when they were never set, the values
+ * stay unchanged then
+ */
+esp_err_t position_state_get_microsteps(uint8_t id, uint8_t *coarse,
+    uint8_t *fine)
+{
+    const uint16_t microsteps = positions[id].microsteps;
+    if (!microsteps) return ESP_ERR_NOT_FOUND;
+    *coarse = microsteps >> 8;
+    *fine = microsteps & 0xFF;
+    return ESP_OK;
+}
+
+/**@brief save the microsteps of a actuator
+ * 
+ * @details written together with the positions after the motors stood still
+ */
+esp_err_t position_state_set_microsteps(uint8_t id, uint8_t coarse,
+    uint8_t fine)
+{
+    portENTER_CRITICAL(&state_mux);
+    positions[id].microsteps = (uint16_t)coarse << 8 | fine;
+    positions[id].microsteps_pending = true;
+    portEXIT_CRITICAL(&state_mux);
+
+    schedule_write();
+    return ESP_OK;
+}
+
+/**@brief copy the flash write counters
+ */
+void position_state_get_stats(position_state_stats_t *current_stats)
+{
+    *current_stats = stats;
+}
+
+/**@brief clear the flash write counters
+ */
+void position_state_reset_stats(void)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+/**@brief write the flash write counters as JSON into the buffer
+ * 
+ * @details returns the length or -1 when the buffer is too small
+ */
+int position_state_format_stats(char *buffer, int size)
+{
+    position_state_stats_t current;
+    position_state_get_stats(&current);
+
+    const int len = snprintf(buffer, size,
+        "{\"updates\":%u,\"writes\":%u,\"writes_avoided\":%u,"
+        "\"write_errors\":%u}",
+        (unsigned)current.updates, (unsigned)current.writes,
+        (unsigned)current.writes_avoided, (unsigned)current.write_errors);
+    return len < size ? len : -1;
+}
+
+/**@brief Function for initializing the position state
+ * 
+ * @details the nvs flash has to be initialized before
+ */
+esp_err_t position_state_init(void)
+{
+    nvs_handle task_nvs_handle;
+    esp_err_t error_code;
+
+    save_timer = xTimerCreate("position_save",
+        CONFIG_POSITION_SAVE_DELAY_MS / portTICK_PERIOD_MS,
+        pdFALSE, NULL, save_timer_callback);
+    if (!save_timer) return ESP_ERR_NO_MEM;
+
+    error_code = nvs_open(POSITION_NAMESPACE, NVS_READWRITE, &task_nvs_handle);
+    if (error_code != ESP_OK) return error_code;
+
+    for (uint8_t id = 0; id < ACTUATOR_COUNT && error_code == ESP_OK; ++id)
+    {
+        error_code = read_position(task_nvs_handle, id);
+    }
+    nvs_close(task_nvs_handle);
+    return error_code;
+}
@@ -0,0 +1,41 @@
+#ifndef __POSITION_STATE__
+#define __POSITION_STATE__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "esp_err.h"
+
+/*  inform c++ compilers that the function should be compiled in C Style */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*  counters to measure how much flash writes the write-behind saves */
+typedef struct {
+    uint32_t updates;           /* position updates from the motor control */
+    uint32_t writes;            /* positions written to the flash */
+    uint32_t writes_avoided;    /* updates that did not cause a flash write */
+    uint32_t write_errors;      /* failed flash writes */
+} position_state_stats_t;
+
+esp_err_t position_state_init(void);
+int32_t position_state_get(uint8_t id);
+void position_state_update(uint8_t id, int32_t position);
+void position_state_hold(bool hold);
+esp_err_t position_state_flush(void);
+void position_state_get_stats(position_state_stats_t *stats);
+void position_state_reset_stats(void);
+int position_state_format_stats(char *buffer, int size);
+int32_t position_state_get_travel(uint8_t id);
+esp_err_t position_state_set_travel(uint8_t id, int32_t travel);
+esp_err_t position_state_get_microsteps(uint8_t id, uint8_t *coarse,
+    uint8_t *fine);
+esp_err_t position_state_set_microsteps(uint8_t id, uint8_t coarse,
+    uint8_t fine);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __POSITION_STATE__ */
@@ -0,0 +1,174 @@
+/*  Lets the module sleep while all motors stand still.
+*   With CONFIG_POWER_SAVE the CPU scales its frequency down and enters light
+*   sleep whenever no task has to run, the Wi-Fi uses modem sleep. While a
+*   motor moves, a lock keeps the APB clock at its maximum, since it clocks
+*   the step timer, and prevents the light sleep.
+*   Tickless idle and the power management have to be enabled in the sdkconfig
+*   (CONFIG_PM_ENABLE, CONFIG_FREERTOS_USE_TICKLESS_IDLE), see sdkconfig.defaults.
+*/
+#include "power_manager.h"
+#include "interrupt_task.h"
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_pm.h"
+#include "esp_sleep.h"
+#include "soc/rtc.h"
+
+#if CONFIG_POWER_SAVE == 1
+    #define POWER_SAVE true
+#else
+    #define POWER_SAVE false
+#endif
+
+static const char *TAG = "POWER_MANAGER";
+static bool initialized = false;
+static esp_pm_lock_handle_t apb_lock = NULL;
+static esp_pm_lock_handle_t cpu_lock = NULL;
+static bool active = false;
+static int64_t state_since = 0;
+static power_manager_stats_t stats;
+static portMUX_TYPE stats_mux = portMUX_INITIALIZER_UNLOCKED;
+
+/**@brief add the time since the last change to the current state
+ */
+static void account_time(int64_t now)
+{
+    portENTER_CRITICAL(&stats_mux);
+    if (active)
+    {
+        stats.active_us += now - state_since;
+    } else {
+        stats.idle_us += now - state_since;
+    }
+    state_since = now;
+    portEXIT_CRITICAL(&stats_mux);
+}
+
+/**@brief switch between the active and the idle state
+ * 
+ * @details only called by the motor control task. Has to be activated
+ * before a move gets handed over to the step generator, so the step timer
+ * runs at the full clock before the first step. Idle calls re-arm the End
+ * Stop wakeups.
+ */
+void power_manager_set_active(bool new_active)
+{
+    if (new_active != active)
+    {
+        account_time(esp_timer_get_time());
+        active = new_active;
+        if (active)
+        {
+            ++stats.wakeups;
+            if (apb_lock) esp_pm_lock_acquire(apb_lock);
+            if (cpu_lock) esp_pm_lock_acquire(cpu_lock);
+            /*  the End Stops need their edge interrupts while moving */
+            interrupt_task_set_wakeup(false);
+        } else {
+            if (cpu_lock) esp_pm_lock_release(cpu_lock);
+            if (apb_lock) esp_pm_lock_release(apb_lock);
+        }
+    }
+    /*  a End Stop that woke the module disarmed the wakeups */
+    if (!active && initialized) interrupt_task_set_wakeup(POWER_SAVE);
+}
+
+/**@brief measure the time from a command to the first step of a move that
+ * started from idle
+ */
+void power_manager_add_wake_latency(uint32_t latency_us)
+{
+    portENTER_CRITICAL(&stats_mux);
+    ++stats.wake_count;
+    stats.wake_last_us = latency_us;
+    stats.wake_total_us += latency_us;
+    if (latency_us > stats.wake_max_us) stats.wake_max_us = latency_us;
+    portEXIT_CRITICAL(&stats_mux);
+}
+
+/**@brief copy the current statistics including the running state
+ */
+void power_manager_get_stats(power_manager_stats_t *current_stats)
+{
+    account_time(esp_timer_get_time());
+    portENTER_CRITICAL(&stats_mux);
+    *current_stats = stats;
+    portEXIT_CRITICAL(&stats_mux);
+}
+
+/**@brief clear the statistics
+ */
+void power_manager_reset_stats(void)
+{
+    portENTER_CRITICAL(&stats_mux);
+    memset(&stats, 0, sizeof(stats));
+    state_since = esp_timer_get_time();
+    portEXIT_CRITICAL(&stats_mux);
+}
+
+/**@brief write the statistics as JSON into buffer
+ * 
+ * @details returns the length or -1 when the buffer is too small
+ */
+int power_manager_format_stats(char *buffer, int size)
+{
+    power_manager_stats_t current;
+    power_manager_get_stats(&current);
+
+    const int len = snprintf(buffer, size,
+        "{\"power_save\":%s,\"wakeups\":%u,\"active_ms\":%u,\"idle_ms\":%u,"
+        "\"wake_count\":%u,\"wake_last_us\":%u,\"wake_mean_us\":%u,"
+        "\"wake_max_us\":%u}",
+        POWER_SAVE ? "true" : "false", (unsigned)current.wakeups,
+        (unsigned)(current.active_us / 1000), (unsigned)(current.idle_us / 1000),
+        (unsigned)current.wake_count, (unsigned)current.wake_last_us,
+        current.wake_count
+            ? (unsigned)(current.wake_total_us / current.wake_count) : 0,
+        (unsigned)current.wake_max_us);
+    return len < size ? len : -1;
+}
+
+/**@brief Function for initializing the power management
+ * 
+ * @details the locks get created whenever the power management is enabled,
+ * so the step timer is protected from the frequency scaling in any case.
+ * The End Stop interrupts have to be installed before.
+ */
+esp_err_t power_manager_init(void)
+{
+    state_since = esp_timer_get_time();
+
+#if CONFIG_PM_ENABLE
+    esp_err_t error_code = esp_pm_lock_create(ESP_PM_APB_FREQ_MAX, 0,
+        "motor_apb", &apb_lock);
+    if (error_code == ESP_OK)
+    {
+        error_code = esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0,
+            "motor_cpu", &cpu_lock);
+    }
+    if (error_code != ESP_OK) return error_code;
+
+    if (POWER_SAVE)
+    {
+        const esp_pm_config_esp32_t pm_config = {
+            .max_freq_mhz = CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ,
+            .min_freq_mhz = rtc_clk_xtal_freq_get(),
+            .light_sleep_enable = true,
+        };
+        error_code = esp_pm_configure(&pm_config);
+        if (error_code != ESP_OK) return error_code;
+        esp_sleep_enable_gpio_wakeup();
+        ESP_LOGI(TAG, "Light sleep enabled while idle");
+    }
+#else
+    if (POWER_SAVE)
+    {
+        ESP_LOGW(TAG, "CONFIG_PM_ENABLE is not set, the module does not sleep");
+    }
+#endif
+    initialized = true;
+    /*  a calibration might already be running */
+    if (!active) interrupt_task_set_wakeup(POWER_SAVE);
+    return ESP_OK;
+}
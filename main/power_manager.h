@@ -0,0 +1,37 @@
+#ifndef __POWER_MANAGER__
+#define __POWER_MANAGER__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "esp_err.h"
+
+/*  inform c++ compilers that the function should be compiled in C Style */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*  time spent in each state, the idle current is the sleep current measured
+*   on the supply times the idle share */
+typedef struct {
+    uint32_t wakeups;       /* changes from idle to active */
+    uint64_t active_us;     /* motors moving, no light sleep */
+    uint64_t idle_us;       /* motors standing still, light sleep allowed */
+    uint32_t wake_count;    /* moves started from idle */
+    uint32_t wake_last_us;  /* command to first step of the last wake */
+    uint32_t wake_max_us;
+    uint64_t wake_total_us;
+} power_manager_stats_t;
+
+esp_err_t power_manager_init(void);
+void power_manager_set_active(bool active);
+void power_manager_add_wake_latency(uint32_t latency_us);
+void power_manager_get_stats(power_manager_stats_t *stats);
+void power_manager_reset_stats(void);
+int power_manager_format_stats(char *buffer, int size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __POWER_MANAGER__ */
@@ -0,0 +1,139 @@
+/*  Hardware timer backend for the step pulse generation.
+*   Uses timer 0 of timer group 0 as a free running 1 MHz counter with an
+*   absolute alarm, so the pulse timing does not depend on the RTOS tick.
+*/
+#include "pulse_output.h"
+#include "esp_log.h"
+#include "esp_attr.h"
+#include "driver/timer.h"
+#include "soc/gpio_struct.h"
+#include "rom/ets_sys.h"
+
+#define PULSE_TIMER_GROUP       TIMER_GROUP_0
+#define PULSE_TIMER_IDX         TIMER_0
+#define PULSE_TIMER_DIVIDER     (TIMER_BASE_CLK / 1000000) /* 1 tick = 1 us */
+#define PULSE_WIDTH_US          2   /* DRV8825 requires at least 1.9 us */
+#define PULSE_MIN_LEAD_US       5   /* alarms closer than this get delayed */
+
+static const char *TAG = "PULSE_OUTPUT";
+static pulse_output_handler_t pulse_handler = NULL;
+
+/**@brief read the current counter value from inside a ISR
+ */
+static inline uint64_t IRAM_ATTR pulse_timer_read(void)
+{
+    TIMERG0.hw_timer[PULSE_TIMER_IDX].update = 1;
+    return ((uint64_t)TIMERG0.hw_timer[PULSE_TIMER_IDX].cnt_high << 32)
+        | TIMERG0.hw_timer[PULSE_TIMER_IDX].cnt_low;
+}
+
+/**@brief set the next alarm and make sure it is not in the past, since the
+ * alarm would only trigger after a overflow of the counter otherwise
+ */
+static inline void IRAM_ATTR pulse_timer_arm(uint64_t alarm_time)
+{
+    const uint64_t earliest = pulse_timer_read() + PULSE_MIN_LEAD_US;
+    if (alarm_time < earliest) alarm_time = earliest;
+
+    TIMERG0.hw_timer[PULSE_TIMER_IDX].alarm_high = (uint32_t)(alarm_time >> 32);
+    TIMERG0.hw_timer[PULSE_TIMER_IDX].alarm_low = (uint32_t)alarm_time;
+    TIMERG0.hw_timer[PULSE_TIMER_IDX].config.alarm_en = TIMER_ALARM_EN;
+}
+
+static void IRAM_ATTR pulse_timer_isr(void *arg)
+{
+    TIMERG0.int_clr_timers.t0 = 1;
+
+    const uint64_t alarm_time =
+        ((uint64_t)TIMERG0.hw_timer[PULSE_TIMER_IDX].alarm_high << 32)
+        | TIMERG0.hw_timer[PULSE_TIMER_IDX].alarm_low;
+
+    const uint64_t next_alarm = pulse_handler(alarm_time);
+    /*  the alarm gets disabled by hardware after it triggered */
+    if (next_alarm != PULSE_OUTPUT_STOP)
+    {
+        pulse_timer_arm(next_alarm);
+    }
+}
+
+/**@brief get the current time of the pulse timer in us
+ */
+uint64_t IRAM_ATTR pulse_output_get_time(void)
+{
+    return pulse_timer_read();
+}
+
+/**@brief schedule the first alarm of a pulse train
+ */
+void IRAM_ATTR pulse_output_start(uint64_t alarm_time)
+{
+    pulse_timer_arm(alarm_time);
+}
+
+/**@brief stop the pulse train, can be called from a ISR
+ */
+void IRAM_ATTR pulse_output_stop(void)
+{
+    TIMERG0.hw_timer[PULSE_TIMER_IDX].config.alarm_en = TIMER_ALARM_DIS;
+}
+
+/**@brief set the level of output pins, can be called from a ISR
+ * 
+ * @details writes the GPIO registers directly, so only GPIO 0-31 are supported
+ */
+void IRAM_ATTR pulse_output_set_level(uint32_t gpio_mask, bool level)
+{
+    if (level)
+    {
+        GPIO.out_w1ts = gpio_mask;
+    } else {
+        GPIO.out_w1tc = gpio_mask;
+    }
+}
+
+/**@brief generate a single pulse on the given pins, can be called from a ISR
+ */
+void IRAM_ATTR pulse_output_pulse(uint32_t gpio_mask)
+{
+    GPIO.out_w1ts = gpio_mask;
+    ets_delay_us(PULSE_WIDTH_US);
+    GPIO.out_w1tc = gpio_mask;
+}
+
+/**@brief Function for initializing the hardware timer used for the pulses
+ */
+esp_err_t pulse_output_init(pulse_output_handler_t handler)
+{
+    esp_err_t error_code;
+    timer_config_t config = {
+        .divider = PULSE_TIMER_DIVIDER,
+        .counter_dir = TIMER_COUNT_UP,
+        .counter_en = TIMER_PAUSE,
+        .alarm_en = TIMER_ALARM_DIS,
+        .intr_type = TIMER_INTR_LEVEL,
+        .auto_reload = TIMER_AUTORELOAD_DIS,
+    };
+
+    pulse_handler = handler;
+
+    error_code = timer_init(PULSE_TIMER_GROUP, PULSE_TIMER_IDX, &config);
+    if (error_code != ESP_OK) return error_code;
+
+    error_code = timer_set_counter_value(PULSE_TIMER_GROUP, PULSE_TIMER_IDX, 0);
+    if (error_code != ESP_OK) return error_code;
+
+    error_code = timer_enable_intr(PULSE_TIMER_GROUP, PULSE_TIMER_IDX);
+    if (error_code != ESP_OK) return error_code;
+
+    /*  ISR is placed in IRAM so steps continue while the flash is written */
+    error_code = timer_isr_register(PULSE_TIMER_GROUP, PULSE_TIMER_IDX,
+        pulse_timer_isr, NULL, ESP_INTR_FLAG_IRAM, NULL);
+    if (error_code != ESP_OK) return error_code;
+
+    /*  the counter runs all the time, only the alarm gets switched */
+    error_code = timer_start(PULSE_TIMER_GROUP, PULSE_TIMER_IDX);
+    if (error_code != ESP_OK) return error_code;
+
+    ESP_LOGI(TAG, "Pulse timer started");
+    return ESP_OK;
+}
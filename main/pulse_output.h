@@ -0,0 +1,33 @@
+#ifndef __PULSE_OUTPUT__
+#define __PULSE_OUTPUT__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "esp_err.h"
+
+/*  inform c++ compilers that the function should be compiled in C Style */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*  returned by the handler when no further alarm is required */
+#define PULSE_OUTPUT_STOP       UINT64_MAX
+
+/*  Handler that gets called from the timer interrupt.
+*   alarm_time is the absolute time (us) the alarm was scheduled for, the
+*   return value is the absolute time of the next alarm or PULSE_OUTPUT_STOP */
+typedef uint64_t (*pulse_output_handler_t)(uint64_t alarm_time);
+
+esp_err_t pulse_output_init(pulse_output_handler_t handler);
+uint64_t pulse_output_get_time(void);
+void pulse_output_start(uint64_t alarm_time);
+void pulse_output_stop(void);
+void pulse_output_set_level(uint32_t gpio_mask, bool level);
+void pulse_output_pulse(uint32_t gpio_mask);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PULSE_OUTPUT__ */
@@ -0,0 +1,228 @@
+/*  Compares the position measured by the encoder of a actuator with the
+*   commanded position of the step generator.
+*   While a move runs, a difference above CONFIG_ENCODER_STALL_STEPS stops
+*   it, at the end of a move a single lost step is corrected. The position
+*   is set to the measured one and the move continues, after the retries the
+*   motor backs off and keeps the measured position. Actuators without
+*   encoder stay open-loop.
+*/
+#include "stall_detection.h"
+#include "step_generator.h"
+#include "telemetry_task.h"
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#if CONFIG_ENCODER_REVERSE == 1
+    #define ENCODER_REVERSE true
+#else
+    #define ENCODER_REVERSE false
+#endif
+
+#define UNITS_PER_REV   ((int64_t)CONFIG_STEPPER_STEPS_PER_REV \
+                        * STEP_GENERATOR_UNITS_PER_STEP)
+#define STALL_UNITS     (CONFIG_ENCODER_STALL_STEPS * STEP_GENERATOR_UNITS_PER_STEP)
+#define LOST_UNITS      STEP_GENERATOR_UNITS_PER_STEP /* corrected at the end */
+#define BACK_OFF_UNITS  (CONFIG_ENCODER_BACK_OFF_STEPS * STEP_GENERATOR_UNITS_PER_STEP)
+
+static const char *TAG = "STALL_DETECTION";
+static stall_detection_stats_t stats[ACTUATOR_COUNT];
+static portMUX_TYPE stats_mux = portMUX_INITIALIZER_UNLOCKED;
+
+/**@brief get the encoder count converted to 1/32 steps
+ */
+static int32_t encoder_units(const actuator_t *actuator)
+{
+    int32_t count = encoder_get_count(actuator->id);
+    if (ENCODER_REVERSE) count = -count;
+    return (int32_t)(count * UNITS_PER_REV / CONFIG_ENCODER_COUNTS_PER_REV);
+}
+
+/**@brief get the position measured by the encoder in 1/32 steps
+ */
+static int32_t measured_position(const actuator_t *actuator)
+{
+    return actuator->encoder_offset + encoder_units(actuator);
+}
+
+/**@brief overwrite the commanded position with the measured one
+ * 
+ * @details the motor has to stand still
+ */
+static void correct_position(actuator_t *actuator, int32_t measured)
+{
+    step_generator_set_position(&actuator->channel, measured);
+    telemetry_task_notify(1UL << actuator->id);
+}
+
+/**@brief Function for initializing the encoder of a actuator
+ * 
+ * @details the encoder starts at the current position, which has to be
+ * loaded before
+ */
+esp_err_t stall_detection_init(actuator_t *actuator)
+{
+    const actuator_pins_t *pins = actuator->pins;
+    if (pins->encoder_a == ENCODER_PIN_UNUSED
+        || pins->encoder_b == ENCODER_PIN_UNUSED)
+    {
+        return ESP_OK;
+    }
+
+    esp_err_t error_code = encoder_init(actuator->id, pins->encoder_a,
+        pins->encoder_b);
+    if (error_code != ESP_OK) return error_code;
+    actuator->has_encoder = true;
+    stall_detection_sync(actuator);
+    return ESP_OK;
+}
+
+/**@brief take over the commanded position as measured position
+ * 
+ * @details called after the position got corrected by a End Stop or a
+ * calibration, the motor has to stand still
+ */
+void stall_detection_sync(actuator_t *actuator)
+{
+    if (!actuator->has_encoder) return;
+    actuator->encoder_offset = step_generator_get_position(&actuator->channel)
+        - encoder_units(actuator);
+}
+
+/**@brief prepare the feedback for a new command
+ * 
+ * @details has to be called before the target is handed over. A motor that
+ * stands still takes over the measured position first, the blind might have
+ * been moved by hand while the driver was released.
+ */
+void stall_detection_start(actuator_t *actuator)
+{
+    actuator->stall_retries = 0;
+    if (!actuator->has_encoder
+        || step_generator_is_running(&actuator->channel))
+    {
+        return;
+    }
+
+    const int32_t measured = measured_position(actuator);
+    const int32_t error = step_generator_get_position(&actuator->channel)
+        - measured;
+    if (abs(error) >= LOST_UNITS)
+    {
+        ESP_LOGI(TAG, "Actuator %d moved by %d/%d steps while idle",
+            actuator->id, -error, STEP_GENERATOR_UNITS_PER_STEP);
+        portENTER_CRITICAL(&stats_mux);
+        ++stats[actuator->id].corrections;
+        portEXIT_CRITICAL(&stats_mux);
+        correct_position(actuator, measured);
+    }
+}
+
+/**@brief compare the measured position with the commanded one during a move
+ * 
+ * @details called every segment while the actuator moves and once after
+ * the step generator stopped. Returns true when the move got restarted, so
+ * it is not finished yet.
+ */
+bool stall_detection_update(actuator_t *actuator)
+{
+    if (!actuator->has_encoder) return false;
+
+    step_channel_t *channel = &actuator->channel;
+    const bool running = step_generator_is_running(channel);
+    const int32_t measured = measured_position(actuator);
+    const int32_t error = abs(step_generator_get_position(channel) - measured);
+
+    portENTER_CRITICAL(&stats_mux);
+    stall_detection_stats_t *actuator_stats = &stats[actuator->id];
+    if (error > actuator_stats->max_error) actuator_stats->max_error = error;
+    if (running && error >= STALL_UNITS) ++actuator_stats->stalls;
+    if (!running && error >= LOST_UNITS) ++actuator_stats->corrections;
+    portEXIT_CRITICAL(&stats_mux);
+
+    if (error < (running ? STALL_UNITS : LOST_UNITS)) return false;
+
+    /*  a stalled motor does not follow the deceleration anyway */
+    step_generator_stop(channel);
+    correct_position(actuator, measured);
+
+    const int32_t target = actuator_percent_to_steps(actuator,
+        actuator->command.position);
+    if (actuator->stall_retries < CONFIG_ENCODER_STALL_RETRIES)
+    {
+        ++actuator->stall_retries;
+        ESP_LOGI(TAG, "Actuator %d %s %d/%d steps behind, retry %d",
+            actuator->id, running ? "stalled" : "stopped", error,
+            STEP_GENERATOR_UNITS_PER_STEP, actuator->stall_retries);
+        step_generator_set_target(channel, target, actuator->command.speed,
+            step_generator_start_time());
+        return true;
+    }
+
+    /*  a obstacle blocks the blind, the back off itself is not retried */
+    if (running && actuator->stall_retries == CONFIG_ENCODER_STALL_RETRIES)
+    {
+        ++actuator->stall_retries;
+        int32_t back_off = target > measured
+            ? measured - BACK_OFF_UNITS : measured + BACK_OFF_UNITS;
+        if (back_off < 0) back_off = 0;
+        if (back_off > actuator->travel) back_off = actuator->travel;
+
+        ESP_LOGI(TAG, "Actuator %d blocked, backing off", actuator->id);
+        portENTER_CRITICAL(&stats_mux);
+        ++stats[actuator->id].back_offs;
+        portEXIT_CRITICAL(&stats_mux);
+        actuator->command.position = actuator_steps_to_percent(actuator,
+            back_off);
+        step_generator_set_target(channel, back_off, 0,
+            step_generator_start_time());
+        return true;
+    }
+
+    /*  keep the measured position, the move is finished */
+    actuator->command.position = actuator_steps_to_percent(actuator, measured);
+    return false;
+}
+
+/**@brief copy the current statistics of a actuator
+ */
+void stall_detection_get_stats(uint8_t id, stall_detection_stats_t *current_stats)
+{
+    portENTER_CRITICAL(&stats_mux);
+    *current_stats = stats[id];
+    portEXIT_CRITICAL(&stats_mux);
+}
+
+/**@brief clear the statistics
+ */
+void stall_detection_reset_stats(void)
+{
+    portENTER_CRITICAL(&stats_mux);
+    memset(stats, 0, sizeof(stats));
+    portEXIT_CRITICAL(&stats_mux);
+}
+
+/**@brief write the statistics as JSON into buffer
+ * 
+ * @details returns the length or -1 when the buffer is too small
+ */
+int stall_detection_format_stats(char *buffer, int size)
+{
+    int len = snprintf(buffer, size, "{\"stall_steps\":%d,\"actuators\":[",
+        CONFIG_ENCODER_STALL_STEPS);
+
+    for (uint8_t id = 0; id < ACTUATOR_COUNT && len < size; ++id)
+    {
+        stall_detection_stats_t current;
+        stall_detection_get_stats(id, &current);
+        len += snprintf(buffer + len, size - len,
+            "%s{\"encoder\":%s,\"stalls\":%u,\"corrections\":%u,"
+            "\"back_offs\":%u,\"max_error\":%d}",
+            id ? "," : "", actuator_get(id)->has_encoder ? "true" : "false",
+            (unsigned)current.stalls, (unsigned)current.corrections,
+            (unsigned)current.back_offs, current.max_error);
+    }
+    if (len < size) len += snprintf(buffer + len, size - len, "]}");
+    return len < size ? len : -1;
+}
@@ -0,0 +1,35 @@
+#ifndef __STALL_DETECTION__
+#define __STALL_DETECTION__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "esp_err.h"
+#include "actuator.h"
+
+/*  inform c++ compilers that the function should be compiled in C Style */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*  feedback statistics of a single actuator */
+typedef struct {
+    uint32_t stalls;        /* moves stopped by the stall threshold */
+    uint32_t corrections;   /* lost steps corrected at standstill */
+    uint32_t back_offs;     /* moves given up after the retries */
+    int32_t max_error;      /* highest difference in 1/32 steps */
+} stall_detection_stats_t;
+
+esp_err_t stall_detection_init(actuator_t *actuator);
+void stall_detection_sync(actuator_t *actuator);
+void stall_detection_start(actuator_t *actuator);
+bool stall_detection_update(actuator_t *actuator);
+void stall_detection_get_stats(uint8_t id, stall_detection_stats_t *stats);
+void stall_detection_reset_stats(void);
+int stall_detection_format_stats(char *buffer, int size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __STALL_DETECTION__ */
@@ -0,0 +1,452 @@
+/*  Generates the step pulses for the stepper drivers from the hardware timer.
+*   The motor control task only sets target positions, while the timing and
+*   the position tracking are handled completely inside the timer interrupt.
+*   A single timer serves all motors: each channel keeps the time of its next
+*   step and the alarm is always set to the earliest one.
+*   The target can be changed at any time, the running move then decelerates,
+*   reverses if required and continues to the new target.
+*   Channels with connected mode pins cruise with coarse steps and switch to
+*   fine microsteps at low speed and for the last steps before the target.
+*   The planner always works with full steps, a pulse only advances it by
+*   the fraction of a step it moved.
+*/
+#include <stdio.h>
+#include "step_generator.h"
+#include "pulse_output.h"
+#include "latency_stats.h"
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_attr.h"
+
+#define STEP_START_DELAY_US     100  /* delay between start and first step */
+#define STEP_GROUP_US           20   /* steps this close share one interrupt */
+#define FINE_DISTANCE           (CONFIG_STEPPER_FINE_STEPS * STEP_GENERATOR_UNITS_PER_STEP)
+
+static const char *TAG = "STEP_GENERATOR";
+
+static step_channel_t *channels[STEP_GENERATOR_MAX_CHANNELS];
+static uint8_t channel_count = 0;
+/*  time of the pending alarm, only valid while the timer is active */
+static uint64_t next_alarm;
+static bool timer_active = false;
+static portMUX_TYPE step_mux = portMUX_INITIALIZER_UNLOCKED;
+static step_generator_stats_t stats;
+/*  ramp index below which the fine microsteps are used */
+static uint16_t fine_index;
+
+/**@brief set the mode pins for the given 1/32 steps per pulse
+ * 
+ * @details M0-M2 hold log2 of the microsteps, not connected pins are pulled
+ * low by the driver
+ */
+static inline void IRAM_ATTR set_mode(step_channel_t *channel, uint8_t units)
+{
+    const uint32_t code = __builtin_ctz(STEP_GENERATOR_UNITS_PER_STEP / units);
+    for (uint8_t i = 0; i < STEP_GENERATOR_MODE_PINS; ++i)
+    {
+        pulse_output_set_level(channel->mode_masks[i], (code >> i) & 1);
+    }
+    channel->step_units = units;
+}
+
+/**@brief switch between the coarse and the fine steps
+ * 
+ * @details the indexer of the driver only reaches the positions of a coarser
+ * mode from one of them, so the coarse mode waits for such a position
+ */
+static inline void IRAM_ATTR select_mode(step_channel_t *channel, int32_t distance)
+{
+    const bool fine = distance <= FINE_DISTANCE
+        || channel->planner.ramp_index < fine_index;
+    const uint8_t units = fine ? channel->fine_units : channel->coarse_units;
+
+    if (units == channel->step_units) return;
+    if (units > channel->step_units
+        && ((uint32_t)(channel->position - channel->phase_origin) & (units - 1)))
+    {
+        return;
+    }
+    set_mode(channel, units);
+}
+
+/**@brief calculate the next step of a single channel
+ * 
+ * @details returns the GPIO mask of the step pin when a step has to be
+ * generated or 0 when the channel only changed its state
+ */
+static inline uint32_t IRAM_ATTR channel_step(step_channel_t *channel)
+{
+    motion_planner_t *planner = &channel->planner;
+    int32_t distance = channel->direction
+        ? channel->target - channel->position
+        : channel->position - channel->target;
+    select_mode(channel, distance);
+    const int32_t units = channel->step_units;
+
+    /*  target reached at low speed, a target between two microsteps is
+    *   reached at the closest one */
+    if (distance < units && distance > -units && planner->ramp_index <= 1)
+    {
+        planner->ramp_index = 0;
+        channel->running = false;
+        return 0;
+    }
+
+    /*  target is behind the motor and it came to a stop, so the direction
+    *   gets changed. The step is delayed by one interval at the lowest speed,
+    *   so the driver sees the direction change before the next step */
+    if (distance < 0 && planner->ramp_index == 0)
+    {
+        channel->direction = !channel->direction;
+        pulse_output_set_level(channel->dir_mask, channel->direction);
+        ++stats.reversals;
+        channel->interval = motion_planner_step(planner, 0);
+        channel->substep = 0;
+        channel->next_step += channel->interval;
+        return 0;
+    }
+
+    channel->position += channel->direction ? units : -units;
+    if (channel->first_step_pending)
+    {
+        channel->first_step_time = latency_stats_timestamp();
+        channel->first_step_pending = false;
+    }
+    /*  the speed changes once per full step */
+    channel->substep += units;
+    if (channel->substep >= STEP_GENERATOR_UNITS_PER_STEP)
+    {
+        channel->substep -= STEP_GENERATOR_UNITS_PER_STEP;
+        channel->interval = motion_planner_step(planner,
+            (distance - units) / STEP_GENERATOR_UNITS_PER_STEP);
+    }
+    /*  schedule relative to the planned time, so errors do not add up */
+    channel->next_step += (channel->interval * units)
+        / STEP_GENERATOR_UNITS_PER_STEP;
+    return channel->step_mask;
+}
+
+/**@brief Called by the pulse timer when the next step of a channel is due
+ */
+static uint64_t IRAM_ATTR step_generator_handler(uint64_t alarm_time)
+{
+    uint32_t step_mask = 0;
+    uint32_t steps = 0;
+    uint64_t next = PULSE_OUTPUT_STOP;
+
+    portENTER_CRITICAL_ISR(&step_mux);
+    for (uint8_t i = 0; i < channel_count; ++i)
+    {
+        step_channel_t *channel = channels[i];
+        if (!channel->running) continue;
+
+        if (channel->next_step <= alarm_time + STEP_GROUP_US)
+        {
+            const uint32_t channel_mask = channel_step(channel);
+            if (channel_mask)
+            {
+                step_mask |= channel_mask;
+                ++steps;
+            }
+        }
+        if (channel->running && channel->next_step < next)
+        {
+            next = channel->next_step;
+        }
+    }
+    timer_active = (next != PULSE_OUTPUT_STOP);
+    next_alarm = next;
+    portEXIT_CRITICAL_ISR(&step_mux);
+
+    if (step_mask)
+    {
+        /*  track how late the step is compared to the planned time */
+        const uint32_t late = (uint32_t)(pulse_output_get_time() - alarm_time);
+        /*  all due channels step with a single pulse */
+        pulse_output_pulse(step_mask);
+
+        portENTER_CRITICAL_ISR(&step_mux);
+        if (late > stats.max_late_us) stats.max_late_us = late;
+        stats.steps += steps;
+        portEXIT_CRITICAL_ISR(&step_mux);
+    }
+    return next;
+}
+
+/**@brief schedule the first step of a channel, step_mux has to be taken
+ */
+static void start_channel(step_channel_t *channel, uint64_t start_time)
+{
+    channel->next_step = start_time;
+    channel->running = true;
+    /*  the alarm only gets moved when the channel is due before it */
+    if (!timer_active || start_time < next_alarm)
+    {
+        timer_active = true;
+        next_alarm = start_time;
+        pulse_output_start(start_time);
+    }
+}
+
+/**@brief get a start time for moves that should start as soon as possible
+ * 
+ * @details moves that get the same start time make their steps together
+ */
+uint64_t step_generator_start_time(void)
+{
+    return pulse_output_get_time() + STEP_START_DELAY_US;
+}
+
+/**@brief get a start time delay_us in the future
+ * 
+ * @details used for moves that start at the same time on multiple modules,
+ * the timer alarm is exact, so the start does not depend on the task timing
+ */
+uint64_t step_generator_delayed_start_time(uint32_t delay_us)
+{
+    if (delay_us < STEP_START_DELAY_US) delay_us = STEP_START_DELAY_US;
+    return pulse_output_get_time() + delay_us;
+}
+
+/**@brief set a new target position in steps
+ * 
+ * @details starts a new move at start_time when the motor is standing still,
+ * otherwise the running move continues towards the new target. speed limits
+ * the cruise speed in steps/s, 0 uses the configured max speed.
+ */
+void step_generator_set_target(step_channel_t *channel, int32_t target,
+    uint16_t speed, uint64_t start_time)
+{
+    const uint16_t max_index = motion_planner_speed_index(speed);
+
+    portENTER_CRITICAL(&step_mux);
+    channel->target = target;
+    channel->planner.max_index = max_index;
+    if (!channel->running && channel->target != channel->position)
+    {
+        channel->direction = channel->target > channel->position;
+        pulse_output_set_level(channel->dir_mask, channel->direction);
+        motion_planner_start(&channel->planner, max_index);
+        channel->interval = motion_planner_interval(&channel->planner);
+        channel->substep = 0;
+        start_channel(channel, start_time);
+    }
+    /*  the time of the next step is the latency of the new target */
+    channel->first_step_pending = channel->running;
+    portEXIT_CRITICAL(&step_mux);
+}
+
+/**@brief correct the current position, the motor has to stand still
+ * 
+ * @details the indexer of the driver did not move, so its full step
+ * positions move with the correction
+ */
+void step_generator_set_position(step_channel_t *channel, int32_t position)
+{
+    portENTER_CRITICAL(&step_mux);
+    channel->phase_origin += position - channel->position;
+    channel->position = position;
+    channel->target = position;
+    portEXIT_CRITICAL(&step_mux);
+}
+
+/**@brief get the current position in steps
+ */
+int32_t step_generator_get_position(step_channel_t *channel)
+{
+    portENTER_CRITICAL(&step_mux);
+    const int32_t position = channel->position;
+    portEXIT_CRITICAL(&step_mux);
+    return position;
+}
+
+/**@brief check whether a move is running
+ */
+bool step_generator_is_running(const step_channel_t *channel)
+{
+    return channel->running;
+}
+
+/**@brief stop the running move immediately, can be called from a ISR
+ * 
+ * @details the timer keeps running for the other channels, a pending alarm
+ * of this channel just finds nothing to do
+ */
+void IRAM_ATTR step_generator_stop(step_channel_t *channel)
+{
+    portENTER_CRITICAL_ISR(&step_mux);
+    channel->running = false;
+    channel->target = channel->position;
+    portEXIT_CRITICAL_ISR(&step_mux);
+}
+
+/**@brief stop the motor when it moves towards a end stop, can be called
+ * from a ISR
+ * 
+ * @details returns false when the motor moves away from the end stop, since
+ * the switch might still bounce after leaving it
+ */
+bool IRAM_ATTR step_generator_end_stop(step_channel_t *channel, bool end_direction)
+{
+    portENTER_CRITICAL_ISR(&step_mux);
+    const bool reached = !channel->running || channel->direction == end_direction;
+    if (channel->running && reached)
+    {
+        channel->running = false;
+        channel->target = channel->position;
+    }
+    portEXIT_CRITICAL_ISR(&step_mux);
+    return reached;
+}
+
+/**@brief copy the current timing statistics
+ */
+void step_generator_get_stats(step_generator_stats_t *current_stats)
+{
+    portENTER_CRITICAL(&step_mux);
+    *current_stats = stats;
+    portEXIT_CRITICAL(&step_mux);
+}
+
+/**@brief clear the timing statistics
+ */
+void step_generator_reset_stats(void)
+{
+    portENTER_CRITICAL(&step_mux);
+    memset(&stats, 0, sizeof(stats));
+    portEXIT_CRITICAL(&step_mux);
+}
+
+/**@brief write the timing statistics as JSON into the buffer
+ * 
+ * @details max_late_us is the highest delay of a step behind its planned
+ * time, returns the length or -1 when the buffer is too small
+ */
+int step_generator_format_stats(char *buffer, int size)
+{
+    step_generator_stats_t current;
+    step_generator_get_stats(&current);
+
+    const int len = snprintf(buffer, size,
+        "{\"steps\":%u,\"reversals\":%u,\"max_late_us\":%u}",
+        (unsigned)current.steps, (unsigned)current.reversals,
+        (unsigned)current.max_late_us);
+    return len < size ? len : -1;
+}
+
+/**@brief add a motor to the step generator
+ * 
+ * @details channel has to stay valid as long as the step generator runs
+ */
+esp_err_t step_generator_add_channel(step_channel_t *channel,
+    uint8_t step_gpio, uint8_t dir_gpio)
+{
+    if (channel_count >= STEP_GENERATOR_MAX_CHANNELS) return ESP_ERR_NO_MEM;
+
+    memset(channel, 0, sizeof(*channel));
+    channel->step_mask = 1UL << step_gpio;
+    channel->dir_mask = 1UL << dir_gpio;
+    /*  full steps until mode pins are connected */
+    channel->step_units = STEP_GENERATOR_UNITS_PER_STEP;
+    channel->coarse_units = STEP_GENERATOR_UNITS_PER_STEP;
+    channel->fine_units = STEP_GENERATOR_UNITS_PER_STEP;
+
+    portENTER_CRITICAL(&step_mux);
+    channels[channel_count++] = channel;
+    portEXIT_CRITICAL(&step_mux);
+    return ESP_OK;
+}
+
+/**@brief connect the M0-M2 pins of the driver
+ * 
+ * @details the driver starts in full step mode, which is a full step
+ * position of the indexer. Pins that are not connected get
+ * STEP_GENERATOR_PIN_UNUSED, only GPIO 0-31 are supported.
+ */
+esp_err_t step_generator_set_mode_pins(step_channel_t *channel,
+    const uint8_t mode_gpios[STEP_GENERATOR_MODE_PINS])
+{
+    uint32_t masks[STEP_GENERATOR_MODE_PINS];
+    for (uint8_t i = 0; i < STEP_GENERATOR_MODE_PINS; ++i)
+    {
+        if (mode_gpios[i] == STEP_GENERATOR_PIN_UNUSED)
+        {
+            masks[i] = 0;
+        } else if (mode_gpios[i] < 32) {
+            masks[i] = 1UL << mode_gpios[i];
+        } else {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+
+    portENTER_CRITICAL(&step_mux);
+    memcpy(channel->mode_masks, masks, sizeof(masks));
+    channel->phase_origin = channel->position;
+    set_mode(channel, channel->step_units);
+    portEXIT_CRITICAL(&step_mux);
+    return ESP_OK;
+}
+
+/**@brief check whether a microstep mode can be set with the connected pins
+ */
+static bool mode_supported(const step_channel_t *channel, uint8_t microsteps)
+{
+    if (microsteps == 0 || microsteps > STEP_GENERATOR_UNITS_PER_STEP
+        || (microsteps & (microsteps - 1)))
+    {
+        return false;
+    }
+    const uint32_t code = __builtin_ctz(microsteps);
+    for (uint8_t i = 0; i < STEP_GENERATOR_MODE_PINS; ++i)
+    {
+        if (((code >> i) & 1) && !channel->mode_masks[i]) return false;
+    }
+    return true;
+}
+
+/**@brief set the microsteps per full step while cruising and for the fine
+ * approach, e.g. 1 and 16
+ * 
+ * @details can be changed during a move, the new modes are used from the
+ * next suitable step on. Both have to be powers of two up to 32 and coarse
+ * can not be finer than fine.
+ */
+esp_err_t step_generator_set_microsteps(step_channel_t *channel,
+    uint8_t coarse, uint8_t fine)
+{
+    if (coarse > fine || !mode_supported(channel, coarse)
+        || !mode_supported(channel, fine))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&step_mux);
+    channel->coarse_units = STEP_GENERATOR_UNITS_PER_STEP / coarse;
+    channel->fine_units = STEP_GENERATOR_UNITS_PER_STEP / fine;
+    portEXIT_CRITICAL(&step_mux);
+    return ESP_OK;
+}
+
+/**@brief get the microsteps per full step of both modes
+ */
+void step_generator_get_microsteps(const step_channel_t *channel,
+    uint8_t *coarse, uint8_t *fine)
+{
+    *coarse = STEP_GENERATOR_UNITS_PER_STEP / channel->coarse_units;
+    *fine = STEP_GENERATOR_UNITS_PER_STEP / channel->fine_units;
+}
+
+/**@brief Function for initializing the step generator
+ */
+esp_err_t step_generator_init(void)
+{
+    esp_err_t error_code = motion_planner_init();
+    if (error_code != ESP_OK) return error_code;
+    fine_index = motion_planner_speed_index(CONFIG_STEPPER_FINE_SPEED);
+
+    error_code = pulse_output_init(step_generator_handler);
+    if (error_code != ESP_OK) return error_code;
+
+    ESP_LOGI(TAG, "Step generator initialized");
+    return ESP_OK;
+}
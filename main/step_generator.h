@@ -0,0 +1,77 @@
+#ifndef __STEP_GENERATOR__
+#define __STEP_GENERATOR__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "esp_err.h"
+#include "motion_planner.h"
+
+/*  inform c++ compilers that the function should be compiled in C Style */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*  maximum amount of motors driven by the step generator */
+#define STEP_GENERATOR_MAX_CHANNELS     4
+/*  positions are kept in 1/32 steps, the finest microstep mode of the
+*   DRV8825, so they stay valid when the mode changes */
+#define STEP_GENERATOR_UNITS_PER_STEP   32
+#define STEP_GENERATOR_MODE_PINS        3    /* M0-M2 of the DRV8825 */
+#define STEP_GENERATOR_PIN_UNUSED       0xFF /* mode pin not connected */
+
+/*  state of a single motor, shared between the ISR and the tasks */
+typedef struct {
+    uint32_t step_mask;     /* GPIO mask of the step pin */
+    uint32_t dir_mask;      /* GPIO mask of the direction pin */
+    uint32_t mode_masks[STEP_GENERATOR_MODE_PINS]; /* GPIO masks of M0-M2 */
+    int32_t position;       /* current position in 1/32 steps */
+    int32_t target;         /* target position in 1/32 steps */
+    int32_t phase_origin;   /* a full step position of the driver indexer */
+    uint8_t step_units;     /* 1/32 steps per pulse in the current mode */
+    uint8_t coarse_units;   /* 1/32 steps per pulse while cruising */
+    uint8_t fine_units;     /* 1/32 steps per pulse at the target and slow */
+    uint8_t substep;        /* 1/32 steps since the last full step */
+    uint32_t interval;      /* time of a full step at the current speed */
+    bool direction;         /* level of the direction pin */
+    bool running;           /* a move is running */
+    uint64_t next_step;     /* time of the next step in us */
+    bool first_step_pending;    /* set_target waits for the first step */
+    uint32_t first_step_time;   /* latency timestamp of the first step */
+    motion_planner_t planner;
+} step_channel_t;
+
+/*  timing statistics of the generated steps */
+typedef struct {
+    uint32_t steps;         /* steps generated since boot */
+    uint32_t reversals;     /* direction changes during a running move */
+    uint32_t max_late_us;   /* highest delay between alarm and the step */
+} step_generator_stats_t;
+
+esp_err_t step_generator_init(void);
+esp_err_t step_generator_add_channel(step_channel_t *channel,
+    uint8_t step_gpio, uint8_t dir_gpio);
+esp_err_t step_generator_set_mode_pins(step_channel_t *channel,
+    const uint8_t mode_gpios[STEP_GENERATOR_MODE_PINS]);
+esp_err_t step_generator_set_microsteps(step_channel_t *channel,
+    uint8_t coarse, uint8_t fine);
+void step_generator_get_microsteps(const step_channel_t *channel,
+    uint8_t *coarse, uint8_t *fine);
+uint64_t step_generator_start_time(void);
+uint64_t step_generator_delayed_start_time(uint32_t delay_us);
+void step_generator_set_target(step_channel_t *channel, int32_t target,
+    uint16_t speed, uint64_t start_time);
+void step_generator_set_position(step_channel_t *channel, int32_t position);
+int32_t step_generator_get_position(step_channel_t *channel);
+bool step_generator_is_running(const step_channel_t *channel);
+void step_generator_stop(step_channel_t *channel);
+bool step_generator_end_stop(step_channel_t *channel, bool end_direction);
+void step_generator_get_stats(step_generator_stats_t *stats);
+void step_generator_reset_stats(void);
+int step_generator_format_stats(char *buffer, int size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __STEP_GENERATOR__ */
@@ -0,0 +1,129 @@
+/*  Publishes the state of the actuators to blindstate/<id>.
+*   The motor task only notifies about changes, the messages get built and
+*   sent by this low priority task at most CONFIG_TELEMETRY_RATE_HZ times per
+*   second while a motor is moving. The final state is sent retained.
+*/
+#include <stdio.h>
+#include "telemetry_task.h"
+#include "motor_control_task.h"
+#include "mqtts_task.h"
+#include "actuator.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/gpio.h"
+#include "esp_log.h"
+
+#define TELEMETRY_TOPIC         "blindstate/%u"
+#define TELEMETRY_PERIOD        (1000 / CONFIG_TELEMETRY_RATE_HZ / portTICK_PERIOD_MS)
+
+static const char *TAG = "TELEMETRY_TASK";
+static TaskHandle_t telemetry_handle = NULL;
+
+/**@brief get the name of the pressed end stop of a actuator
+ * 
+ * @details the end stops pull the pins to ground
+ */
+static const char *end_stop_state(const actuator_t *actuator)
+{
+    if (gpio_get_level(actuator->pins->high_end_stop) == 0) return "high";
+    if (gpio_get_level(actuator->pins->low_end_stop) == 0) return "low";
+    return "none";
+}
+
+/**@brief publish the state of a single actuator
+ * 
+ * @details updates during a move are sent with QoS 0, the state after the
+ * move is sent retained with QoS 1, so new subscribers get it right away
+ */
+static esp_err_t publish_state(actuator_t *actuator, bool final)
+{
+    char topic[24];
+    char data[96];
+
+    snprintf(topic, sizeof(topic), TELEMETRY_TOPIC, actuator->id);
+    const int len = snprintf(data, sizeof(data),
+        "{\"position\":%d,\"target\":%d,\"state\":\"%s\",\"end_stop\":\"%s\"}",
+        (int)actuator_steps_to_percent(actuator,
+            step_generator_get_position(&actuator->channel)),
+        (int)actuator->command.position,
+        actuator->calibration != CALIBRATION_IDLE ? "calibrating"
+            : final ? "idle" : "moving",
+        end_stop_state(actuator));
+
+    return mqtts_task_publish(topic, data, len, final ? 1 : 0, final);
+}
+
+/**@brief Task that publishes the state of the actuators
+ * 
+ * @details the notification value contains a bit for each actuator whose
+ * state changed. While a actuator is moving its state is published once per
+ * period, changes in between are coalesced into the next message.
+ */
+static void telemetry_task(void *arg)
+{
+    TickType_t last_publish[ACTUATOR_COUNT] = {0};
+    bool published_moving[ACTUATOR_COUNT] = {false};
+
+    ESP_LOGI(TAG, "Start Telemetry Task");
+
+    for(;;)
+    {
+        bool moving = false;
+        for (uint8_t id = 0; id < ACTUATOR_COUNT; ++id)
+        {
+            moving |= actuator_get(id)->moving;
+        }
+
+        uint32_t notification = 0;
+        xTaskNotifyWait(0, UINT32_MAX, &notification,
+            moving ? TELEMETRY_PERIOD : portMAX_DELAY);
+
+        const TickType_t now = xTaskGetTickCount();
+        for (uint8_t id = 0; id < ACTUATOR_COUNT; ++id)
+        {
+            actuator_t *actuator = actuator_get(id);
+            const uint32_t bit = 1UL << id;
+
+            if (actuator->moving)
+            {
+                if (now - last_publish[id] < TELEMETRY_PERIOD) continue;
+                /*  missed updates during a move are not repeated */
+                publish_state(actuator, false);
+                last_publish[id] = now;
+                published_moving[id] = true;
+            } else if (published_moving[id] || (notification & bit)) {
+                /*  the mqtt task requests all states again after a reconnect */
+                publish_state(actuator, true);
+                published_moving[id] = false;
+            }
+        }
+    }
+}
+
+/**@brief inform the telemetry task about a changed state
+ * 
+ * @details contains a bit for each actuator, the state gets published by the
+ * telemetry task, so the caller is never blocked by the network
+ */
+void telemetry_task_notify(uint32_t actuator_mask)
+{
+    if (telemetry_handle == NULL) return;
+    xTaskNotify(telemetry_handle, actuator_mask, eSetBits);
+}
+
+/**@brief Function for initializing the Task of the telemetry
+ */
+esp_err_t telemetry_task_init(void)
+{
+    xTaskCreate(
+        telemetry_task,         /* Task function */
+        "TELEMETRY",            /* Name of task */
+        3072,                   /* Stack size of task */
+        NULL,                   /* parameter of the task */
+        2,                      /* priority of the task (high is important) */
+        &telemetry_handle);     /* Task handle to keep track of created Task */
+
+    /*  publish the state after boot */
+    telemetry_task_notify(TELEMETRY_ALL_ACTUATORS);
+    return ESP_OK;
+}
@@ -0,0 +1,24 @@
+#ifndef __TELEMETRY_TASK__
+#define __TELEMETRY_TASK__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "esp_err.h"
+
+/*  inform c++ compilers that the function should be compiled in C Style */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*  notify mask to publish the state of all actuators */
+#define TELEMETRY_ALL_ACTUATORS     UINT32_MAX
+
+esp_err_t telemetry_task_init(void);
+void telemetry_task_notify(uint32_t actuator_mask);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __TELEMETRY_TASK__ */
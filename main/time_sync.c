@@ -0,0 +1,302 @@
+/*  Keeps a clock that is synchronized with a SNTP server, so multiple modules
+*   can start their moves at the same time.
+*   The system time is not touched: the server time is modelled as an offset
+*   and a drift relative to esp_timer, which keeps running monotonic. Each
+*   synchronization sends a few requests and uses the one with the shortest
+*   round trip, since its offset has the smallest error.
+*/
+#include "time_sync.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+#include "lwip/netdb.h"
+
+#define SNTP_PORT               "123"
+#define SNTP_PACKET_SIZE        48
+#define SNTP_UNIX_OFFSET        2208988800ULL /* seconds from 1900 to 1970 */
+#define SYNC_SAMPLES            4    /* requests per synchronization */
+#define SYNC_TIMEOUT_MS         500  /* wait time for a single answer */
+#define SYNC_FAST_COUNT         4    /* first syncs use the fast interval */
+#define SYNC_FAST_INTERVAL_S    16
+#define DRIFT_MIN_ELAPSED_US    10000000LL /* min time for a drift estimate */
+#define DRIFT_MAX_PPB           500000 /* crystals are far below 500 ppm */
+#define STEP_THRESHOLD_US       1000000 /* larger errors reset the model */
+
+static const char *TAG = "TIME_SYNC";
+
+/*  server time = server_ref + elapsed + elapsed * drift_ppb / 1e9 */
+typedef struct {
+    int64_t local_ref;      /* esp_timer time of the last sync */
+    int64_t server_ref;     /* server time in us since 1970 at local_ref */
+    int32_t drift_ppb;
+    bool synchronized;
+} clock_model_t;
+
+static clock_model_t clock_model;
+static portMUX_TYPE clock_mux = portMUX_INITIALIZER_UNLOCKED;
+static time_sync_stats_t stats;
+
+/**@brief get the server time for a esp_timer time, clock_mux has to be taken
+ */
+static int64_t server_time(int64_t local_us)
+{
+    const int64_t elapsed = local_us - clock_model.local_ref;
+    return clock_model.server_ref + elapsed
+        + elapsed * clock_model.drift_ppb / 1000000000LL;
+}
+
+/**@brief read a SNTP timestamp and convert it to us since 1970
+ */
+static int64_t read_timestamp(const uint8_t *data)
+{
+    const uint32_t seconds = (uint32_t)data[0] << 24 | (uint32_t)data[1] << 16
+        | (uint32_t)data[2] << 8 | data[3];
+    const uint32_t fraction = (uint32_t)data[4] << 24 | (uint32_t)data[5] << 16
+        | (uint32_t)data[6] << 8 | data[7];
+    return ((int64_t)seconds - (int64_t)SNTP_UNIX_OFFSET) * 1000000
+        + (int64_t)(((uint64_t)fraction * 1000000) >> 32);
+}
+
+/**@brief send a single request and calculate the offset of the server clock
+ * 
+ * @details offset = server - local at the time the answer arrived. The
+ * transmit time of the request is the local timestamp, the server returns
+ * it as originate time, so old answers are detected.
+ */
+static esp_err_t request_time(int sock, const struct addrinfo *server,
+    int64_t *local_us, int64_t *offset_us, uint32_t *delay_us)
+{
+    uint8_t packet[SNTP_PACKET_SIZE] = { 0 };
+    /*  leap indicator 0, version 4, mode 3 (client) */
+    packet[0] = 0x23;
+
+    const int64_t t1 = esp_timer_get_time();
+    memcpy(&packet[40], &t1, sizeof(t1));
+    if (sendto(sock, packet, sizeof(packet), 0, server->ai_addr,
+        server->ai_addrlen) != sizeof(packet))
+    {
+        return ESP_FAIL;
+    }
+
+    uint8_t answer[SNTP_PACKET_SIZE];
+    const int len = recvfrom(sock, answer, sizeof(answer), 0, NULL, NULL);
+    const int64_t t4 = esp_timer_get_time();
+    if (len != sizeof(answer)) return ESP_ERR_TIMEOUT;
+
+    /*  mode 4 (server), stratum 0 is a kiss-o'-death message */
+    if ((answer[0] & 0x07) != 4 || answer[1] == 0
+        || memcmp(&answer[24], &packet[40], sizeof(t1)) != 0)
+    {
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+
+    const int64_t t2 = read_timestamp(&answer[32]);
+    const int64_t t3 = read_timestamp(&answer[40]);
+    const int64_t delay = (t4 - t1) - (t3 - t2);
+    if (delay < 0) return ESP_ERR_INVALID_RESPONSE;
+
+    *local_us = t4;
+    *offset_us = ((t2 - t1) + (t3 - t4)) / 2;
+    *delay_us = (uint32_t)delay;
+    return ESP_OK;
+}
+
+/**@brief update the clock model with a new measurement
+ * 
+ * @details the drift gets corrected by half of the measured error rate, so
+ * a single delayed answer does not disturb the estimate too much
+ */
+static void update_clock(int64_t local_us, int64_t offset_us, uint32_t delay_us)
+{
+    const int64_t measured = local_us + offset_us;
+    int32_t error = 0;
+
+    portENTER_CRITICAL(&clock_mux);
+    if (clock_model.synchronized)
+    {
+        const int64_t elapsed = local_us - clock_model.local_ref;
+        const int64_t predicted = server_time(local_us);
+        error = (int32_t)(measured - predicted);
+
+        if (error > STEP_THRESHOLD_US || error < -STEP_THRESHOLD_US)
+        {
+            /*  the server time jumped */
+            clock_model.drift_ppb = 0;
+        } else if (elapsed >= DRIFT_MIN_ELAPSED_US) {
+            int64_t drift = clock_model.drift_ppb
+                + (int64_t)error * 1000000000LL / elapsed / 2;
+            if (drift > DRIFT_MAX_PPB) drift = DRIFT_MAX_PPB;
+            if (drift < -DRIFT_MAX_PPB) drift = -DRIFT_MAX_PPB;
+            clock_model.drift_ppb = (int32_t)drift;
+        }
+    }
+    clock_model.local_ref = local_us;
+    clock_model.server_ref = measured;
+    clock_model.synchronized = true;
+
+    ++stats.syncs;
+    stats.last_error_us = error;
+    stats.last_delay_us = delay_us;
+    stats.drift_ppb = clock_model.drift_ppb;
+    portEXIT_CRITICAL(&clock_mux);
+
+    ESP_LOGI(TAG, "Synchronized: error %d us, delay %u us, drift %d ppb",
+        error, (unsigned)delay_us, clock_model.drift_ppb);
+}
+
+/**@brief synchronize the clock with the configured server
+ */
+static esp_err_t synchronize(void)
+{
+    const struct addrinfo hints = {
+        .ai_family = AF_INET,
+        .ai_socktype = SOCK_DGRAM,
+    };
+    struct addrinfo *server = NULL;
+    if (getaddrinfo(CONFIG_TIME_SYNC_SERVER, SNTP_PORT, &hints, &server) != 0
+        || server == NULL)
+    {
+        ESP_LOGI(TAG, "DNS lookup of %s failed", CONFIG_TIME_SYNC_SERVER);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    const int sock = socket(server->ai_family, server->ai_socktype, 0);
+    if (sock < 0)
+    {
+        freeaddrinfo(server);
+        return ESP_FAIL;
+    }
+    const struct timeval timeout = {
+        .tv_sec = 0,
+        .tv_usec = SYNC_TIMEOUT_MS * 1000,
+    };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    /*  the answer with the shortest round trip has the smallest error */
+    int64_t best_local = 0;
+    int64_t best_offset = 0;
+    uint32_t best_delay = UINT32_MAX;
+    for (uint8_t i = 0; i < SYNC_SAMPLES; ++i)
+    {
+        int64_t local_us;
+        int64_t offset_us;
+        uint32_t delay_us;
+        if (request_time(sock, server, &local_us, &offset_us, &delay_us) == ESP_OK
+            && delay_us < best_delay)
+        {
+            best_local = local_us;
+            best_offset = offset_us;
+            best_delay = delay_us;
+        }
+    }
+    close(sock);
+    freeaddrinfo(server);
+
+    if (best_delay == UINT32_MAX) return ESP_ERR_TIMEOUT;
+    update_clock(best_local, best_offset, best_delay);
+    return ESP_OK;
+}
+
+/**@brief Task that synchronizes the clock periodically
+ * 
+ * @details the first synchronizations use a short interval, so the drift
+ * is known soon after the boot
+ */
+static void time_sync_task(void *args)
+{
+    for(;;)
+    {
+        if (synchronize() != ESP_OK)
+        {
+            ++stats.failures;
+            ESP_LOGI(TAG, "Synchronization failed");
+        }
+
+        const uint32_t interval = stats.syncs < SYNC_FAST_COUNT
+            ? SYNC_FAST_INTERVAL_S : CONFIG_TIME_SYNC_INTERVAL_S;
+        vTaskDelay(interval * 1000 / portTICK_PERIOD_MS);
+    }
+}
+
+/**@brief check whether the clock got synchronized at least once
+ */
+bool time_sync_is_synchronized(void)
+{
+    return clock_model.synchronized;
+}
+
+/**@brief convert a server time in ms since 1970 to a esp_timer time
+ * 
+ * @details returns ESP_ERR_INVALID_STATE before the first synchronization
+ */
+esp_err_t time_sync_to_local(int64_t server_ms, int64_t *local_us)
+{
+    portENTER_CRITICAL(&clock_mux);
+    if (!clock_model.synchronized)
+    {
+        portEXIT_CRITICAL(&clock_mux);
+        return ESP_ERR_INVALID_STATE;
+    }
+    const int64_t elapsed = server_ms * 1000 - clock_model.server_ref;
+    *local_us = clock_model.local_ref + elapsed
+        - elapsed * clock_model.drift_ppb / 1000000000LL;
+    portEXIT_CRITICAL(&clock_mux);
+    return ESP_OK;
+}
+
+/**@brief copy the current synchronization statistics
+ */
+void time_sync_get_stats(time_sync_stats_t *current_stats)
+{
+    portENTER_CRITICAL(&clock_mux);
+    *current_stats = stats;
+    portEXIT_CRITICAL(&clock_mux);
+}
+
+/**@brief clear the statistics, the clock model is kept
+ */
+void time_sync_reset_stats(void)
+{
+    portENTER_CRITICAL(&clock_mux);
+    memset(&stats, 0, sizeof(stats));
+    stats.drift_ppb = clock_model.drift_ppb;
+    portEXIT_CRITICAL(&clock_mux);
+}
+
+/**@brief write the statistics as JSON into buffer
+ * 
+ * @details returns the length or -1 when the buffer is too small
+ */
+int time_sync_format_stats(char *buffer, int size)
+{
+    time_sync_stats_t current;
+    time_sync_get_stats(&current);
+
+    const int len = snprintf(buffer, size,
+        "{\"synchronized\":%s,\"syncs\":%u,\"failures\":%u,\"last_error_us\":%d,"
+        "\"last_delay_us\":%u,\"drift_ppb\":%d}",
+        time_sync_is_synchronized() ? "true" : "false",
+        (unsigned)current.syncs, (unsigned)current.failures,
+        current.last_error_us, (unsigned)current.last_delay_us,
+        current.drift_ppb);
+    return len < size ? len : -1;
+}
+
+/**@brief Function for initializing the Task of the time synchronization
+ * 
+ * @details needs a network connection, failed synchronizations are retried
+ */
+esp_err_t time_sync_init(void)
+{
+    xTaskCreate(
+        &time_sync_task,        /* Task function */
+        "time_sync_task",       /* Name of task */
+        3072,                   /* Stack size of task */
+        NULL,                   /* parameter of the task */
+        2,                      /* priority of the task (high is important) */
+        NULL);                  /* Task handle to keep track of created Task */
+
+    return ESP_OK;
+}
@@ -0,0 +1,34 @@
+#ifndef __TIME_SYNC__
+#define __TIME_SYNC__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "esp_err.h"
+
+/*  inform c++ compilers that the function should be compiled in C Style */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*  synchronization statistics */
+typedef struct {
+    uint32_t syncs;         /* successful synchronizations */
+    uint32_t failures;      /* synchronizations without a valid answer */
+    int32_t last_error_us;  /* error of the local clock before the last sync */
+    uint32_t last_delay_us; /* round trip time of the last sync */
+    int32_t drift_ppb;      /* estimated drift of the local clock */
+} time_sync_stats_t;
+
+esp_err_t time_sync_init(void);
+bool time_sync_is_synchronized(void);
+esp_err_t time_sync_to_local(int64_t server_ms, int64_t *local_us);
+void time_sync_get_stats(time_sync_stats_t *stats);
+void time_sync_reset_stats(void);
+int time_sync_format_stats(char *buffer, int size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __TIME_SYNC__ */
@@ -1,31 +1,213 @@
+/*  Connects to the WiFi and keeps the connection.
+*   The access point (BSSID and channel) and optionally the ip configuration
+*   of the last connection are kept in the NVS, so a reconnect skips the scan
+*   and the DHCP. Reconnects wait with a randomized exponential backoff, so
+*   the modules of a building do not retry at once after a power failure.
+*/
+#include <stdio.h>
 #include "wifi_task.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
 #include "freertos/event_groups.h"
+#include "freertos/timers.h"
 #include "esp_wifi.h"
 #include "esp_event_loop.h"
+#include "esp_system.h"
+#include "esp_timer.h"
 #include "esp_log.h"
+#include "nvs.h"
+#include "boot_timing.h"
+
+#define WIFI_NAMESPACE          "wifi"
+#define WIFI_CACHE_KEY          "cache"
+#define WIFI_CACHE_ATTEMPTS     3    /* failed attempts until a full scan */
+
+#if CONFIG_POWER_SAVE == 1
+    #define POWER_SAVE true
+#else
+    #define POWER_SAVE false
+#endif
 
 static EventGroupHandle_t wifi_event_group;
 const static int WIFI_CONNECTED_BIT = BIT0;
 static const char *TAG = "WIFI_TASK";
 
+/*  access point and ip configuration of the last connection */
+typedef struct {
+    uint8_t bssid[6];
+    uint8_t channel;
+    tcpip_adapter_ip_info_t ip_info;
+    tcpip_adapter_dns_info_t dns;
+} wifi_cache_t;
+
+static wifi_cache_t cache;
+static bool cache_valid = false;
+/*  the cached access point is used for the current attempts */
+static bool cache_used = false;
+static uint32_t attempts = 0;
+static int64_t connect_start = 0;
+static TimerHandle_t reconnect_timer = NULL;
+static wifi_task_stats_t stats;
+
+/**@brief read the cache of the last connection from the NVS
+ */
+static void load_cache(void)
+{
+    nvs_handle task_nvs_handle;
+    size_t length = sizeof(cache);
+
+    if (nvs_open(WIFI_NAMESPACE, NVS_READONLY, &task_nvs_handle) != ESP_OK)
+    {
+        return;
+    }
+    cache_valid = nvs_get_blob(task_nvs_handle, WIFI_CACHE_KEY, &cache,
+        &length) == ESP_OK && length == sizeof(cache);
+    nvs_close(task_nvs_handle);
+}
+
+/**@brief save the access point and ip configuration of a new connection
+ * 
+ * @details only written when something changed, usually a reconnect finds
+ * the same access point
+ */
+static void save_cache(const tcpip_adapter_ip_info_t *ip_info)
+{
+    wifi_ap_record_t ap_info;
+    wifi_cache_t current = { 0 };
+    nvs_handle task_nvs_handle;
+
+    if (esp_wifi_sta_get_ap_info(&ap_info) != ESP_OK) return;
+    memcpy(current.bssid, ap_info.bssid, sizeof(current.bssid));
+    current.channel = ap_info.primary;
+    current.ip_info = *ip_info;
+    tcpip_adapter_get_dns_info(TCPIP_ADAPTER_IF_STA, TCPIP_ADAPTER_DNS_MAIN,
+        &current.dns);
+
+    if (cache_valid && memcmp(&current, &cache, sizeof(cache)) == 0) return;
+
+    if (nvs_open(WIFI_NAMESPACE, NVS_READWRITE, &task_nvs_handle) != ESP_OK)
+    {
+        return;
+    }
+    if (nvs_set_blob(task_nvs_handle, WIFI_CACHE_KEY, &current,
+        sizeof(current)) == ESP_OK)
+    {
+        nvs_commit(task_nvs_handle);
+        cache = current;
+        cache_valid = true;
+        ESP_LOGI(TAG, "Access point on channel %d cached", current.channel);
+    }
+    nvs_close(task_nvs_handle);
+}
+
+/**@brief set the station config, with or without the cached access point
+ * 
+ * @details without the cache all channels get scanned for the best
+ * access point
+ */
+static void configure_station(bool use_cache)
+{
+    wifi_config_t wifi_config = {
+        .sta = {
+            .ssid = CONFIG_WIFI_SSID,
+            .password = CONFIG_WIFI_PASSWORD,
+        },
+    };
+
+    cache_used = use_cache && cache_valid;
+    if (cache_used)
+    {
+        wifi_config.sta.bssid_set = true;
+        memcpy(wifi_config.sta.bssid, cache.bssid, sizeof(cache.bssid));
+        wifi_config.sta.channel = cache.channel;
+    } else {
+        wifi_config.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+    }
+    esp_wifi_set_config(ESP_IF_WIFI_STA, &wifi_config);
+
+#if CONFIG_WIFI_STATIC_IP
+    /*  the cached address is only valid with the cached access point */
+    if (cache_used)
+    {
+        tcpip_adapter_dhcpc_stop(TCPIP_ADAPTER_IF_STA);
+        tcpip_adapter_set_ip_info(TCPIP_ADAPTER_IF_STA, &cache.ip_info);
+        tcpip_adapter_set_dns_info(TCPIP_ADAPTER_IF_STA, TCPIP_ADAPTER_DNS_MAIN,
+            &cache.dns);
+    } else {
+        tcpip_adapter_dhcpc_start(TCPIP_ADAPTER_IF_STA);
+    }
+#endif
+}
+
+/**@brief called by the reconnect timer after the backoff
+ */
+static void reconnect_timer_callback(TimerHandle_t timer)
+{
+    esp_wifi_connect();
+}
+
+/**@brief schedule the next connection attempt
+ * 
+ * @details the delay doubles with each failed attempt and is randomized
+ * between 50% and 100%
+ */
+static void schedule_reconnect(void)
+{
+    uint32_t delay = CONFIG_WIFI_RECONNECT_MAX_MS;
+    if (attempts < 16 && ((uint32_t)CONFIG_WIFI_RECONNECT_MIN_MS << attempts) < delay)
+    {
+        delay = CONFIG_WIFI_RECONNECT_MIN_MS << attempts;
+    }
+    delay = delay / 2 + esp_random() % (delay / 2 + 1);
+
+    ESP_LOGI(TAG, "Reconnecting in %u ms", (unsigned)delay);
+    xTimerChangePeriod(reconnect_timer, delay / portTICK_PERIOD_MS + 1, 0);
+}
+
 /**@brief function handles WiFi events
  */
 static esp_err_t wifi_event_handler(void *ctx, system_event_t *event)
 {
     switch (event->event_id) {
         case SYSTEM_EVENT_STA_START:
+            connect_start = esp_timer_get_time();
             esp_wifi_connect();
             break;
         case SYSTEM_EVENT_STA_GOT_IP:
             ESP_LOGI(TAG, "got ip:%s",
                 ip4addr_ntoa(&event->event_info.got_ip.ip_info.ip));
             xEventGroupSetBits(wifi_event_group, WIFI_CONNECTED_BIT);
+            boot_timing_mark(BOOT_PHASE_WIFI);
+
+            /*  time from the disconnect to the ip address */
+            stats.last_ms = (esp_timer_get_time() - connect_start) / 1000;
+            if (stats.last_ms > stats.max_ms) stats.max_ms = stats.last_ms;
+            stats.total_ms += stats.last_ms;
+            ++stats.connects;
+            if (!cache_used) ++stats.full_scans;
+            attempts = 0;
+            save_cache(&event->event_info.got_ip.ip_info);
+            /*  the access point found by the scan is used from now on */
+            if (!cache_used) configure_station(true);
             break;
         case SYSTEM_EVENT_STA_DISCONNECTED:
-            esp_wifi_connect();
-            xEventGroupClearBits(wifi_event_group, WIFI_CONNECTED_BIT);
+            if (xEventGroupGetBits(wifi_event_group) & WIFI_CONNECTED_BIT)
+            {
+                xEventGroupClearBits(wifi_event_group, WIFI_CONNECTED_BIT);
+                connect_start = esp_timer_get_time();
+            } else {
+                ++stats.failures;
+            }
+            ESP_LOGI(TAG, "disconnected, reason: %d",
+                event->event_info.disconnected.reason);
+
+            /*  the access point might have changed */
+            if (++attempts == WIFI_CACHE_ATTEMPTS && cache_used)
+            {
+                ESP_LOGI(TAG, "Cached access point not reachable, scanning");
+                configure_station(false);
+            }
+            schedule_reconnect();
             break;
         default:
             break;
@@ -33,29 +215,78 @@ static esp_err_t wifi_event_handler(void *ctx, system_event_t *event)
     return ESP_OK;
 }
 
+/**@brief copy the connection statistics
+ */
+void wifi_task_get_stats(wifi_task_stats_t *current_stats)
+{
+    *current_stats = stats;
+}
+
+/**@brief clear the connection statistics
+ */
+void wifi_task_reset_stats(void)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+/**@brief write the connection statistics as JSON into the buffer
+ * 
+ * @details times in ms from the disconnect (or the start) until the module
+ * got a ip address, returns the length or -1 when the buffer is too small
+ */
+int wifi_task_format_stats(char *buffer, int size)
+{
+    wifi_task_stats_t current;
+    wifi_task_get_stats(&current);
+
+    const int len = snprintf(buffer, size,
+        "{\"connects\":%u,\"failures\":%u,\"full_scans\":%u,\"last_ms\":%u,"
+        "\"mean_ms\":%u,\"max_ms\":%u}",
+        (unsigned)current.connects, (unsigned)current.failures,
+        (unsigned)current.full_scans, (unsigned)current.last_ms,
+        current.connects ? (unsigned)(current.total_ms / current.connects) : 0,
+        (unsigned)current.max_ms);
+    return len < size ? len : -1;
+}
+
+/**@brief wait until the module got a ip address
+ * 
+ * @details returns false when the timeout passed without a connection
+ */
+bool wifi_task_wait_connected(TickType_t timeout)
+{
+    return xEventGroupWaitBits(wifi_event_group, WIFI_CONNECTED_BIT, false,
+        true, timeout) & WIFI_CONNECTED_BIT;
+}
+
 /**@brief Function for initializing the Wifi connection using WPA2
+ * 
+ * @details does not wait for the connection, see wifi_task_wait_connected
  */
 esp_err_t wifi_task_init(void)
 {
     tcpip_adapter_init();
     wifi_event_group = xEventGroupCreate();
+    reconnect_timer = xTimerCreate("wifi_reconnect", 1, pdFALSE, NULL,
+        reconnect_timer_callback);
+    if (!wifi_event_group || !reconnect_timer) return ESP_ERR_NO_MEM;
+
+    load_cache();
     ESP_ERROR_CHECK(esp_event_loop_init(wifi_event_handler, NULL));
     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
     ESP_ERROR_CHECK(esp_wifi_init(&cfg));
     /*  only store config in RAM */
     ESP_ERROR_CHECK(esp_wifi_set_storage(WIFI_STORAGE_RAM));
-    wifi_config_t wifi_config = {
-        .sta = {
-            .ssid = CONFIG_WIFI_SSID,
-            .password = CONFIG_WIFI_PASSWORD,
-        },
-    };
 
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
-    ESP_ERROR_CHECK(esp_wifi_set_config(ESP_IF_WIFI_STA, &wifi_config));
+    configure_station(true);
     ESP_LOGI(TAG, "start the WIFI SSID:[%s]", CONFIG_WIFI_SSID);
     ESP_ERROR_CHECK(esp_wifi_start());
-    ESP_LOGI(TAG, "Waiting for wifi");
-    xEventGroupWaitBits(wifi_event_group, WIFI_CONNECTED_BIT, false, true, portMAX_DELAY);
+    /*  the radio sleeps between the beacons, commands get delayed by up to
+    *   one DTIM interval */
+    if (POWER_SAVE)
+    {
+        esp_wifi_set_ps(WIFI_PS_MIN_MODEM);
+    }
     return ESP_OK;
 }
@@ -4,6 +4,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <string.h>
+#include "freertos/FreeRTOS.h"
 #include "esp_err.h"
 
 /*  inform c++ compilers that the function should be compiled in C Style */
@@ -11,7 +12,21 @@
 extern "C" {
 #endif
 
+/*  connection statistics, times from the disconnect to the ip address */
+typedef struct {
+    uint32_t connects;      /* successful connections */
+    uint32_t failures;      /* failed connection attempts */
+    uint32_t full_scans;    /* connections without the cached access point */
+    uint32_t last_ms;
+    uint32_t max_ms;
+    uint32_t total_ms;
+} wifi_task_stats_t;
+
 esp_err_t wifi_task_init(void);
+bool wifi_task_wait_connected(TickType_t timeout);
+void wifi_task_get_stats(wifi_task_stats_t *stats);
+void wifi_task_reset_stats(void);
+int wifi_task_format_stats(char *buffer, int size);
 
 #ifdef __cplusplus
 }
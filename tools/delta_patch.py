@@ -0,0 +1,71 @@
+#!/usr/bin/env python3
+"""Create a patch for the delta OTA update (see main/delta_update.c).
+
+usage: delta_patch.py <old firmware.bin> <new firmware.bin> <patch output>
+
+Prints the sha256 of the new image, which belongs into the "patches" entry
+of the update JSON:
+    {"version": 0.2, "file": "<url of the full image>",
+     "patches": [{"from": 0.1, "file": "<url of the patch>", "sha256": "..."}]}
+The patch and the JSON can be served by any HTTP server for testing, e.g.
+"python3 -m http.server" with CONFIG_UPDATE_JSON_URL pointing to it.
+"""
+import hashlib
+import struct
+import sys
+
+MAGIC = b"BDP1"
+COPY = 0x01
+INSERT = 0x02
+BLOCK = 32          # minimum length of a copied part
+
+
+def make_patch(old, new):
+    # index of all blocks of the old image
+    index = {}
+    for offset in range(0, len(old) - BLOCK + 1):
+        index.setdefault(old[offset:offset + BLOCK], offset)
+
+    patch = bytearray(MAGIC + struct.pack("<I", len(new)))
+    insert = bytearray()
+    pos = 0
+    while pos < len(new):
+        offset = index.get(new[pos:pos + BLOCK])
+        if offset is None:
+            insert.append(new[pos])
+            pos += 1
+            continue
+
+        length = BLOCK
+        while (pos + length < len(new) and offset + length < len(old)
+               and new[pos + length] == old[offset + length]):
+            length += 1
+
+        if insert:
+            patch += struct.pack("<BI", INSERT, len(insert)) + insert
+            insert = bytearray()
+        patch += struct.pack("<BII", COPY, offset, length)
+        pos += length
+
+    if insert:
+        patch += struct.pack("<BI", INSERT, len(insert)) + insert
+    return patch
+
+
+def main():
+    if len(sys.argv) != 4:
+        sys.exit(__doc__)
+    with open(sys.argv[1], "rb") as old_file, open(sys.argv[2], "rb") as new_file:
+        old = old_file.read()
+        new = new_file.read()
+
+    patch = make_patch(old, new)
+    with open(sys.argv[3], "wb") as patch_file:
+        patch_file.write(patch)
+
+    print("patch: %d bytes, image: %d bytes" % (len(patch), len(new)))
+    print("sha256: %s" % hashlib.sha256(new).hexdigest())
+
+
+if __name__ == "__main__":
+    main()